@@ -130,37 +130,52 @@ arp_packet(void *arg)
 			dhcp_close(ifp);
 			return;
 		}
+		metrics_inc(ifp->ctx, ifp, MET_ARP_RX);
 		/* We must have a full ARP header */
-		if ((size_t)bytes < sizeof(ar))
+		if ((size_t)bytes < sizeof(ar)) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
+		}
 		memcpy(&ar, arp_buffer, sizeof(ar));
 		/* Families must match */
-		if (ar.ar_hrd != htons(ifp->family))
+		if (ar.ar_hrd != htons(ifp->family)) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
+		}
 		/* Protocol must be IP. */
-		if (ar.ar_pro != htons(ETHERTYPE_IP))
+		if (ar.ar_pro != htons(ETHERTYPE_IP)) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
-		if (ar.ar_pln != sizeof(arm.sip.s_addr))
+		}
+		if (ar.ar_pln != sizeof(arm.sip.s_addr)) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
+		}
 		/* Only these types are recognised */
 		if (ar.ar_op != htons(ARPOP_REPLY) &&
-		    ar.ar_op != htons(ARPOP_REQUEST))
+		    ar.ar_op != htons(ARPOP_REQUEST)) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
+		}
 
 		/* Get pointers to the hardware addreses */
 		hw_s = arp_buffer + sizeof(ar);
 		hw_t = hw_s + ar.ar_hln + ar.ar_pln;
 		/* Ensure we got all the data */
-		if ((hw_t + ar.ar_hln + ar.ar_pln) - arp_buffer > bytes)
+		if ((hw_t + ar.ar_hln + ar.ar_pln) - arp_buffer > bytes) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
+		}
 		/* Ignore messages from ourself */
 		TAILQ_FOREACH(ifn, ifp->ctx->ifaces, next) {
 			if (ar.ar_hln == ifn->hwlen &&
 			    memcmp(hw_s, ifn->hwaddr, ifn->hwlen) == 0)
 				break;
 		}
-		if (ifn)
+		if (ifn) {
+			metrics_inc(ifp->ctx, ifp, MET_ARP_DROP);
 			continue;
+		}
 		/* Copy out the HW and IP addresses */
 		memcpy(&arm.sha, hw_s, ar.ar_hln);
 		memcpy(&arm.sip.s_addr, hw_s + ar.ar_hln, ar.ar_pln);
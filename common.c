@@ -168,17 +168,6 @@ setvard(char ***e, const char *prefix, const char *var, size_t value)
 	return setvar(e, prefix, var, buffer);
 }
 
-
-time_t
-uptime(void)
-{
-	struct timeval tv;
-
-	if (get_monotonic(&tv) == -1)
-		return -1;
-	return tv.tv_sec;
-}
-
 char *
 hwaddr_ntoa(const unsigned char *hwaddr, size_t hwlen, char *buf, size_t buflen)
 {
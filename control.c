@@ -32,6 +32,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,6 +51,14 @@
             (sizeof(*(su)) - sizeof((su)->sun_path) + strlen((su)->sun_path))
 #endif
 
+/* Each queued message needs two iovecs, one for the length and
+ * one for the data. */
+#if defined(IOV_MAX) && IOV_MAX < CONTROL_QUEUE_MAX * 2
+#define CONTROL_IOV_MAX		IOV_MAX
+#else
+#define CONTROL_IOV_MAX		(CONTROL_QUEUE_MAX * 2)
+#endif
+
 static void
 control_queue_purge(struct dhcpcd_ctx *ctx, char *data)
 {
@@ -88,64 +97,151 @@ control_queue_free(struct fd_list *fd)
 	}
 }
 
+static void control_handle_legacy(void *);
+
 static void
 control_delete(struct fd_list *fd)
 {
 
 	TAILQ_REMOVE(&fd->ctx->control_fds, fd, next);
 	eloop_event_delete(fd->ctx->eloop, fd->fd, 0);
+	eloop_timeout_delete(fd->ctx->eloop, control_handle_legacy, fd);
 	close(fd->fd);
 	control_queue_free(fd);
+	free(fd->buf);
+	free(fd->argv);
 	free(fd);
 }
 
+/* Each command is \n terminated
+ * Each argument is NULL separated
+ * Commands may arrive split over several reads or several in one read,
+ * so any trailing partial command is kept for the next read.
+ * Older clients do not terminate the command, so if flush is set then
+ * any complete arguments left over are treated as a command.
+ * Only flush on EOF or once a client which has never terminated a
+ * command has stopped sending, otherwise a command split over two
+ * reads would run early.
+ * Replies are not limited, so commands are held while the client has
+ * more unread replies than the queue limit, such as a large
+ * --dumpstate, and run as the replies are written. */
+static int
+control_parse(struct fd_list *fd, int flush)
+{
+	char *cmd, *p, *e, *np, **nargv;
+	size_t argc, len;
+
+	cmd = p = fd->buf;
+	e = fd->buf + fd->buf_len;
+	argc = 0;
+	while (p < e || (flush && argc != 0)) {
+		if (argc == 0 &&
+		    fd->reply_bytes > fd->ctx->control_queue_bytes_max)
+			break;
+		if (p < e) {
+			np = memchr(p, '\0', (size_t)(e - p));
+			if (np == NULL)
+				break;
+			if (argc + 1 >= fd->argv_len) {
+				nargv = realloc(fd->argv,
+				    sizeof(char *) * (fd->argv_len + 16));
+				if (nargv == NULL)
+					return -1;
+				fd->argv = nargv;
+				fd->argv_len += 16;
+			}
+			fd->argv[argc++] = p;
+			len = (size_t)(np - p);
+			p = np + 1;
+			if (len == 0 || np[-1] != '\n')
+				continue;
+			np[-1] = '\0';
+			fd->flags |= FD_TERMINATED;
+		}
+		fd->argv[argc] = NULL;
+		if (dhcpcd_handleargs(fd->ctx, fd, (int)argc, fd->argv) == -1) {
+			syslog(LOG_ERR, "%s: dhcpcd_handleargs: %m", __func__);
+			if (errno != EINTR && errno != EAGAIN)
+				return -1;
+		}
+		cmd = p;
+		argc = 0;
+		if (fd->flags & FD_CLOSING)
+			break;
+	}
+
+	fd->buf_len = (size_t)(e - cmd);
+	if (fd->buf_len != 0 && cmd != fd->buf)
+		memmove(fd->buf, cmd, fd->buf_len);
+	return 0;
+}
+
+/* An older client has sent part of a command and then nothing more
+ * for a while, so assume it is waiting for a reply. */
+static void
+control_handle_legacy(void *arg)
+{
+	struct fd_list *fd = arg;
+
+	if (!(fd->flags & (FD_TERMINATED | FD_CLOSING)) &&
+	    fd->buf_len != 0 && control_parse(fd, 1) == -1)
+		control_delete(fd);
+}
+
+/* Only read once per wakeup so a busy client cannot starve the
+ * other events; if more is waiting we will be woken again. */
 static void
 control_handle_data(void *arg)
 {
 	struct fd_list *fd = arg;
-	char buffer[1024], *e, *p, *argvp[255], **ap, *a;
 	ssize_t bytes;
-	size_t len;
-	int argc;
-
-	bytes = read(fd->fd, buffer, sizeof(buffer) - 1);
+	char *nbuf;
+	size_t nsize;
+	struct timeval tv;
+
+	if (fd->buf_len == fd->buf_size) {
+		nsize = fd->buf_size + CONTROL_BUFFER_LEN;
+		if (nsize > CONTROL_BUFFER_MAX) {
+			syslog(LOG_ERR, "%s: fd %d: %s", __func__,
+			    fd->fd, fd->reply_bytes >
+			    fd->ctx->control_queue_bytes_max ?
+			    "replies not read" : "command too long");
+			control_delete(fd);
+			return;
+		}
+		if ((nbuf = realloc(fd->buf, nsize)) == NULL) {
+			syslog(LOG_ERR, "%s: %m", __func__);
+			control_delete(fd);
+			return;
+		}
+		fd->buf = nbuf;
+		fd->buf_size = nsize;
+	}
+	bytes = read(fd->fd, fd->buf + fd->buf_len,
+	    fd->buf_size - fd->buf_len);
+	if (bytes == -1 && (errno == EINTR || errno == EAGAIN))
+		return;
 	if (bytes == -1 || bytes == 0) {
 		/* Control was closed or there was an error.
-		 * Remove it from our list. */
+		 * Process what we have and remove it from our list. */
+		if (bytes == 0)
+			control_parse(fd, 1);
 		control_delete(fd);
 		return;
 	}
-	buffer[bytes] = '\0';
-	p = buffer;
-	e = buffer + bytes;
+	fd->buf_len += (size_t)bytes;
+	if (control_parse(fd, 0) == -1 || fd->flags & FD_CLOSING) {
+		if (!(fd->flags & FD_CLOSING))
+			control_delete(fd);
+		return;
+	}
 
-	/* Each command is \n terminated
-	 * Each argument is NULL separated */
-	while (p < e) {
-		argc = 0;
-		ap = argvp;
-		while (p < e) {
-			argc++;
-			if ((size_t)argc >= sizeof(argvp) / sizeof(argvp[0])) {
-				errno = ENOBUFS;
-				return;
-			}
-			a = *ap++ = p;
-			len = strlen(p);
-			p += len + 1;
-			if (len && a[len - 1] == '\n') {
-				a[len - 1] = '\0';
-				break;
-			}
-		}
-		*ap = NULL;
-		if (dhcpcd_handleargs(fd->ctx, fd, argc, argvp) == -1) {
-			syslog(LOG_ERR, "%s: dhcpcd_handleargs: %m", __func__);
-			if (errno != EINTR && errno != EAGAIN) {
-				control_delete(fd);
-				return;
-			}
-		}
+	/* Older clients wait for a reply without closing or terminating
+	 * the command, so run it once they stop sending. */
+	if (!(fd->flags & FD_TERMINATED) && fd->buf_len != 0) {
+		ms_to_tv(&tv, CONTROL_LEGACY_WAIT);
+		eloop_timeout_add_tv(fd->ctx->eloop, &tv,
+		    control_handle_legacy, fd);
 	}
 }
 
@@ -179,6 +275,13 @@ control_handle1(struct dhcpcd_ctx *ctx, int lfd, unsigned int fd_flags)
 		l->flags = fd_flags;
 		TAILQ_INIT(&l->queue);
 		TAILQ_INIT(&l->free_queue);
+		l->queue_len = l->queue_bytes = l->reply_bytes = 0;
+		l->queue_wpos = 0;
+		l->queue_drops = 0;
+		l->buf = NULL;
+		l->buf_len = l->buf_size = 0;
+		l->argv = NULL;
+		l->argv_len = 0;
 		TAILQ_INSERT_TAIL(&ctx->control_fds, l, next);
 		eloop_event_add(ctx->eloop, l->fd,
 		    control_handle_data, l, NULL, NULL);
@@ -321,8 +424,11 @@ freeit:
 	while ((l = TAILQ_FIRST(&ctx->control_fds))) {
 		TAILQ_REMOVE(&ctx->control_fds, l, next);
 		eloop_event_delete(ctx->eloop, l->fd, 0);
+		eloop_timeout_delete(ctx->eloop, control_handle_legacy, l);
 		close(l->fd);
 		control_queue_free(l);
+		free(l->buf);
+		free(l->argv);
 		free(l);
 	}
 
@@ -349,75 +455,199 @@ control_open(struct dhcpcd_ctx *ctx, const char *ifname)
 ssize_t
 control_send(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 {
-	char buffer[1024];
+	char *buffer;
 	int i;
 	size_t len, l;
+	ssize_t bytes;
 
-	if (argc > 255) {
+	if (argc == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	len = 0;
+	for (i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+	/* Terminate the command so it can be pipelined */
+	len++;
+	if (len > CONTROL_BUFFER_MAX) {
 		errno = ENOBUFS;
 		return -1;
 	}
+	if ((buffer = malloc(len)) == NULL)
+		return -1;
 	len = 0;
 	for (i = 0; i < argc; i++) {
 		l = strlen(argv[i]) + 1;
-		if (len + l > sizeof(buffer)) {
-			errno = ENOBUFS;
-			return -1;
-		}
 		memcpy(buffer + len, argv[i], l);
 		len += l;
 	}
-	return write(ctx->control_fd, buffer, len);
+	buffer[len - 1] = '\n';
+	buffer[len++] = '\0';
+	bytes = write(ctx->control_fd, buffer, len);
+	free(buffer);
+	return bytes;
 }
 
 static void
 control_writeone(void *arg)
 {
 	struct fd_list *fd;
-	struct iovec iov[2];
+	struct iovec iov[CONTROL_IOV_MAX];
 	struct fd_data *data;
+	int iovcnt;
+	size_t off, msg_len;
+	ssize_t bytes;
 
 	fd = arg;
-	data = TAILQ_FIRST(&fd->queue);
-	iov[0].iov_base = &data->data_len;
-	iov[0].iov_len = sizeof(size_t);
-	iov[1].iov_base = data->data;
-	iov[1].iov_len = data->data_len;
-	if (writev(fd->fd, iov, 2) == -1) {
+
+	/* Write as many queued messages as we can in one go.
+	 * The head of the queue may have been partially written. */
+	iovcnt = 0;
+	off = fd->queue_wpos;
+	TAILQ_FOREACH(data, &fd->queue, next) {
+		if (iovcnt + 2 > CONTROL_IOV_MAX)
+			break;
+		if (off < sizeof(data->data_len)) {
+			iov[iovcnt].iov_base = (char *)&data->data_len + off;
+			iov[iovcnt].iov_len = sizeof(data->data_len) - off;
+			iovcnt++;
+			off = 0;
+		} else
+			off -= sizeof(data->data_len);
+		iov[iovcnt].iov_base = data->data + off;
+		iov[iovcnt].iov_len = data->data_len - off;
+		iovcnt++;
+		off = 0;
+	}
+
+	bytes = writev(fd->fd, iov, iovcnt);
+	if (bytes == -1) {
 		syslog(LOG_ERR, "%s: writev fd %d: %m", __func__, fd->fd);
 		if (errno != EINTR && errno != EAGAIN)
 			control_delete(fd);
 		return;
 	}
 
-	TAILQ_REMOVE(&fd->queue, data, next);
-	if (data->freeit)
-		control_queue_purge(fd->ctx, data->data);
-	data->data = NULL; /* safety */
-	data->data_len = 0;
-	TAILQ_INSERT_TAIL(&fd->free_queue, data, next);
+	while ((data = TAILQ_FIRST(&fd->queue))) {
+		msg_len = sizeof(data->data_len) + data->data_len;
+		if (fd->queue_wpos + (size_t)bytes < msg_len) {
+			fd->queue_wpos += (size_t)bytes;
+			break;
+		}
+		bytes -= (ssize_t)(msg_len - fd->queue_wpos);
+		fd->queue_wpos = 0;
+
+		TAILQ_REMOVE(&fd->queue, data, next);
+		if (data->ifname[0] == '\0')
+			fd->reply_bytes -= msg_len;
+		else {
+			fd->queue_len--;
+			fd->queue_bytes -= msg_len;
+		}
+		if (data->freeit)
+			control_queue_purge(fd->ctx, data->data);
+		data->data = NULL; /* safety */
+		data->data_len = 0;
+		TAILQ_INSERT_TAIL(&fd->free_queue, data, next);
+	}
 
 	if (TAILQ_FIRST(&fd->queue) == NULL)
 		eloop_event_delete(fd->ctx->eloop, fd->fd, 1);
+
+	/* Run any commands held back by unread replies */
+	if (fd->buf_len != 0 && !(fd->flags & FD_CLOSING) &&
+	    fd->reply_bytes <= fd->ctx->control_queue_bytes_max &&
+	    control_parse(fd, 0) == -1)
+		control_delete(fd);
+}
+
+static int
+control_queue_full(const struct fd_list *fd, size_t len)
+{
+	const struct dhcpcd_ctx *ctx;
+
+	ctx = fd->ctx;
+	return (fd->queue_len >= ctx->control_queue_max ||
+	    fd->queue_bytes + len > ctx->control_queue_bytes_max);
+}
+
+/* Drop the oldest event queued for ifname, or any interface if NULL.
+ * Replies and the head of the queue if partially written are kept. */
+static int
+control_queue_drop(struct fd_list *fd, const char *ifname)
+{
+	struct fd_data *d;
+
+	TAILQ_FOREACH(d, &fd->queue, next) {
+		if (d->ifname[0] == '\0' ||
+		    (d == TAILQ_FIRST(&fd->queue) && fd->queue_wpos != 0))
+			continue;
+		if (ifname == NULL || strcmp(d->ifname, ifname) == 0)
+			break;
+	}
+	if (d == NULL)
+		return 0;
+
+	TAILQ_REMOVE(&fd->queue, d, next);
+	fd->queue_len--;
+	fd->queue_bytes -= sizeof(d->data_len) + d->data_len;
+	if (d->freeit)
+		control_queue_purge(fd->ctx, d->data);
+	d->data = NULL; /* safety */
+	d->data_len = 0;
+	TAILQ_INSERT_TAIL(&fd->free_queue, d, next);
+
+	if (fd->queue_drops++ == 0)
+		syslog(LOG_WARNING, "fd %d: control queue full, dropping events",
+		    fd->fd);
+	return 1;
 }
 
 int
-control_queue(struct fd_list *fd, char *data, size_t data_len, uint8_t fit)
+control_queue(struct fd_list *fd, const char *ifname,
+    char *data, size_t data_len, uint8_t fit)
 {
 	struct fd_data *d;
-	size_t n;
+	size_t len;
+
+	if (fd->flags & FD_CLOSING) {
+		errno = EPIPE;
+		return -1;
+	}
+
+	/* Replies to commands are never dropped and don't count
+	 * towards the limits, which are for events. */
+	len = sizeof(d->data_len) + data_len;
+	if (ifname != NULL && control_queue_full(fd, len)) {
+		switch (fd->ctx->control_queue_policy) {
+		case CONTROL_POLICY_DISCONNECT:
+			/* We could be processing a command from this fd,
+			 * so it's removed when the read side sees EOF. */
+			syslog(LOG_ERR, "fd %d: control queue full, disconnecting",
+			    fd->fd);
+			fd->flags |= FD_CLOSING;
+			shutdown(fd->fd, SHUT_RDWR);
+			eloop_event_delete(fd->ctx->eloop, fd->fd, 1);
+			errno = ENOBUFS;
+			return -1;
+		case CONTROL_POLICY_COALESCE:
+			control_queue_drop(fd, ifname);
+			break;
+		}
+		while (control_queue_full(fd, len) &&
+		    control_queue_drop(fd, NULL))
+			;
+		if (control_queue_full(fd, len)) {
+			fd->queue_drops++;
+			errno = ENOBUFS;
+			return -1;
+		}
+	}
 
 	d = TAILQ_FIRST(&fd->free_queue);
 	if (d) {
 		TAILQ_REMOVE(&fd->free_queue, d, next);
 	} else {
-		n = 0;
-		TAILQ_FOREACH(d, &fd->queue, next) {
-			if (++n == CONTROL_QUEUE_MAX) {
-				errno = ENOBUFS;
-				return -1;
-			}
-		}
 		d = malloc(sizeof(*d));
 		if (d == NULL)
 			return -1;
@@ -425,12 +655,59 @@ control_queue(struct fd_list *fd, char *data, size_t data_len, uint8_t fit)
 	d->data = data;
 	d->data_len = data_len;
 	d->freeit = fit;
+	if (ifname)
+		strlcpy(d->ifname, ifname, sizeof(d->ifname));
+	else
+		d->ifname[0] = '\0';
 	TAILQ_INSERT_TAIL(&fd->queue, d, next);
+	if (ifname) {
+		fd->queue_len++;
+		fd->queue_bytes += len;
+	} else
+		fd->reply_bytes += len;
 	eloop_event_add(fd->ctx->eloop, fd->fd,
 	    NULL, NULL, control_writeone, fd);
 	return 0;
 }
 
+int
+control_queuestats(struct fd_list *fd)
+{
+	struct fd_list *l;
+	char *buf, *p;
+	size_t len;
+	int n;
+
+	/* Each client is a NULL terminated string */
+	len = 0;
+	TAILQ_FOREACH(l, &fd->ctx->control_fds, next) {
+		n = snprintf(NULL, 0,
+		    "fd=%d flags=%u queued=%zu bytes=%zu replybytes=%zu"
+		    " drops=%lu",
+		    l->fd, l->flags, l->queue_len, l->queue_bytes,
+		    l->reply_bytes, l->queue_drops);
+		if (n == -1)
+			return -1;
+		len += (size_t)n + 1;
+	}
+	if ((buf = malloc(len)) == NULL)
+		return -1;
+	p = buf;
+	TAILQ_FOREACH(l, &fd->ctx->control_fds, next) {
+		n = snprintf(p, len - (size_t)(p - buf),
+		    "fd=%d flags=%u queued=%zu bytes=%zu replybytes=%zu"
+		    " drops=%lu",
+		    l->fd, l->flags, l->queue_len, l->queue_bytes,
+		    l->reply_bytes, l->queue_drops);
+		p += n + 1;
+	}
+	if (control_queue(fd, NULL, buf, len, 1) == -1) {
+		free(buf);
+		return -1;
+	}
+	return 0;
+}
+
 void
 control_close(struct dhcpcd_ctx *ctx)
 {
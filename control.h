@@ -30,14 +30,29 @@
 
 #include "dhcpcd.h"
 
-/* Limit queue size per fd */
+/* Size to grow the command buffer by and the maximum size of one command */
+#define CONTROL_BUFFER_LEN	1024
+#define CONTROL_BUFFER_MAX	(64 * 1024)
+
+/* How long to wait for more of a command from a client which does not
+ * terminate them before running what it has sent, in milliseconds */
+#define CONTROL_LEGACY_WAIT	50
+
+/* Default limits of the queue per fd */
 #define CONTROL_QUEUE_MAX	100
+#define CONTROL_QUEUE_BYTES_MAX	(1024 * 1024)
+
+/* What to do with events for a listener whose queue is full */
+#define CONTROL_POLICY_DROP		0	/* drop the oldest event */
+#define CONTROL_POLICY_COALESCE		1	/* keep the latest per interface */
+#define CONTROL_POLICY_DISCONNECT	2	/* close the listener */
 
 struct fd_data {
 	TAILQ_ENTRY(fd_data) next;
 	char *data;
 	size_t data_len;
 	uint8_t freeit;
+	char ifname[IF_NAMESIZE];	/* set if an event which can be dropped */
 };
 TAILQ_HEAD(fd_data_head, fd_data);
 
@@ -48,17 +63,31 @@ struct fd_list {
 	unsigned int flags;
 	struct fd_data_head queue;
 	struct fd_data_head free_queue;
+	size_t queue_len;	/* events queued */
+	size_t queue_bytes;	/* bytes of events queued */
+	size_t reply_bytes;	/* bytes of replies queued */
+	size_t queue_wpos;	/* bytes of the queue head already written */
+	unsigned long queue_drops;
+	char *buf;		/* unprocessed command data */
+	size_t buf_len;
+	size_t buf_size;
+	char **argv;
+	size_t argv_len;
 };
 TAILQ_HEAD(fd_list_head, fd_list);
 
 #define FD_LISTEN	(1<<0)
 #define FD_UNPRIV	(1<<1)
+#define FD_CLOSING	(1<<2)
+#define FD_TERMINATED	(1<<3)	/* client has sent a \n terminated command */
 
 int control_start(struct dhcpcd_ctx *, const char *);
 int control_stop(struct dhcpcd_ctx *);
 int control_open(struct dhcpcd_ctx *, const char *);
 ssize_t control_send(struct dhcpcd_ctx *, int, char * const *);
-int control_queue(struct fd_list *fd, char *data, size_t data_len, uint8_t fit);
+int control_queue(struct fd_list *fd, const char *ifname,
+    char *data, size_t data_len, uint8_t fit);
+int control_queuestats(struct fd_list *fd);
 void control_close(struct dhcpcd_ctx *ctx);
 
 #endif
@@ -201,7 +201,8 @@ get_option(struct dhcpcd_ctx *ctx,
 				e = p + sizeof(dhcp->servername);
 			} else
 				goto exit;
-			break;
+			/* No length to read */
+			continue;
 		case DHO_OPTIONSOVERLOADED:
 			/* Ensure we only get this option once by setting
 			 * the last bit as well as the value.
@@ -702,7 +703,7 @@ make_message(struct dhcp_message **message,
 	struct if_options *ifo = iface->options;
 	const struct dhcp_state *state = D_CSTATE(iface);
 	const struct dhcp_lease *lease = &state->lease;
-	time_t up = uptime() - state->start_uptime;
+	time_t up = eloop_uptime(iface->ctx->eloop) - state->start_uptime;
 	char hbuf[HOSTNAME_MAX_LEN + 1];
 	const char *hostname;
 	const struct vivco *vivco;
@@ -2774,11 +2775,13 @@ dhcp_handlepacket(void *arg)
 			arp_close(ifp);
 			break;
 		}
+		metrics_inc(ifp->ctx, ifp, MET_DHCP_RX);
 		if (valid_udp_packet(ifp->ctx->packet, bytes,
 		    &from, flags & RAW_PARTIALCSUM) == -1)
 		{
 			syslog(LOG_ERR, "%s: invalid UDP packet from %s",
 			    ifp->name, inet_ntoa(from));
+			metrics_inc(ifp->ctx, ifp, MET_DHCP_DROP);
 			continue;
 		}
 		i = whitelisted_ip(ifp->options, from.s_addr);
@@ -2786,6 +2789,7 @@ dhcp_handlepacket(void *arg)
 			syslog(LOG_WARNING,
 			    "%s: non whitelisted DHCP packet from %s",
 			    ifp->name, inet_ntoa(from));
+			metrics_inc(ifp->ctx, ifp, MET_DHCP_DROP);
 			continue;
 		} else if (i != 1 &&
 		    blacklisted_ip(ifp->options, from.s_addr) == 1)
@@ -2793,6 +2797,7 @@ dhcp_handlepacket(void *arg)
 			syslog(LOG_WARNING,
 			    "%s: blacklisted DHCP packet from %s",
 			    ifp->name, inet_ntoa(from));
+			metrics_inc(ifp->ctx, ifp, MET_DHCP_DROP);
 			continue;
 		}
 		if (ifp->flags & IFF_POINTOPOINT &&
@@ -2807,6 +2812,7 @@ dhcp_handlepacket(void *arg)
 			syslog(LOG_ERR,
 			    "%s: packet greater than DHCP size from %s",
 			    ifp->name, inet_ntoa(from));
+			metrics_inc(ifp->ctx, ifp, MET_DHCP_DROP);
 			continue;
 		}
 		if (dhcp == NULL) {
@@ -2820,6 +2826,7 @@ dhcp_handlepacket(void *arg)
 		if (dhcp->cookie != htonl(MAGIC_COOKIE)) {
 			syslog(LOG_DEBUG, "%s: bogus cookie from %s",
 			    ifp->name, inet_ntoa(from));
+			metrics_inc(ifp->ctx, ifp, MET_DHCP_DROP);
 			continue;
 		}
 		/* Ensure packet is for us */
@@ -2832,6 +2839,7 @@ dhcp_handlepacket(void *arg)
 			    ifp->name, ntohl(dhcp->xid),
 			    hwaddr_ntoa(dhcp->chaddr, sizeof(dhcp->chaddr),
 				buf, sizeof(buf)));
+			metrics_inc(ifp->ctx, ifp, MET_DHCP_DROP);
 			continue;
 		}
 		dhcp_handledhcp(ifp, &dhcp, &from);
@@ -2980,6 +2988,7 @@ dhcp_init(struct interface *ifp)
 	state->state = DHS_INIT;
 	state->reason = "PREINIT";
 	state->nakoff = 0;
+	free(state->leasefile);
 	state->leasefile = calloc(1, strlen(ifp->ssid) + IF_NAMESIZE + sizeof(LEASEFILE) + 1);
 	snprintf(state->leasefile, strlen(ifp->ssid) + IF_NAMESIZE + sizeof(LEASEFILE) + 1,
 		LEASEFILE, ifp->name, ifp->ssid);
@@ -3075,7 +3084,7 @@ dhcp_start1(void *arg)
 	}
 
 	state = D_STATE(ifp);
-	state->start_uptime = uptime();
+	state->start_uptime = eloop_uptime(ifp->ctx->eloop);
 	free(state->offer);
 	state->offer = NULL;
 
@@ -3130,8 +3139,7 @@ dhcp_start1(void *arg)
 				state->addr = state->lease.addr;
 				state->net = state->lease.net;
 				state->added |= STATE_ADDED | STATE_FAKE;
-				ipv4_sortinterfaces(ifp->ctx);
-				ipv4_buildroutes(ifp->ctx);
+				ipv4_buildifroutes(ifp);
 			} else
 				syslog(LOG_ERR, "%s: %m", __func__);
 		}
@@ -3276,7 +3284,7 @@ dhcp_handleifa(int type, struct interface *ifp,
 				dhcp_message_add_addr(state->new, i, *dst);
 	}
 	state->reason = "STATIC";
-	ipv4_buildroutes(ifp->ctx);
+	ipv4_buildifroutes(ifp);
 	script_runreason(ifp, state->reason);
 	if (ifo->options & DHCPCD_INFORM) {
 		state->state = DHS_INFORM;
@@ -307,7 +307,7 @@ dhcp6_updateelapsed(struct interface *ifp, struct dhcp6_message *m, size_t len)
 
 	o = __UNCONST(co);
 	state = D6_STATE(ifp);
-	up = uptime() - state->start_uptime;
+	up = eloop_uptime(ifp->ctx->eloop) - state->start_uptime;
 	if (up < 0 || up > (time_t)UINT16_MAX)
 		up = (time_t)UINT16_MAX;
 	u16 = htons(up);
@@ -946,7 +946,7 @@ dhcp6_freedrop_addrs(struct interface *ifp, int drop,
 	if (state) {
 		ipv6_freedrop_addrs(&state->addrs, drop, ifd);
 		if (drop)
-			ipv6_buildroutes(ifp->ctx);
+			ipv6_buildifroutes(ifp);
 	}
 }
 
@@ -1212,7 +1212,7 @@ dhcp6_startrenew(void *arg)
 	ifp = arg;
 	state = D6_STATE(ifp);
 	state->state = DH6S_RENEW;
-	state->start_uptime = uptime();
+	state->start_uptime = eloop_uptime(ifp->ctx->eloop);
 	state->RTC = 0;
 	state->IRT = REN_TIMEOUT;
 	state->MRT = REN_MAX_RT;
@@ -1354,7 +1354,7 @@ dhcp6_startdiscover(void *arg)
 	syslog(LOG_INFO, "%s: soliciting a DHCPv6 lease", ifp->name);
 	state = D6_STATE(ifp);
 	state->state = DH6S_DISCOVER;
-	state->start_uptime = uptime();
+	state->start_uptime = eloop_uptime(ifp->ctx->eloop);
 	state->RTC = 0;
 	state->IMD = SOL_MAX_DELAY;
 	state->IRT = SOL_TIMEOUT;
@@ -1512,7 +1512,7 @@ dhcp6_startconfirm(struct interface *ifp)
 
 	state = D6_STATE(ifp);
 	state->state = DH6S_CONFIRM;
-	state->start_uptime = uptime();
+	state->start_uptime = eloop_uptime(ifp->ctx->eloop);
 	state->RTC = 0;
 	state->IMD = CNF_MAX_DELAY;
 	state->IRT = CNF_TIMEOUT;
@@ -1541,7 +1541,7 @@ dhcp6_startinform(void *arg)
 		syslog(LOG_INFO, "%s: requesting DHCPv6 information",
 		    ifp->name);
 	state->state = DH6S_INFORM;
-	state->start_uptime = uptime();
+	state->start_uptime = eloop_uptime(ifp->ctx->eloop);
 	state->RTC = 0;
 	state->IMD = INF_MAX_DELAY;
 	state->IRT = INF_TIMEOUT;
@@ -1584,7 +1584,7 @@ dhcp6_startrelease(struct interface *ifp)
 		return;
 
 	state->state = DH6S_RELEASE;
-	state->start_uptime = uptime();
+	state->start_uptime = eloop_uptime(ifp->ctx->eloop);
 	state->RTC = 0;
 	state->IRT = REL_TIMEOUT;
 	state->MRT = 0;
@@ -2067,7 +2067,7 @@ dhcp6_validatelease(struct interface *ifp,
 	state->renew = state->rebind = state->expire = 0;
 	state->lowpl = ND6_INFINITE_LIFETIME;
 	if (!acquired) {
-		get_monotonic(&aq);
+		eloop_gettime(ifp->ctx->eloop, &aq);
 		acquired = &aq;
 	}
 	nia = dhcp6_findia(ifp, m, len, sfrom, acquired);
@@ -2144,7 +2144,7 @@ dhcp6_readlease(struct interface *ifp)
 	}
 
 	gettimeofday(&now, NULL);
-	get_monotonic(&acquired);
+	eloop_gettime(ifp->ctx->eloop, &acquired);
 	acquired.tv_sec -= now.tv_sec - st.st_mtime;
 
 	/* Check to see if the lease is still valid */
@@ -2451,6 +2451,7 @@ dhcp6_delegate_prefix(struct interface *ifp)
 		if (k && !carrier_warned) {
 			ifd_state = D6_STATE(ifd);
 			ipv6_addaddrs(&ifd_state->addrs);
+			ipv6_buildifroutes(ifd);
 			dhcp6_script_try_run(ifd, 1);
 		}
 	}
@@ -2515,7 +2516,7 @@ dhcp6_find_delegates(struct interface *ifp)
 		state = D6_STATE(ifp);
 		state->state = DH6S_DELEGATED;
 		ipv6_addaddrs(&state->addrs);
-		ipv6_buildroutes(ifp->ctx);
+		ipv6_buildifroutes(ifp);
 		dhcp6_script_try_run(ifp, 1);
 	}
 	return k;
@@ -2988,7 +2989,7 @@ recv:
 		else if (state->expire == 0)
 			syslog(has_new ? LOG_INFO : LOG_DEBUG,
 			    "%s: will expire", ifp->name);
-		ipv6_buildroutes(ifp->ctx);
+		ipv6_buildifroutes(ifp);
 		dhcp6_writelease(ifp);
 		dhcp6_script_try_run(ifp, 0);
 	}
@@ -3130,6 +3131,7 @@ dhcp6_start1(void *arg)
 					TAILQ_REMOVE(ifs, ifn, next);
 					TAILQ_INSERT_AFTER(ifp->ctx->ifaces,
 					    ifp, ifn, next);
+					if_freehash(ifp->ctx);
 					dhcpcd_initstate(ifn);
 					ifn->options->options |=
 					    DHCPCD_PFXDLGONLY;
@@ -3277,6 +3279,7 @@ dhcp6_freedrop(struct interface *ifp, int drop, const char *reason)
 			ifpx->options->options |= DHCPCD_EXITING;
 		dhcp6_freedrop(ifpx, dropdele ? 1 : drop, reason);
 		TAILQ_REMOVE(ifp->ctx->ifaces, ifpx, next);
+		if_hashdel(ifp->ctx, ifpx);
 		if_free(ifpx);
 	}
 
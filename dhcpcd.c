@@ -135,8 +135,11 @@ printf("usage: "PACKAGE"\t[-46ABbDdEGgHJKkLnpqTVw]\n"
 static void
 free_globals(struct dhcpcd_ctx *ctx)
 {
+#ifdef EMBEDDED_CONFIG
 	struct dhcp_opt *opt;
+#endif
 
+	free_config(ctx);
 	if (ctx->ifac) {
 		for (; ctx->ifac > 0; ctx->ifac--)
 			free(ctx->ifav[ctx->ifac - 1]);
@@ -156,6 +159,19 @@ free_globals(struct dhcpcd_ctx *ctx)
 		ctx->ifcv = NULL;
 	}
 
+#ifndef EMBEDDED_CONFIG
+	/* Our option definitions are static, see genembedc */
+#ifdef INET
+	ctx->dhcp_opts = NULL;
+	ctx->dhcp_opts_len = 0;
+#endif
+#ifdef INET6
+	ctx->dhcp6_opts = NULL;
+	ctx->dhcp6_opts_len = 0;
+#endif
+	ctx->vivso = NULL;
+	ctx->vivso_len = 0;
+#else
 #ifdef INET
 	if (ctx->dhcp_opts) {
 		for (opt = ctx->dhcp_opts;
@@ -184,6 +200,7 @@ free_globals(struct dhcpcd_ctx *ctx)
 		free(ctx->vivso);
 		ctx->vivso = NULL;
 	}
+#endif
 }
 
 static void
@@ -329,6 +346,7 @@ stop_interface(struct interface *ifp)
 
 	/* Remove the interface from our list */
 	TAILQ_REMOVE(ifp->ctx->ifaces, ifp, next);
+	if_hashdel(ifp->ctx, ifp);
 	if_free(ifp);
 
 	if (!(ctx->options & (DHCPCD_MASTER | DHCPCD_TEST)))
@@ -495,10 +513,10 @@ configure_interface1(struct interface *ifp)
 		ifo->auth.options &= ~DHCPCD_AUTH_REQUIRE;
 }
 
-int
-dhcpcd_selectprofile(struct interface *ifp, const char *profile)
+static struct if_options *
+read_ifconfig(struct interface *ifp, const char *profile,
+    int argc, char **argv)
 {
-	struct if_options *ifo;
 	char pssid[PROFILE_LEN];
 
 	if (ifp->ssid_len) {
@@ -512,9 +530,20 @@ dhcpcd_selectprofile(struct interface *ifp, const char *profile)
 		}
 	} else
 		pssid[0] = '\0';
-	ifo = read_config(ifp->ctx, ifp->name, pssid, profile);
+	return read_config(ifp->ctx, ifp->name, pssid, profile, argc, argv);
+}
+
+static int
+select_profile(struct interface *ifp, const char *profile,
+    int argc, char **argv)
+{
+	struct if_options *ifo;
+
+	ifo = read_ifconfig(ifp, profile, argc, argv);
 	if (ifo == NULL) {
-		syslog(LOG_DEBUG, "%s: no profile %s", ifp->name, profile);
+		if (profile != NULL)
+			syslog(LOG_DEBUG, "%s: no profile %s",
+			    ifp->name, profile);
 		return -1;
 	}
 	if (profile != NULL) {
@@ -530,12 +559,18 @@ dhcpcd_selectprofile(struct interface *ifp, const char *profile)
 	return 1;
 }
 
+int
+dhcpcd_selectprofile(struct interface *ifp, const char *profile)
+{
+
+	return select_profile(ifp, profile, 0, NULL);
+}
+
 static void
 configure_interface(struct interface *ifp, int argc, char **argv)
 {
 
-	dhcpcd_selectprofile(ifp, NULL);
-	add_options(ifp->ctx, ifp->name, ifp->options, argc, argv);
+	select_profile(ifp, NULL, argc, argv);
 	configure_interface1(ifp);
 }
 
@@ -568,6 +603,12 @@ dhcpcd_handlecarrier(struct dhcpcd_ctx *ctx, int carrier, unsigned int flags,
 	if (ifp == NULL || !(ifp->options->options & DHCPCD_LINK))
 		return;
 
+	/* Whatever is pending is older than this */
+	if (ifp->link_pending) {
+		eloop_q_timeout_delete(ctx->eloop, ELOOP_LINK, NULL, ifp);
+		ifp->link_pending = 0;
+	}
+
 	switch(carrier) {
 	case LINK_UNKNOWN:
 		carrier = if_carrier(ifp); /* will set ifp->flags */
@@ -629,6 +670,130 @@ dhcpcd_handlecarrier(struct dhcpcd_ctx *ctx, int carrier, unsigned int flags,
 	}
 }
 
+static void
+dhcpcd_linkdebounced(void *arg)
+{
+	struct interface *ifp = arg;
+
+	ifp->link_pending = 0;
+	dhcpcd_handlecarrier(ifp->ctx, ifp->link_carrier, ifp->link_flags,
+	    ifp->name);
+}
+
+/* A flapping switch port or a driver reset can send many link messages
+ * in a short time. Instead of acting on each one, remember the latest
+ * carrier and flags and act once the link_debounce window is over.
+ * If the link ends up where it started, nothing happens at all. */
+void
+dhcpcd_handlelink(struct dhcpcd_ctx *ctx, int carrier, unsigned int flags,
+    const char *ifname)
+{
+	struct interface *ifp;
+	struct timeval tv;
+
+	if (ctx->link_debounce == 0) {
+		dhcpcd_handlecarrier(ctx, carrier, flags, ifname);
+		return;
+	}
+
+	ifp = if_find(ctx, ifname);
+	if (ifp == NULL || !(ifp->options->options & DHCPCD_LINK))
+		return;
+	ifp->link_carrier = carrier;
+	ifp->link_flags = flags;
+	if (ifp->link_pending++)
+		return;
+	tv.tv_sec = ctx->link_debounce / 1000;
+	tv.tv_usec = (suseconds_t)(ctx->link_debounce % 1000) * 1000;
+	if (eloop_q_timeout_add_tv(ctx->eloop, ELOOP_LINK, &tv,
+	    dhcpcd_linkdebounced, ifp) == -1)
+		dhcpcd_linkdebounced(ifp);
+}
+
+/* Names of new interfaces waiting for dhcpcd_handleadded */
+struct if_added {
+	struct if_added *hnext;
+	char name[IF_NAMESIZE];
+};
+
+static struct if_added **
+dhcpcd_findadded(struct if_added **added, size_t size, const char *ifname)
+{
+	struct if_added **b;
+
+	if (added == NULL)
+		return NULL;
+	for (b = &added[if_hashname(ifname, size)]; *b; b = &(*b)->hnext) {
+		if (strcmp((*b)->name, ifname) == 0)
+			return b;
+	}
+	return NULL;
+}
+
+static int
+dhcpcd_addadded(struct dhcpcd_ctx *ctx, const char *ifname)
+{
+	struct if_added **nb, **b, *a, *an;
+	size_t i, size;
+
+	/* Double the buckets as the set grows */
+	if (ctx->link_added_len * 2 >= ctx->link_added_size) {
+		size = ctx->link_added_size ? ctx->link_added_size << 1 : 16;
+		if ((nb = calloc(size, sizeof(*nb))) == NULL)
+			return -1;
+		for (i = 0; i < ctx->link_added_size; i++) {
+			for (a = ctx->link_added[i]; a; a = an) {
+				an = a->hnext;
+				b = &nb[if_hashname(a->name, size)];
+				a->hnext = *b;
+				*b = a;
+			}
+		}
+		free(ctx->link_added);
+		ctx->link_added = nb;
+		ctx->link_added_size = size;
+	}
+	if ((a = malloc(sizeof(*a))) == NULL)
+		return -1;
+	strlcpy(a->name, ifname, sizeof(a->name));
+	b = &ctx->link_added[if_hashname(ifname, ctx->link_added_size)];
+	a->hnext = *b;
+	*b = a;
+	ctx->link_added_len++;
+	return 0;
+}
+
+static void
+dhcpcd_freeadded(struct if_added **added, size_t size)
+{
+	struct if_added *a, *an;
+	size_t i;
+
+	if (added == NULL)
+		return;
+	for (i = 0; i < size; i++) {
+		for (a = added[i]; a; a = an) {
+			an = a->hnext;
+			free(a);
+		}
+	}
+	free(added);
+}
+
+static void
+dhcpcd_unqueueinterface(struct dhcpcd_ctx *ctx, const char *ifname)
+{
+	struct if_added **b, *a;
+
+	b = dhcpcd_findadded(ctx->link_added, ctx->link_added_size, ifname);
+	if (b != NULL) {
+		a = *b;
+		*b = a->hnext;
+		free(a);
+		ctx->link_added_len--;
+	}
+}
+
 static void
 warn_iaid_conflict(struct interface *ifp, uint8_t *iaid)
 {
@@ -807,20 +972,6 @@ dhcpcd_prestartinterface(void *arg)
 	dhcpcd_startinterface(ifp);
 }
 
-static void
-handle_link(void *arg)
-{
-	struct dhcpcd_ctx *ctx;
-
-	ctx = arg;
-	if (if_managelink(ctx) == -1) {
-		syslog(LOG_ERR, "if_managelink: %m");
-		eloop_event_delete(ctx->eloop, ctx->link_fd, 0);
-		close(ctx->link_fd);
-		ctx->link_fd = -1;
-	}
-}
-
 static void
 dhcpcd_initstate1(struct interface *ifp, int argc, char **argv)
 {
@@ -870,17 +1021,75 @@ run_preinit(struct interface *ifp)
 		    ifp->carrier == LINK_UP ? "CARRIER" : "NOCARRIER");
 }
 
+/* If running off an interface list, check it's in it. */
+static int
+dhcpcd_listed(const struct dhcpcd_ctx *ctx, const char *ifname)
+{
+	int i;
+
+	if (ctx->ifc == 0)
+		return 1;
+	for (i = 0; i < ctx->ifc; i++)
+		if (strcmp(ctx->ifv[i], ifname) == 0)
+			return 1;
+	return 0;
+}
+
+/* Start on an interface found by if_discover, taking it off ifs,
+ * or update the one we already have. */
+static void
+dhcpcd_attachinterface(struct dhcpcd_ctx *ctx, struct if_head *ifs,
+    struct interface *ifp, int action)
+{
+	struct interface *iff;
+
+	/* Check if we already have the interface */
+	iff = if_find(ctx, ifp->name);
+	if (iff) {
+		syslog(LOG_DEBUG, "%s: interface updated", iff->name);
+		/* The flags and hwaddr could have changed */
+		iff->flags = ifp->flags;
+		iff->hwlen = ifp->hwlen;
+		if (ifp->hwlen != 0)
+			memcpy(iff->hwaddr, ifp->hwaddr, iff->hwlen);
+	} else {
+		syslog(LOG_DEBUG, "%s: interface added", ifp->name);
+		TAILQ_REMOVE(ifs, ifp, next);
+		TAILQ_INSERT_TAIL(ctx->ifaces, ifp, next);
+		if_hashadd(ctx, ifp);
+		dhcpcd_initstate(ifp);
+		run_preinit(ifp);
+		iff = ifp;
+	}
+	if (action > 0)
+		dhcpcd_prestartinterface(iff);
+}
+
+static void
+dhcpcd_freeifs(struct if_head *ifs)
+{
+	struct interface *ifp;
+
+	/* Free our discovered list */
+	while ((ifp = TAILQ_FIRST(ifs))) {
+		TAILQ_REMOVE(ifs, ifp, next);
+		if_free(ifp);
+	}
+	free(ifs);
+}
+
 int
 dhcpcd_handleinterface(void *arg, int action, const char *ifname)
 {
 	struct dhcpcd_ctx *ctx;
 	struct if_head *ifs;
-	struct interface *ifp, *iff, *ifn;
+	struct interface *ifp, *ifn;
 	const char * const argv[] = { ifname };
 	int i;
 
 	ctx = arg;
 	if (action == -1) {
+		dhcpcd_unqueueinterface(ctx, ifname);
 		ifp = if_find(ctx, ifname);
 		if (ifp == NULL) {
 			errno = ESRCH;
@@ -892,14 +1101,8 @@ dhcpcd_handleinterface(void *arg, int action, const char *ifname)
 		return 0;
 	}
 
-	/* If running off an interface list, check it's in it. */
-	if (ctx->ifc && action != 2) {
-		for (i = 0; i < ctx->ifc; i++)
-			if (strcmp(ctx->ifv[i], ifname) == 0)
-				break;
-		if (i >= ctx->ifc)
-			return 0;
-	}
+	if (action != 2 && !dhcpcd_listed(ctx, ifname))
+		return 0;
 
 	i = -1;
 	ifs = if_discover(ctx, -1, UNCONST(argv));
@@ -907,39 +1110,163 @@ dhcpcd_handleinterface(void *arg, int action, const char *ifname)
 		if (strcmp(ifp->name, ifname) != 0)
 			continue;
 		i = 0;
-		/* Check if we already have the interface */
-		iff = if_find(ctx, ifp->name);
-		if (iff) {
-			syslog(LOG_DEBUG, "%s: interface updated", iff->name);
-			/* The flags and hwaddr could have changed */
-			iff->flags = ifp->flags;
-			iff->hwlen = ifp->hwlen;
-			if (ifp->hwlen != 0)
-				memcpy(iff->hwaddr, ifp->hwaddr, iff->hwlen);
-		} else {
-			syslog(LOG_DEBUG, "%s: interface added", ifp->name);
-			TAILQ_REMOVE(ifs, ifp, next);
-			TAILQ_INSERT_TAIL(ctx->ifaces, ifp, next);
-			dhcpcd_initstate(ifp);
-			run_preinit(ifp);
-			iff = ifp;
-		}
-		if (action > 0)
-			dhcpcd_prestartinterface(iff);
+		dhcpcd_attachinterface(ctx, ifs, ifp, action);
 	}
-
-	/* Free our discovered list */
-	while ((ifp = TAILQ_FIRST(ifs))) {
-		TAILQ_REMOVE(ifs, ifp, next);
-		if_free(ifp);
-	}
-	free(ifs);
+	dhcpcd_freeifs(ifs);
 
 	if (i == -1)
 		errno = ENOENT;
 	return i;
 }
 
+static void
+dhcpcd_handleadded(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+	struct if_added **added;
+	struct if_head *ifs;
+	struct interface *ifp, *ifn;
+	size_t size;
+
+	/* Handling an interface can queue more */
+	added = ctx->link_added;
+	size = ctx->link_added_size;
+	ctx->link_added = NULL;
+	ctx->link_added_size = ctx->link_added_len = 0;
+
+	/* Discover once for the whole batch and pick the new ones out */
+	ifs = if_discover(ctx, 0, NULL);
+	if (ifs == NULL)
+		syslog(LOG_ERR, "%s: if_discover: %m", __func__);
+	else {
+		TAILQ_FOREACH_SAFE(ifp, ifs, next, ifn) {
+			if (dhcpcd_findadded(added, size, ifp->name) != NULL &&
+			    dhcpcd_listed(ctx, ifp->name))
+				dhcpcd_attachinterface(ctx, ifs, ifp, 1);
+		}
+		dhcpcd_freeifs(ifs);
+	}
+	dhcpcd_freeadded(added, size);
+}
+
+/* Creating a lot of interfaces at once sends a few messages for each
+ * one. Collect the names over the link_debounce window so they are
+ * all discovered with one if_discover. */
+int
+dhcpcd_queueinterface(struct dhcpcd_ctx *ctx, const char *ifname)
+{
+	struct timeval tv;
+
+	if (ctx->link_debounce == 0)
+		return dhcpcd_handleinterface(ctx, 1, ifname);
+
+	if (dhcpcd_findadded(ctx->link_added, ctx->link_added_size,
+	    ifname) != NULL)
+		return 0;
+	if (dhcpcd_addadded(ctx, ifname) == -1) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		return dhcpcd_handleinterface(ctx, 1, ifname);
+	}
+	if (ctx->link_added_len > 1)
+		return 0;
+	tv.tv_sec = ctx->link_debounce / 1000;
+	tv.tv_usec = (suseconds_t)(ctx->link_debounce % 1000) * 1000;
+	if (eloop_timeout_add_tv(ctx->eloop, &tv,
+	    dhcpcd_handleadded, ctx) == -1)
+		dhcpcd_handleadded(ctx);
+	return 0;
+}
+
+/* The link socket overflowed, so interfaces may have come or gone and
+ * their flags, carrier or routes changed without us being told.
+ * Discover every interface again and restore our routes. */
+static void
+dhcpcd_resync(struct dhcpcd_ctx *ctx)
+{
+	struct if_head *ifs;
+	struct interface *ifp, *ifn, *iff, **found;
+	char (*gone)[IF_NAMESIZE];
+	size_t size, len, i;
+
+	if ((ifs = if_discover(ctx, 0, NULL)) == NULL) {
+		syslog(LOG_ERR, "%s: if_discover: %m", __func__);
+		goto routes;
+	}
+
+	/* Hash what was found by name to see which of ours departed.
+	 * Found interfaces are not in our hash, so borrow its link. */
+	i = 0;
+	TAILQ_FOREACH(ifp, ifs, next)
+		i++;
+	for (size = 16; size < i * 2; size <<= 1)
+		;
+	len = 0;
+	TAILQ_FOREACH(iff, ctx->ifaces, next)
+		len++;
+	found = calloc(size, sizeof(*found));
+	gone = len ? malloc(len * sizeof(*gone)) : NULL;
+	if (found == NULL || (len && gone == NULL))
+		syslog(LOG_ERR, "%s: %m", __func__);
+	else {
+		TAILQ_FOREACH(ifp, ifs, next) {
+			i = if_hashname(ifp->name, size);
+			ifp->name_hnext = found[i];
+			found[i] = ifp;
+		}
+		len = 0;
+		TAILQ_FOREACH(iff, ctx->ifaces, next) {
+			ifp = found[if_hashname(iff->name, size)];
+			for (; ifp; ifp = ifp->name_hnext) {
+				if (strcmp(ifp->name, iff->name) == 0)
+					break;
+			}
+			if (ifp == NULL)
+				strlcpy(gone[len++], iff->name, sizeof(*gone));
+		}
+		TAILQ_FOREACH(ifp, ifs, next)
+			ifp->name_hnext = NULL;
+		/* Stopping one can stop others, so not while walking */
+		for (i = 0; i < len; i++)
+			dhcpcd_handleinterface(ctx, -1, gone[i]);
+	}
+	free(found);
+	free(gone);
+
+	TAILQ_FOREACH_SAFE(ifp, ifs, next, ifn) {
+		if ((iff = if_find(ctx, ifp->name)) != NULL) {
+			dhcpcd_handlelink(ctx, ifp->carrier, ifp->flags,
+			    ifp->name);
+			dhcpcd_attachinterface(ctx, ifs, ifp, 0);
+		} else if (dhcpcd_listed(ctx, ifp->name))
+			dhcpcd_attachinterface(ctx, ifs, ifp, 1);
+	}
+	dhcpcd_freeifs(ifs);
+
+routes:
+	ipv4_syncroutes(ctx);
+	ipv6_syncroutes(ctx);
+}
+
+static void
+handle_link(void *arg)
+{
+	struct dhcpcd_ctx *ctx;
+
+	ctx = arg;
+	if (if_managelink(ctx) == -1) {
+		/* We may have missed anything, so check everything */
+		if (errno == ENOBUFS) {
+			syslog(LOG_WARNING, "if_managelink: %m");
+			dhcpcd_resync(ctx);
+			return;
+		}
+		syslog(LOG_ERR, "if_managelink: %m");
+		eloop_event_delete(ctx->eloop, ctx->link_fd, 0);
+		close(ctx->link_fd);
+		ctx->link_fd = -1;
+	}
+}
+
 void
 dhcpcd_handlehwaddr(struct dhcpcd_ctx *ctx, const char *ifname,
     const uint8_t *hwaddr, uint8_t hwlen)
@@ -969,8 +1296,23 @@ dhcpcd_handlehwaddr(struct dhcpcd_ctx *ctx, const char *ifname,
 static void
 if_reboot(struct interface *ifp, int argc, char **argv)
 {
+	struct if_options *ifo;
 	unsigned long long oldopts;
 
+	/* Leave the interface alone if the reloaded config gives it
+	 * the same options. */
+	if (*ifp->profile == '\0' &&
+	    (ifo = read_ifconfig(ifp, NULL, argc, argv)) != NULL)
+	{
+		if (if_options_same(ifo, ifp->options)) {
+			free_options(ifo);
+			syslog(LOG_DEBUG, "%s: configuration unchanged",
+			    ifp->name);
+			return;
+		}
+		free_options(ifo);
+	}
+
 	oldopts = ifp->options->options;
 	script_runreason(ifp, "RECONFIGURE");
 	configure_interface(ifp, argc, argv);
@@ -985,7 +1327,7 @@ reload_config(struct dhcpcd_ctx *ctx)
 	struct if_options *ifo;
 
 	free_globals(ctx);
-	ifo = read_config(ctx, NULL, NULL, NULL);
+	ifo = read_config(ctx, NULL, NULL, NULL, 0, NULL);
 	add_options(ctx, NULL, ifo, ctx->argc, ctx->argv);
 	/* We need to preserve these two options. */
 	if (ctx->options & DHCPCD_MASTER)
@@ -1017,6 +1359,7 @@ reconf_reboot(struct dhcpcd_ctx *ctx, int action, int argc, char **argv, int oi)
 			if_free(ifp);
 		} else {
 			TAILQ_INSERT_TAIL(ctx->ifaces, ifp, next);
+			if_hashadd(ctx, ifp);
 			dhcpcd_initstate1(ifp, argc, argv);
 			run_preinit(ifp);
 			dhcpcd_prestartinterface(ifp);
@@ -1025,6 +1368,10 @@ reconf_reboot(struct dhcpcd_ctx *ctx, int action, int argc, char **argv, int oi)
 	free(ifs);
 
 	ipv4_sortinterfaces(ctx);
+	/* Interface metrics may have changed */
+	if (!action)
+		ipv4_syncroutes(ctx);
+	ipv6_buildroutes(ctx);
 }
 
 static void
@@ -1093,6 +1440,7 @@ handle_signal1(void *arg)
 		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
 			ipv4_applyaddr(ifp);
 		}
+		ipv4_syncroutes(ctx);
 		return;
 	case SIGPIPE:
 		syslog(LOG_WARNING, "received signal PIPE");
@@ -1188,15 +1536,19 @@ dhcpcd_handleargs(struct dhcpcd_ctx *ctx, struct fd_list *fd,
 	 * expected reply we should be safely able just to change the
 	 * write callback on the fd */
 	if (strcmp(*argv, "--version") == 0) {
-		return control_queue(fd, UNCONST(VERSION),
+		return control_queue(fd, NULL, UNCONST(VERSION),
 		    strlen(VERSION) + 1, 0);
 	} else if (strcmp(*argv, "--getconfigfile") == 0) {
-		return control_queue(fd, UNCONST(fd->ctx->cffile),
+		return control_queue(fd, NULL, UNCONST(fd->ctx->cffile),
 		    strlen(fd->ctx->cffile) + 1, 0);
 	} else if (strcmp(*argv, "--getinterfaces") == 0) {
 		eloop_event_add(fd->ctx->eloop, fd->fd, NULL, NULL,
 		    dhcpcd_getinterfaces, fd);
 		return 0;
+	} else if (strcmp(*argv, "--dumpstate") == 0) {
+		return send_interfaces(fd);
+	} else if (strcmp(*argv, "--getmetrics") == 0) {
+		return metrics_send(fd);
 	} else if (strcmp(*argv, "--listen") == 0) {
 		fd->flags |= FD_LISTEN;
 		return 0;
@@ -1208,6 +1560,10 @@ dhcpcd_handleargs(struct dhcpcd_ctx *ctx, struct fd_list *fd,
 		return -1;
 	}
 
+	/* This shows the state of other clients */
+	if (strcmp(*argv, "--getcontrolstats") == 0)
+		return control_queuestats(fd);
+
 	/* Log the command */
 	len = 1;
 	for (opt = 0; opt < argc; opt++)
@@ -1323,6 +1679,9 @@ main(int argc, char **argv)
 	ctx.cffile = CONFIG;
 	ctx.pid_fd = ctx.control_fd = ctx.control_unpriv_fd = ctx.link_fd = -1;
 	TAILQ_INIT(&ctx.control_fds);
+	ctx.control_queue_max = CONTROL_QUEUE_MAX;
+	ctx.control_queue_bytes_max = CONTROL_QUEUE_BYTES_MAX;
+	ctx.control_queue_policy = CONTROL_POLICY_DROP;
 #ifdef PLUGIN_DEV
 	ctx.dev_fd = -1;
 #endif
@@ -1393,7 +1752,7 @@ main(int argc, char **argv)
 	ctx.ifc = argc - optind;
 	ctx.ifv = argv + optind;
 
-	ifo = read_config(&ctx, NULL, NULL, NULL);
+	ifo = read_config(&ctx, NULL, NULL, NULL, 0, NULL);
 	if (ifo == NULL)
 		goto exit_failure;
 	opt = add_options(&ctx, NULL, ifo, argc, argv);
@@ -1406,10 +1765,10 @@ main(int argc, char **argv)
 		printf("Interface options:\n");
 		if (optind == argc - 1) {
 			free_options(ifo);
-			ifo = read_config(&ctx, argv[optind], NULL, NULL);
+			ifo = read_config(&ctx, argv[optind], NULL, NULL,
+			    argc, argv);
 			if (ifo == NULL)
 				goto exit_failure;
-			add_options(&ctx, NULL, ifo, argc, argv);
 		}
 		if_printoptions();
 #ifdef INET
@@ -1509,6 +1868,7 @@ main(int argc, char **argv)
 		i = 0;
 		/* We need to try and find the interface so we can
 		 * load the hardware address to compare automated IAID */
+		if_freehash(&ctx);
 		ctx.ifaces = if_discover(&ctx, 1, argv + optind);
 		if (ctx.ifaces == NULL)
 			goto exit_failure;
@@ -1522,6 +1882,7 @@ main(int argc, char **argv)
 			strlcpy(ifp->name, argv[optind], sizeof(ifp->name));
 			ifp->ctx = &ctx;
 			TAILQ_INSERT_HEAD(ctx.ifaces, ifp, next);
+			if_hashadd(&ctx, ifp);
 		}
 		configure_interface(ifp, ctx.argc, ctx.argv);
 		if (ctx.options & DHCPCD_PFXDLGONLY)
@@ -1702,6 +2063,7 @@ main(int argc, char **argv)
 	    (DHCPCD_MASTER | DHCPCD_DEV))
 		dev_start(&ctx);
 
+	if_freehash(&ctx);
 	ctx.ifaces = if_discover(&ctx, ctx.ifc, ctx.ifv);
 	for (i = 0; i < ctx.ifc; i++) {
 		if (if_find(&ctx, ctx.ifv[i]) == NULL)
@@ -1774,18 +2136,26 @@ exit_failure:
 
 exit1:
 	/* Free memory and close fd's */
+	if_batch_free(&ctx);
 	if (ctx.ifaces) {
 		while ((ifp = TAILQ_FIRST(ctx.ifaces))) {
 			TAILQ_REMOVE(ctx.ifaces, ifp, next);
+			if_hashdel(&ctx, ifp);
 			if_free(ifp);
 		}
 		free(ctx.ifaces);
 	}
+	if_freehash(&ctx);
+	dhcpcd_freeadded(ctx.link_added, ctx.link_added_size);
 	free(ctx.duid);
 	if (ctx.link_fd != -1) {
 		eloop_event_delete(ctx.eloop, ctx.link_fd, 0);
 		close(ctx.link_fd);
 	}
+#ifdef __linux__
+	free(ctx.link_iov.iov_base);
+	free(ctx.reply_iov.iov_base);
+#endif
 
 	free_options(ifo);
 	free_globals(&ctx);
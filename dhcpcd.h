@@ -35,6 +35,7 @@
 #include "defs.h"
 #include "control.h"
 #include "if-options.h"
+#include "metrics.h"
 
 #define HWADDR_LEN	20
 #define IF_SSIDSIZE	33
@@ -59,6 +60,8 @@
 struct interface {
 	struct dhcpcd_ctx *ctx;
 	TAILQ_ENTRY(interface) next;
+	struct interface *name_hnext;	/* see if_findindexname */
+	struct interface *index_hnext;
 	char name[IF_NAMESIZE];
 	unsigned int index;
 	unsigned int flags;
@@ -73,18 +76,29 @@ struct interface {
 	int wireless;
 	uint8_t ssid[IF_SSIDSIZE];
 	unsigned int ssid_len;
+	/* Latest link state while waiting out ctx->link_debounce.
+	 * The timer for it is on the ELOOP_LINK queue. */
+	int link_pending;
+	int link_carrier;
+	unsigned int link_flags;
 
 	char profile[PROFILE_LEN];
 	struct if_options *options;
 	void *if_data[IF_DATA_MAX];
+	unsigned long long metrics[MET_MAX];
 };
 TAILQ_HEAD(if_head, interface);
 
+/* The link debounce timer has a queue of its own so that deleting the
+ * other timers of an interface cannot take it with them */
+#define ELOOP_LINK	7
+
 struct dhcpcd_ctx {
 #ifdef USE_SIGNALS
 	sigset_t sigset;
 #endif
 	const char *cffile;
+	struct if_conf *conf;	/* cffile as read, see read_config */
 	unsigned long long options;
 	int argc;
 	char **argv;
@@ -100,7 +114,26 @@ struct dhcpcd_ctx {
 	size_t duid_len;
 	int pid_fd;
 	int link_fd;
+	unsigned int link_debounce;	/* milliseconds */
+	/* New interfaces to discover, see dhcpcd_queueinterface */
+	struct if_added **link_added;
+	size_t link_added_size;
+	size_t link_added_len;
+#ifdef __linux__
+	/* Netlink receive buffers for the link socket and replies */
+	struct iovec link_iov;
+	struct iovec reply_iov;
+	/* Asynchronous route and address requests, see if_batch_begin */
+	struct nl_batch *nl_batch;
+	/* Interfaces and addresses while dumping, see if_getifaddrs */
+	struct nl_ifaddrs_head *nl_ifaddrs;
+#endif
 	struct if_head *ifaces;
+	/* ifaces hashed by name and index, see if_findindexname */
+	struct interface **ifaces_name;
+	struct interface **ifaces_index;
+	size_t ifaces_hsize;
+	size_t ifaces_hlen;
 
 	struct eloop_ctx *eloop;
 
@@ -109,6 +142,11 @@ struct dhcpcd_ctx {
 	struct fd_list_head control_fds;
 	char control_sock[sizeof(CONTROLSOCKET) + IF_NAMESIZE];
 	gid_t control_group;
+	size_t control_queue_max;
+	size_t control_queue_bytes_max;
+	int control_queue_policy;
+
+	struct metrics metrics;
 
 	/* DHCP Enterprise options, RFC3925 */
 	struct dhcp_opt *vivso;
@@ -118,6 +156,12 @@ struct dhcpcd_ctx {
 	struct dhcp_opt *dhcp_opts;
 	size_t dhcp_opts_len;
 	struct rt_head *ipv4_routes;
+	struct rt_hash *ipv4_rhash;	/* ipv4_routes hashed */
+	struct rt_hash *ipv4_whash;	/* routes interfaces want */
+	/* Our copy of the kernel routes, see ipv4_loadkroutes */
+	struct rt_head *ipv4_kroutes;
+	struct rt_hash *ipv4_khash;
+	int ipv4_kload;
 
 	int udp_fd;
 	uint8_t *packet;
@@ -157,7 +201,9 @@ pid_t dhcpcd_daemonise(struct dhcpcd_ctx *);
 
 int dhcpcd_handleargs(struct dhcpcd_ctx *, struct fd_list *, int, char **);
 void dhcpcd_handlecarrier(struct dhcpcd_ctx *, int, unsigned int, const char *);
+void dhcpcd_handlelink(struct dhcpcd_ctx *, int, unsigned int, const char *);
 int dhcpcd_handleinterface(void *, int, const char *);
+int dhcpcd_queueinterface(struct dhcpcd_ctx *, const char *);
 void dhcpcd_handlehwaddr(struct dhcpcd_ctx *, const char *,
     const unsigned char *, uint8_t);
 void dhcpcd_dropinterface(struct interface *, const char *);
@@ -159,7 +159,7 @@ eloop_q_timeout_add_tv(struct eloop_ctx *ctx, int queue,
 	struct timeval w;
 	struct eloop_timeout *t, *tt = NULL;
 
-	get_monotonic(&now);
+	eloop_gettime(ctx, &now);
 	timeradd(&now, when, &w);
 	/* Check for time_t overflow. */
 	if (timercmp(&w, &now, <)) {
@@ -186,6 +186,7 @@ eloop_q_timeout_add_tv(struct eloop_ctx *ctx, int queue,
 				return -1;
 			}
 		}
+		ctx->timeouts_len++;
 	}
 
 	t->when.tv_sec = w.tv_sec;
@@ -245,10 +246,41 @@ eloop_q_timeout_delete(struct eloop_ctx *ctx, int queue,
 		{
 			TAILQ_REMOVE(&ctx->timeouts, t, next);
 			TAILQ_INSERT_TAIL(&ctx->free_timeouts, t, next);
+			ctx->timeouts_len--;
 		}
 	}
 }
 
+void
+eloop_setclock(struct eloop_ctx *ctx,
+    int (*clock)(void *, struct timeval *),
+    void (*idle)(void *, const struct timeval *), void *arg)
+{
+
+	ctx->clock = clock;
+	ctx->clock_idle = idle;
+	ctx->clock_arg = arg;
+}
+
+int
+eloop_gettime(struct eloop_ctx *ctx, struct timeval *tv)
+{
+
+	if (ctx->clock)
+		return ctx->clock(ctx->clock_arg, tv);
+	return get_monotonic(tv);
+}
+
+time_t
+eloop_uptime(struct eloop_ctx *ctx)
+{
+	struct timeval tv;
+
+	if (eloop_gettime(ctx, &tv) == -1)
+		return -1;
+	return tv.tv_sec;
+}
+
 void
 eloop_exit(struct eloop_ctx *ctx, int code)
 {
@@ -310,7 +342,7 @@ eloop_start(struct dhcpcd_ctx *dctx)
 	int n;
 	struct eloop_event *e;
 	struct eloop_timeout *t;
-	struct timeval tv;
+	struct timeval tv, *idle;
 	struct timespec ts, *tsp;
 	void (*t0)(void *);
 #ifndef USE_SIGNALS
@@ -326,13 +358,16 @@ eloop_start(struct dhcpcd_ctx *dctx)
 		if (ctx->timeout0) {
 			t0 = ctx->timeout0;
 			ctx->timeout0 = NULL;
+			ctx->timeouts_run++;
 			t0(ctx->timeout0_arg);
 			continue;
 		}
 		if ((t = TAILQ_FIRST(&ctx->timeouts))) {
-			get_monotonic(&now);
-			if (timercmp(&now, &t->when, >)) {
+			eloop_gettime(ctx, &now);
+			if (!timercmp(&now, &t->when, <)) {
 				TAILQ_REMOVE(&ctx->timeouts, t, next);
+				ctx->timeouts_len--;
+				ctx->timeouts_run++;
 				t->callback(t->arg);
 				TAILQ_INSERT_TAIL(&ctx->free_timeouts, t, next);
 				continue;
@@ -344,11 +379,22 @@ eloop_start(struct dhcpcd_ctx *dctx)
 			/* No timeouts, so wait forever */
 			tsp = NULL;
 
-		if (tsp == NULL && ctx->events_len == 0) {
+		if (tsp == NULL && ctx->events_len == 0 &&
+		    ctx->clock_idle == NULL)
+		{
 			syslog(LOG_ERR, "nothing to do");
 			break;
 		}
 
+		/* Only check for events, the clock waits for us */
+		if (ctx->clock_idle) {
+			idle = tsp ? &tv : NULL;
+			ts.tv_sec = 0;
+			ts.tv_nsec = 0;
+			tsp = &ts;
+		} else
+			idle = NULL;
+
 #ifdef USE_SIGNALS
 		n = pollts(ctx->fds, (nfds_t)ctx->events_len,
 		    tsp, &dctx->sigset);
@@ -370,6 +416,10 @@ eloop_start(struct dhcpcd_ctx *dctx)
 			syslog(LOG_ERR, "poll: %m");
 			break;
 		}
+		if (n == 0 && ctx->clock_idle) {
+			ctx->clock_idle(ctx->clock_arg, idle);
+			continue;
+		}
 
 		/* Process any triggered events. */
 		if (n > 0) {
@@ -377,6 +427,7 @@ eloop_start(struct dhcpcd_ctx *dctx)
 				if (e->pollfd->revents & POLLOUT &&
 					e->write_cb)
 				{
+					ctx->events_run++;
 					e->write_cb(e->write_cb_arg);
 					/* We need to break here as the
 					 * callback could destroy the next
@@ -384,6 +435,7 @@ eloop_start(struct dhcpcd_ctx *dctx)
 					break;
 				}
 				if (e->pollfd->revents) {
+					ctx->events_run++;
 					e->read_cb(e->read_cb_arg);
 					/* We need to break here as the
 					 * callback could destroy the next
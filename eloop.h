@@ -64,6 +64,8 @@ struct eloop_ctx {
 	TAILQ_HEAD (timeout_head, eloop_timeout) timeouts;
 	struct timeout_head free_timeouts;
 
+	size_t timeouts_len;
+
 	void (*timeout0)(void *);
 	void *timeout0_arg;
 
@@ -72,6 +74,17 @@ struct eloop_ctx {
 
 	int exitnow;
 	int exitcode;
+
+	/* Where the time comes from, get_monotonic if not set.
+	 * If clock_idle is set it is called instead of waiting when no
+	 * event is ready, with how long we would have waited or NULL
+	 * for forever, so a virtual clock can move time on instead. */
+	int (*clock)(void *, struct timeval *);
+	void (*clock_idle)(void *, const struct timeval *);
+	void *clock_arg;
+
+	unsigned long long events_run;
+	unsigned long long timeouts_run;
 };
 
 #define eloop_timeout_add_tv(a, b, c, d) \
@@ -91,6 +104,10 @@ int eloop_q_timeout_add_tv(struct eloop_ctx *, int queue,
     const struct timeval *, void (*)(void *), void *);
 int eloop_timeout_add_now(struct eloop_ctx *, void (*)(void *), void *);
 void eloop_q_timeout_delete(struct eloop_ctx *, int, void (*)(void *), void *);
+void eloop_setclock(struct eloop_ctx *, int (*)(void *, struct timeval *),
+    void (*)(void *, const struct timeval *), void *);
+int eloop_gettime(struct eloop_ctx *, struct timeval *);
+time_t eloop_uptime(struct eloop_ctx *);
 struct eloop_ctx * eloop_init(void);
 void eloop_free(struct eloop_ctx *);
 void eloop_exit(struct eloop_ctx *, int);
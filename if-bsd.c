@@ -556,6 +556,15 @@ if_route(const struct rt *rt, int action)
 	close(s);
 	return retval;
 }
+
+int
+if_initrt(__unused struct dhcpcd_ctx *ctx)
+{
+
+	/* Routes are changed without checking the kernel table first */
+	errno = ENOTSUP;
+	return -1;
+}
 #endif
 
 #ifdef INET6
@@ -825,8 +834,7 @@ if_managelink(struct dhcpcd_ctx *ctx)
 			ifan = (struct if_announcemsghdr *)(void *)p;
 			switch(ifan->ifan_what) {
 			case IFAN_ARRIVAL:
-				dhcpcd_handleinterface(ctx, 1,
-				    ifan->ifan_name);
+				dhcpcd_queueinterface(ctx, ifan->ifan_name);
 				break;
 			case IFAN_DEPARTURE:
 				dhcpcd_handleinterface(ctx, -1,
@@ -857,7 +865,7 @@ if_managelink(struct dhcpcd_ctx *ctx)
 				len = LINK_UNKNOWN;
 				break;
 			}
-			dhcpcd_handlecarrier(ctx, len,
+			dhcpcd_handlelink(ctx, len,
 			    (unsigned int)ifm->ifm_flags, ifp->name);
 			break;
 		case RTM_ADD:
@@ -56,8 +56,11 @@
 /* Linux has these in an enum and there is just no way to work
  * out of they exist at compile time. Silly silly silly. */
 #define IFLA_AF_SPEC			26
+#define IFLA_INET_CONF			1
 #define IFLA_INET6_ADDR_GEN_MODE	8
 #define IN6_ADDR_GEN_MODE_NONE		1
+#define IPV4_DEVCONF_PROMOTE_SECONDARIES 20
+#define IFA_FLAGS			8
 
 /* For some reason, glibc doesn't include newer flags from linux/if.h
  * However, we cannot include linux/if.h directly as it conflicts
@@ -69,6 +72,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <ifaddrs.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -81,6 +85,7 @@
 #include "common.h"
 #include "dev.h"
 #include "dhcp.h"
+#include "eloop.h"
 #include "if.h"
 #include "ipv4.h"
 #include "ipv6.h"
@@ -207,6 +212,15 @@ write_path(const char *path, const char *val)
 
 int
 if_init(struct interface *ifp)
+{
+
+	return if_initnl(ifp, NULL);
+}
+
+/* nli is what if_getifaddrs learnt from the kernel,
+ * which saves reading it again from /sys and /proc */
+int
+if_initnl(struct interface *ifp, const struct if_nlinfo *nli)
 {
 	char path[sizeof(PROC_PROMOTE) + IF_NAMESIZE];
 	int n;
@@ -214,6 +228,13 @@ if_init(struct interface *ifp)
 	char buf[1024];
 	FILE *fp;
 
+	if (nli != NULL) {
+		/* The address /sys gives, which the link dump has */
+		ifp->hwlen = nli->hwlen;
+		memcpy(ifp->hwaddr, nli->hwaddr, ifp->hwlen);
+		goto promote;
+	}
+
 	snprintf(path, sizeof(path), "/sys/class/net/%s/address", ifp->name);
 	fp = fopen(path, "r");
 	if (fp == NULL)
@@ -228,6 +249,7 @@ if_init(struct interface *ifp)
 	}
 	fclose(fp);
 
+promote:
 	/* We enable promote_secondaries so that we can do this
 	 * add 192.168.1.2/24
 	 * add 192.168.1.3/24
@@ -236,12 +258,17 @@ if_init(struct interface *ifp)
 	 * This matches the behaviour of BSD which makes coding dhcpcd
 	 * a little easier as there's just one behaviour. */
 	snprintf(path, sizeof(path), PROC_PROMOTE, ifp->name);
-	n = check_proc_int(path);
+	if (nli != NULL && nli->promote != -1)
+		n = nli->promote;
+	else
+		n = check_proc_int(path);
 	if (n == -1)
 		return errno == ENOENT ? 0 : -1;
 	if (n == 1)
 		return 0;
-	return write_path(path, "1") == -1 ? -1 : 0;
+	if (write_path(path, "1") == -1)
+		return errno == ENOENT ? 0 : -1;
+	return 0;
 }
 
 int
@@ -337,73 +364,111 @@ err_netlink(struct nlmsghdr *nlm)
 	return -1;
 }
 
+/* The kernel recommends a receive buffer of at least 8k,
+ * but messages can be larger on hosts with many VFs or routes. */
+#define NLBUFLEN	32768
+
+static int
+alloc_netlink(struct iovec *iov)
+{
+
+	if (iov->iov_base == NULL) {
+		if ((iov->iov_base = malloc(NLBUFLEN)) == NULL)
+			return -1;
+		iov->iov_len = NLBUFLEN;
+	}
+	return 0;
+}
+
 static int
-get_netlink(struct dhcpcd_ctx *ctx, struct interface *ifp, int fd, int flags,
+get_netlink(struct dhcpcd_ctx *ctx, struct iovec *iov,
+    struct interface *ifp, int fd, int flags,
     int (*callback)(struct dhcpcd_ctx *, struct interface *,struct nlmsghdr *))
 {
-	char *buf = NULL, *nbuf;
+	struct msghdr msg;
+	struct sockaddr_nl nladdr;
 	ssize_t bytes;
-	size_t buflen;
+	size_t len;
 	struct nlmsghdr *nlm;
-	struct sockaddr_nl nladdr;
-	socklen_t nladdr_len = sizeof(nladdr);
+	void *nbuf;
 	int r;
 
-	buflen = 0;
+	if (alloc_netlink(iov) == -1)
+		return -1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &nladdr;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
 	r = -1;
 	for (;;) {
-		bytes = recv(fd, NULL, 0,
-		    flags | MSG_PEEK | MSG_DONTWAIT | MSG_TRUNC);
-		if (bytes == -1)
-			goto eexit;
-		if ((size_t)bytes == buflen) {
-			/* Support kernels older than 2.6.22 */
-			if (bytes == 0)
-				bytes = 512;
-			else
-				bytes *= 2;
+		/* Peek first: with MSG_TRUNC this returns the real length
+		 * of the message so the buffer can grow to fit it before
+		 * it is read. */
+		msg.msg_namelen = sizeof(nladdr);
+		bytes = recvmsg(fd, &msg,
+		    flags | MSG_DONTWAIT | MSG_PEEK | MSG_TRUNC);
+		if (bytes == -1) {
+			/* The socket overran, so messages were lost */
+			if (errno == ENOBUFS)
+				return -1;
+			break;
 		}
-		if (buflen < (size_t)bytes) {
-			/* Alloc 1 more so we work with older kernels */
-			buflen = (size_t)bytes + 1;
-			nbuf = realloc(buf, buflen);
-			if (nbuf == NULL)
-				goto eexit;
-			buf = nbuf;
+		if (bytes == 0)
+			break;
+		if ((size_t)bytes > iov->iov_len) {
+			len = iov->iov_len;
+			while (len < (size_t)bytes)
+				len *= 2;
+			syslog(LOG_DEBUG, "%s: growing buffer to %zu",
+			    __func__, len);
+			if ((nbuf = realloc(iov->iov_base, len)) == NULL)
+				break;
+			iov->iov_base = nbuf;
+			iov->iov_len = len;
+		}
+		msg.msg_namelen = sizeof(nladdr);
+		bytes = recvmsg(fd, &msg, flags | MSG_DONTWAIT);
+		if (bytes == -1) {
+			if (errno == ENOBUFS)
+				return -1;
+			break;
+		}
+		if (bytes == 0)
+			break;
+		/* Should not happen after the peek, but if it does a
+		 * message was lost, which is the same as an overrun. */
+		if (msg.msg_flags & MSG_TRUNC) {
+			errno = ENOBUFS;
+			return -1;
 		}
-		bytes = recvfrom(fd, buf, buflen, flags,
-		    (struct sockaddr *)&nladdr, &nladdr_len);
-		if (bytes == -1 || bytes == 0)
-			goto eexit;
 
 		/* Check sender */
-		if (nladdr_len != sizeof(nladdr)) {
+		if (msg.msg_namelen != sizeof(nladdr)) {
 			errno = EINVAL;
-			goto eexit;
+			break;
 		}
 		/* Ignore message if it is not from kernel */
 		if (nladdr.nl_pid != 0)
 			continue;
 
-		for (nlm = (struct nlmsghdr *)(void *)buf;
+		for (nlm = iov->iov_base;
 		     nlm && NLMSG_OK(nlm, (size_t)bytes);
 		     nlm = NLMSG_NEXT(nlm, bytes))
 		{
 			r = err_netlink(nlm);
 			if (r == -1)
-				goto eexit;
+				return -1;
 			if (r)
 				continue;
 			if (callback) {
 				r = callback(ctx, ifp, nlm);
 				if (r != 0)
-					goto eexit;
+					return r;
 			}
 		}
 	}
 
-eexit:
-	free(buf);
 	return r;
 }
 
@@ -434,7 +499,7 @@ link_route(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
 	struct rt6 rt6;
 #endif
 
-	if (nlm->nlmsg_type != RTM_DELROUTE)
+	if (nlm->nlmsg_type != RTM_NEWROUTE && nlm->nlmsg_type != RTM_DELROUTE)
 		return 0;
 
 	len = nlm->nlmsg_len - sizeof(*nlm);
@@ -478,6 +543,10 @@ link_route(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
 				memcpy(&rt.gate.s_addr, RTA_DATA(rta),
 				    sizeof(rt.gate.s_addr));
 				break;
+			case RTA_PREFSRC:
+				memcpy(&rt.src.s_addr, RTA_DATA(rta),
+				    sizeof(rt.src.s_addr));
+				break;
 			case RTA_OIF:
 				rt.iface = if_findindex(ctx,
 				    *(unsigned int *)RTA_DATA(rta));
@@ -516,14 +585,22 @@ link_route(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
 #ifdef INET
 		case AF_INET:
 			if (rt.iface != NULL && metric == rt.iface->metric) {
+				rt.metric = metric;
 				inet_cidrtoaddr(rtm->rtm_dst_len, &rt.net);
-				ipv4_routedeleted(ctx, &rt);
+				/* Keep our copy of the kernel table */
+				if (nlm->nlmsg_type == RTM_NEWROUTE)
+					ipv4_routeadded(ctx, &rt);
+				else
+					ipv4_routedeleted(ctx, &rt);
 			}
 			break;
 #endif
 #ifdef INET6
 		case AF_INET6:
-			if (rt6.iface != NULL && metric == rt6.iface->metric) {
+			if (nlm->nlmsg_type == RTM_DELROUTE &&
+			    rt6.iface != NULL && metric == rt6.iface->metric)
+			{
+				rt6.metric = metric;
 				ipv6_mask(&rt6.net, rtm->rtm_dst_len);
 				ipv6_routedeleted(ctx, &rt6);
 			}
@@ -631,14 +708,13 @@ handle_rename(struct dhcpcd_ctx *ctx, unsigned int ifindex, const char *ifname)
 {
 	struct interface *ifp;
 
-	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-		if (ifp->index == ifindex && strcmp(ifp->name, ifname)) {
-			dhcpcd_handleinterface(ctx, -1, ifp->name);
-			/* Let dev announce the interface for renaming */
-			if (!dev_listening(ctx))
-				dhcpcd_handleinterface(ctx, 1, ifname);
-			return 1;
-		}
+	ifp = if_findindex(ctx, ifindex);
+	if (ifp != NULL && strcmp(ifp->name, ifname)) {
+		dhcpcd_handleinterface(ctx, -1, ifp->name);
+		/* Let dev announce the interface for renaming */
+		if (!dev_listening(ctx))
+			dhcpcd_handleinterface(ctx, 1, ifname);
+		return 1;
 	}
 	return 0;
 }
@@ -767,7 +843,7 @@ link_netlink(struct dhcpcd_ctx *ctx, struct interface *ifp,
 		/* If are listening to a dev manager, let that announce
 		 * the interface rather than the kernel. */
 		if (dev_listening(ctx) < 1)
-			dhcpcd_handleinterface(ctx, 1, ifn);
+			dhcpcd_queueinterface(ctx, ifn);
 		return 1;
 	}
 
@@ -780,7 +856,7 @@ link_netlink(struct dhcpcd_ctx *ctx, struct interface *ifp,
 			dhcpcd_handlehwaddr(ctx, ifn, RTA_DATA(hwaddr), l);
 	}
 
-	dhcpcd_handlecarrier(ctx,
+	dhcpcd_handlelink(ctx,
 	    ifi->ifi_flags & IFF_RUNNING ? LINK_UP : LINK_DOWN,
 	    ifi->ifi_flags, ifn);
 	return 1;
@@ -790,8 +866,8 @@ int
 if_managelink(struct dhcpcd_ctx *ctx)
 {
 
-	return get_netlink(ctx, NULL,
-	    ctx->link_fd, MSG_DONTWAIT, &link_netlink);
+	return get_netlink(ctx, &ctx->link_iov, NULL,
+	    ctx->link_fd, 0, &link_netlink);
 }
 
 static int
@@ -821,13 +897,710 @@ send_netlink(struct dhcpcd_ctx *ctx, struct interface *ifp,
 	hdr->nlmsg_seq = ++seq;
 
 	if (sendmsg(s, &msg, 0) != -1)
-		r = get_netlink(ctx, ifp, s, 0, callback);
+		r = get_netlink(ctx, &ctx->reply_iov, ifp, s, 0, callback);
 	else
 		r = -1;
 	close(s);
 	return r;
 }
 
+/* if_getifaddrs builds a list like getifaddrs(3) from one RTM_GETLINK
+ * and one RTM_GETADDR dump. Each entry keeps what else the kernel told
+ * us in ifa_data so that discovery needs no more syscalls for each
+ * interface or address. */
+struct nl_ifaddrs {
+	struct ifaddrs ifa;
+	struct nl_ifaddrs *hnext;	/* links hashed by index */
+	unsigned int index;
+	struct sockaddr_storage addr;
+	struct sockaddr_storage netmask;
+	struct sockaddr_storage dstaddr;
+	struct if_nlinfo info;
+	char name[IF_NAMESIZE];
+};
+
+struct nl_ifaddrs_head {
+	struct ifaddrs *first;
+	struct ifaddrs **last;
+	struct nl_ifaddrs **links;
+	size_t links_size;
+};
+
+static struct nl_ifaddrs *
+nl_ifaddrs_new(struct dhcpcd_ctx *ctx)
+{
+	struct nl_ifaddrs_head *h;
+	struct nl_ifaddrs *n;
+
+	if ((n = calloc(1, sizeof(*n))) == NULL)
+		return NULL;
+	n->ifa.ifa_name = n->name;
+	n->ifa.ifa_data = &n->info;
+	n->info.promote = -1;
+	h = ctx->nl_ifaddrs;
+	*h->last = &n->ifa;
+	h->last = &n->ifa.ifa_next;
+	return n;
+}
+
+/* Find promote_secondaries in the IPv4 devconf array of IFLA_AF_SPEC */
+static int
+nl_ifaddrs_promote(struct rtattr *spec)
+{
+	size_t alen, clen;
+	struct rtattr *af, *conf;
+	uint32_t promote;
+
+	af = RTA_DATA(spec);
+	alen = RTA_PAYLOAD(spec);
+	for (; RTA_OK(af, alen); af = RTA_NEXT(af, alen)) {
+		if (af->rta_type != AF_INET)
+			continue;
+		conf = RTA_DATA(af);
+		clen = RTA_PAYLOAD(af);
+		for (; RTA_OK(conf, clen); conf = RTA_NEXT(conf, clen)) {
+			if (conf->rta_type != IFLA_INET_CONF ||
+			    RTA_PAYLOAD(conf) <
+			    IPV4_DEVCONF_PROMOTE_SECONDARIES * sizeof(promote))
+				continue;
+			memcpy(&promote, (uint32_t *)RTA_DATA(conf) +
+			    IPV4_DEVCONF_PROMOTE_SECONDARIES - 1,
+			    sizeof(promote));
+			return promote ? 1 : 0;
+		}
+	}
+	return -1;
+}
+
+static int
+_if_getifaddrs_link(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
+    struct nlmsghdr *nlm)
+{
+	size_t len;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	struct nl_ifaddrs *n;
+	struct sockaddr_ll *sll;
+
+	if (nlm->nlmsg_type != RTM_NEWLINK)
+		return 0;
+	len = nlm->nlmsg_len - sizeof(*nlm);
+	if (len < sizeof(*ifi)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	ifi = NLMSG_DATA(nlm);
+	if ((n = nl_ifaddrs_new(ctx)) == NULL)
+		return -1;
+	n->index = n->info.index = (unsigned int)ifi->ifi_index;
+	n->ifa.ifa_flags = ifi->ifi_flags;
+	sll = (struct sockaddr_ll *)(void *)&n->addr;
+
+	rta = (struct rtattr *)(void *)((char *)ifi +NLMSG_ALIGN(sizeof(*ifi)));
+	len = NLMSG_PAYLOAD(nlm, sizeof(*ifi));
+	while (RTA_OK(rta, len)) {
+		switch (rta->rta_type) {
+		case IFLA_IFNAME:
+			strlcpy(n->name, RTA_DATA(rta), sizeof(n->name));
+			break;
+		case IFLA_ADDRESS:
+			/* Like getifaddrs, only links with a hardware
+			 * address have an AF_PACKET address.
+			 * It has room for 8 bytes, so if_initnl takes the
+			 * whole address from info as if_init does from /sys
+			 * for InfiniBand. */
+			if (RTA_PAYLOAD(rta) <= sizeof(n->info.hwaddr)) {
+				n->info.hwlen = (uint8_t)RTA_PAYLOAD(rta);
+				memcpy(n->info.hwaddr, RTA_DATA(rta),
+				    n->info.hwlen);
+			}
+			sll->sll_family = AF_PACKET;
+			sll->sll_ifindex = ifi->ifi_index;
+			sll->sll_hatype = ifi->ifi_type;
+			sll->sll_halen = (unsigned char)
+			    MIN(RTA_PAYLOAD(rta), sizeof(sll->sll_addr));
+			memcpy(sll->sll_addr, RTA_DATA(rta), sll->sll_halen);
+			n->ifa.ifa_addr = (struct sockaddr *)(void *)sll;
+			break;
+		case IFLA_MTU:
+			n->info.mtu = *(unsigned int *)RTA_DATA(rta);
+			break;
+		case IFLA_AF_SPEC:
+			n->info.promote = nl_ifaddrs_promote(rta);
+			break;
+		}
+		rta = RTA_NEXT(rta, len);
+	}
+	return 0;
+}
+
+static struct nl_ifaddrs *
+nl_ifaddrs_findlink(struct nl_ifaddrs_head *h, unsigned int idx)
+{
+	struct nl_ifaddrs *n;
+
+	n = h->links[idx & (h->links_size - 1)];
+	for (; n; n = n->hnext) {
+		if (n->index == idx)
+			return n;
+	}
+	return NULL;
+}
+
+static void
+nl_ifaddrs_setaddr(struct sockaddr_storage *ss, int family, const void *addr)
+{
+	struct sockaddr_in *sin;
+	struct sockaddr_in6 *sin6;
+
+	if (family == AF_INET) {
+		sin = (struct sockaddr_in *)(void *)ss;
+		sin->sin_family = AF_INET;
+		memcpy(&sin->sin_addr, addr, sizeof(sin->sin_addr));
+	} else {
+		sin6 = (struct sockaddr_in6 *)(void *)ss;
+		sin6->sin6_family = AF_INET6;
+		memcpy(&sin6->sin6_addr, addr, sizeof(sin6->sin6_addr));
+	}
+}
+
+static int
+_if_getifaddrs_addr(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
+    struct nlmsghdr *nlm)
+{
+	size_t len, alen;
+	struct ifaddrmsg *ifa;
+	struct rtattr *rta;
+	struct nl_ifaddrs *link, *n;
+	const void *address, *local;
+	const char *label;
+	struct sockaddr_in6 *sin6;
+	struct in_addr mask;
+	uint32_t flags;
+
+	if (nlm->nlmsg_type != RTM_NEWADDR)
+		return 0;
+	len = nlm->nlmsg_len - sizeof(*nlm);
+	if (len < sizeof(*ifa)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	ifa = NLMSG_DATA(nlm);
+	if (ifa->ifa_family == AF_INET)
+		alen = sizeof(struct in_addr);
+	else if (ifa->ifa_family == AF_INET6)
+		alen = sizeof(struct in6_addr);
+	else
+		return 0;
+	link = nl_ifaddrs_findlink(ctx->nl_ifaddrs, ifa->ifa_index);
+	if (link == NULL)
+		return 0;
+
+	address = local = NULL;
+	label = NULL;
+	flags = ifa->ifa_flags;
+	rta = (struct rtattr *)(void *)((char *)ifa +NLMSG_ALIGN(sizeof(*ifa)));
+	len = NLMSG_PAYLOAD(nlm, sizeof(*ifa));
+	while (RTA_OK(rta, len)) {
+		switch (rta->rta_type) {
+		case IFA_ADDRESS:
+			if (RTA_PAYLOAD(rta) == alen)
+				address = RTA_DATA(rta);
+			break;
+		case IFA_LOCAL:
+			if (RTA_PAYLOAD(rta) == alen)
+				local = RTA_DATA(rta);
+			break;
+		case IFA_LABEL:
+			label = RTA_DATA(rta);
+			break;
+		case IFA_FLAGS:
+			flags = *(uint32_t *)RTA_DATA(rta);
+			break;
+		}
+		rta = RTA_NEXT(rta, len);
+	}
+	if (local == NULL && (local = address) == NULL)
+		return 0;
+
+	if ((n = nl_ifaddrs_new(ctx)) == NULL)
+		return -1;
+	n->index = link->index;
+	n->ifa.ifa_flags = link->ifa.ifa_flags;
+	/* IPv4 aliases are labelled, such as eth0:1 */
+	strlcpy(n->name, ifa->ifa_family == AF_INET && label ?
+	    label : link->name, sizeof(n->name));
+	nl_ifaddrs_setaddr(&n->addr, ifa->ifa_family, local);
+	n->ifa.ifa_addr = (struct sockaddr *)(void *)&n->addr;
+	/* A point to point address is the local one,
+	 * and the address of the peer */
+	if (address != NULL && address != local) {
+		nl_ifaddrs_setaddr(&n->dstaddr, ifa->ifa_family, address);
+		n->ifa.ifa_dstaddr = (struct sockaddr *)(void *)&n->dstaddr;
+	}
+	if (ifa->ifa_family == AF_INET) {
+		inet_cidrtoaddr(ifa->ifa_prefixlen, &mask);
+		nl_ifaddrs_setaddr(&n->netmask, AF_INET, &mask);
+		n->ifa.ifa_netmask = (struct sockaddr *)(void *)&n->netmask;
+	} else {
+		sin6 = (struct sockaddr_in6 *)(void *)&n->addr;
+		if (IN6_IS_ADDR_LINKLOCAL(&sin6->sin6_addr))
+			sin6->sin6_scope_id = n->index;
+		n->info.addrflags = (int)flags;
+	}
+	return 0;
+}
+
+static int
+if_getifaddrs_dump(struct dhcpcd_ctx *ctx, unsigned short type,
+    int (*callback)(struct dhcpcd_ctx *, struct interface *,struct nlmsghdr *))
+{
+	struct nlmd {
+		struct nlmsghdr hdr;
+		struct ifaddrmsg ifa;
+	} nlm;
+
+	/* struct ifaddrmsg is smaller than struct ifinfomsg and the
+	 * kernel only needs the family from either for a dump */
+	memset(&nlm, 0, sizeof(nlm));
+	nlm.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(nlm.ifa));
+	nlm.hdr.nlmsg_type = type;
+	nlm.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlm.ifa.ifa_family = AF_UNSPEC;
+	return send_netlink(ctx, NULL, NETLINK_ROUTE, &nlm.hdr, callback);
+}
+
+int
+if_getifaddrs(struct dhcpcd_ctx *ctx, struct ifaddrs **ifap)
+{
+	struct nl_ifaddrs_head h;
+	struct ifaddrs *ifa;
+	struct nl_ifaddrs *n, **b;
+	size_t len;
+	int r;
+
+	memset(&h, 0, sizeof(h));
+	h.last = &h.first;
+	ctx->nl_ifaddrs = &h;
+	r = -1;
+	if (if_getifaddrs_dump(ctx, RTM_GETLINK, &_if_getifaddrs_link) == -1)
+		goto out;
+
+	/* Hash the links so addresses can find theirs */
+	len = 0;
+	for (ifa = h.first; ifa; ifa = ifa->ifa_next)
+		len++;
+	for (h.links_size = 16; h.links_size < len * 2; h.links_size <<= 1)
+		;
+	if ((h.links = calloc(h.links_size, sizeof(*h.links))) == NULL)
+		goto out;
+	for (ifa = h.first; ifa; ifa = ifa->ifa_next) {
+		n = (struct nl_ifaddrs *)(void *)ifa;
+		b = &h.links[n->index & (h.links_size - 1)];
+		n->hnext = *b;
+		*b = n;
+	}
+
+	if (if_getifaddrs_dump(ctx, RTM_GETADDR, &_if_getifaddrs_addr) != -1)
+		r = 0;
+
+out:
+	free(h.links);
+	ctx->nl_ifaddrs = NULL;
+	if (r == -1)
+		if_freeifaddrs(h.first);
+	else
+		*ifap = h.first;
+	return r;
+}
+
+void
+if_freeifaddrs(struct ifaddrs *ifa)
+{
+	struct ifaddrs *next;
+
+	for (; ifa; ifa = next) {
+		next = ifa->ifa_next;
+		free(ifa);
+	}
+}
+
+/* Route and address requests made inside a batch are queued and sent
+ * together on a netlink socket owned by the event loop.
+ * The kernel ACKs each request by sequence number and the ACKs are
+ * handled as they arrive, so callers do not wait for them. */
+#define NLBATCH_MAX	64	/* requests per sendmsg */
+#define NLACK_TIMEOUT	5	/* seconds to wait for pending ACKs */
+#define NLACKBUFLEN	8192
+
+struct nl_request {
+	TAILQ_ENTRY(nl_request) next;
+	uint32_t seq;
+	uint16_t type;
+	size_t len;
+	struct timeval deadline;	/* when a pending ACK times out */
+	char ifname[IF_NAMESIZE];
+	void (*callback)(struct dhcpcd_ctx *, void *, int);
+	void *arg;
+};
+TAILQ_HEAD(nl_request_head, nl_request);
+
+struct nl_batch {
+	int fd;
+	int depth;
+	uint32_t seq;
+	char *buf;
+	size_t buf_len;
+	size_t buf_size;
+	struct nl_request_head queued;
+	struct nl_request_head pending;
+	struct nl_request_head free_reqs;
+};
+
+static int
+queue_netlink(struct nl_batch *b, const char *ifname, struct nlmsghdr *hdr)
+{
+	size_t len, size;
+	char *nbuf;
+	struct nl_request *req;
+
+	len = NLMSG_ALIGN(hdr->nlmsg_len);
+	if (b->buf_len + len > b->buf_size) {
+		size = b->buf_size ? b->buf_size : 4096;
+		while (b->buf_len + len > size)
+			size *= 2;
+		if ((nbuf = realloc(b->buf, size)) == NULL)
+			return -1;
+		b->buf = nbuf;
+		b->buf_size = size;
+	}
+	if ((req = TAILQ_FIRST(&b->free_reqs)))
+		TAILQ_REMOVE(&b->free_reqs, req, next);
+	else if ((req = malloc(sizeof(*req))) == NULL)
+		return -1;
+
+	memset(req, 0, sizeof(*req));
+	if (++b->seq == 0)
+		b->seq = 1;
+	req->seq = b->seq;
+	req->type = hdr->nlmsg_type;
+	req->len = len;
+	strlcpy(req->ifname, ifname, sizeof(req->ifname));
+	TAILQ_INSERT_TAIL(&b->queued, req, next);
+
+	hdr->nlmsg_flags |= NLM_F_ACK;
+	hdr->nlmsg_seq = req->seq;
+	memcpy(b->buf + b->buf_len, hdr, hdr->nlmsg_len);
+	memset(b->buf + b->buf_len + hdr->nlmsg_len, 0, len - hdr->nlmsg_len);
+	b->buf_len += len;
+	return 0;
+}
+
+static int
+request_netlink(struct dhcpcd_ctx *ctx, const char *ifname,
+    struct nlmsghdr *hdr)
+{
+
+	if (ctx->nl_batch && ctx->nl_batch->depth)
+		return queue_netlink(ctx->nl_batch, ifname, hdr);
+	return send_netlink(ctx, NULL, NETLINK_ROUTE, hdr, NULL);
+}
+
+/* The request must already be off the queued or pending list. */
+static void
+done_netlink(struct dhcpcd_ctx *ctx, struct nl_request *req, int error)
+{
+	struct nl_batch *b;
+	const char *cmd;
+
+	b = ctx->nl_batch;
+	if (req->callback)
+		req->callback(ctx, req->arg, error);
+	else if (error) {
+		switch (req->type) {
+		case RTM_NEWROUTE:
+			cmd = "if_addroute";
+			break;
+		case RTM_NEWADDR:
+			cmd = "if_addaddress";
+			break;
+		default:
+			/* Nothing to delete is not an error */
+			if (error == ESRCH || error == ENOENT ||
+			    error == EADDRNOTAVAIL ||
+			    error == ENXIO || error == ENODEV)
+				cmd = NULL;
+			else if (req->type == RTM_DELROUTE)
+				cmd = "if_delroute";
+			else
+				cmd = "if_deladdress";
+			break;
+		}
+		if (cmd) {
+			errno = error;
+			syslog(LOG_ERR, "%s: %s: %m", req->ifname, cmd);
+		}
+	}
+	free(req->arg);
+	TAILQ_INSERT_TAIL(&b->free_reqs, req, next);
+}
+
+static void
+timeout_netlink(void *arg)
+{
+	struct dhcpcd_ctx *ctx;
+	struct nl_batch *b;
+	struct nl_request *req;
+	struct timeval now, tv;
+
+	ctx = arg;
+	b = ctx->nl_batch;
+	get_monotonic(&now);
+	/* Requests are pending in the order they were sent,
+	 * so stop at the first one which still has time left. */
+	while ((req = TAILQ_FIRST(&b->pending))) {
+		if (timercmp(&req->deadline, &now, >))
+			break;
+		TAILQ_REMOVE(&b->pending, req, next);
+		done_netlink(ctx, req, ETIMEDOUT);
+	}
+	if ((req = TAILQ_FIRST(&b->pending))) {
+		timersub(&req->deadline, &now, &tv);
+		eloop_timeout_add_tv(ctx->eloop, &tv, timeout_netlink, ctx);
+	}
+}
+
+static void
+read_netlink(void *arg)
+{
+	struct dhcpcd_ctx *ctx;
+	struct nl_batch *b;
+	char buf[NLACKBUFLEN];
+	ssize_t bytes;
+	size_t len;
+	struct nlmsghdr *nlm;
+	struct nlmsgerr *err;
+	struct nl_request *req;
+	int error;
+
+	ctx = arg;
+	b = ctx->nl_batch;
+	for (;;) {
+		bytes = recv(b->fd, buf, sizeof(buf), MSG_DONTWAIT | MSG_TRUNC);
+		if (bytes == -1) {
+			/* Lost ACKs are failed by timeout_netlink */
+			if (errno == ENOBUFS) {
+				syslog(LOG_ERR, "%s: %m", __func__);
+				continue;
+			}
+			break;
+		}
+		if (bytes == 0)
+			break;
+		if ((size_t)bytes > sizeof(buf)) {
+			syslog(LOG_ERR, "%s: netlink message truncated",
+			    __func__);
+			continue;
+		}
+		len = (size_t)bytes;
+		for (nlm = (struct nlmsghdr *)(void *)buf;
+		     NLMSG_OK(nlm, len);
+		     nlm = NLMSG_NEXT(nlm, len))
+		{
+			if (nlm->nlmsg_type != NLMSG_ERROR)
+				continue;
+			/* ACKs arrive in order, so this is normally
+			 * the first pending request. */
+			TAILQ_FOREACH(req, &b->pending, next) {
+				if (req->seq == nlm->nlmsg_seq)
+					break;
+			}
+			if (req == NULL)
+				continue;
+			if (nlm->nlmsg_len < NLMSG_LENGTH(sizeof(*err)))
+				error = EBADMSG;
+			else {
+				err = (struct nlmsgerr *)NLMSG_DATA(nlm);
+				error = -err->error;
+			}
+			TAILQ_REMOVE(&b->pending, req, next);
+			done_netlink(ctx, req, error);
+		}
+	}
+
+	if (TAILQ_FIRST(&b->pending) == NULL)
+		eloop_timeout_delete(ctx->eloop, timeout_netlink, ctx);
+}
+
+void
+if_batch_begin(struct dhcpcd_ctx *ctx)
+{
+	struct nl_batch *b;
+
+	if ((b = ctx->nl_batch) == NULL) {
+		/* If we cannot allocate a batch,
+		 * requests are sent one by one. */
+		if ((b = calloc(1, sizeof(*b))) == NULL)
+			return;
+		b->fd = -1;
+		TAILQ_INIT(&b->queued);
+		TAILQ_INIT(&b->pending);
+		TAILQ_INIT(&b->free_reqs);
+		ctx->nl_batch = b;
+	}
+	b->depth++;
+}
+
+void
+if_batch_callback(struct dhcpcd_ctx *ctx,
+    void (*callback)(struct dhcpcd_ctx *, void *, int),
+    const void *data, size_t len)
+{
+	struct nl_batch *b;
+	struct nl_request *req;
+
+	b = ctx->nl_batch;
+	if (b == NULL || b->depth == 0 ||
+	    (req = TAILQ_LAST(&b->queued, nl_request_head)) == NULL)
+		return;
+	if ((req->arg = malloc(len)) == NULL) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		return;
+	}
+	memcpy(req->arg, data, len);
+	req->callback = callback;
+}
+
+void
+if_batch_commit(struct dhcpcd_ctx *ctx)
+{
+	struct nl_batch *b;
+	struct nl_request_head reqs;
+	struct nl_request *req;
+	struct sockaddr_nl snl;
+	struct iovec iov;
+	struct msghdr msg;
+	char *buf;
+	size_t n;
+	int error;
+	struct timeval deadline;
+
+	b = ctx->nl_batch;
+	if (b == NULL || b->depth == 0 || --b->depth > 0 ||
+	    TAILQ_FIRST(&b->queued) == NULL)
+		return;
+
+	/* Callbacks may start a new batch, so take ownership of
+	 * this one before sending it. */
+	TAILQ_INIT(&reqs);
+	while ((req = TAILQ_FIRST(&b->queued))) {
+		TAILQ_REMOVE(&b->queued, req, next);
+		TAILQ_INSERT_TAIL(&reqs, req, next);
+	}
+	buf = b->buf;
+	b->buf = NULL;
+	b->buf_len = b->buf_size = 0;
+
+	error = 0;
+	if (b->fd == -1) {
+		memset(&snl, 0, sizeof(snl));
+		if ((b->fd = _open_link_socket(&snl, 1, NETLINK_ROUTE)) == -1 ||
+		    eloop_event_add(ctx->eloop, b->fd,
+		    read_netlink, ctx, NULL, NULL) == -1)
+		{
+			error = errno;
+			if (b->fd != -1) {
+				close(b->fd);
+				b->fd = -1;
+			}
+		}
+	}
+
+	/* Each request gets its own deadline so that committing more
+	 * does not give older ones longer to be answered. */
+	get_monotonic(&deadline);
+	deadline.tv_sec += NLACK_TIMEOUT;
+
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	iov.iov_base = buf;
+	while (TAILQ_FIRST(&reqs)) {
+		iov.iov_len = 0;
+		n = 0;
+		TAILQ_FOREACH(req, &reqs, next) {
+			if (n == NLBATCH_MAX)
+				break;
+			iov.iov_len += req->len;
+			n++;
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &snl;
+		msg.msg_namelen = sizeof(snl);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		if (error == 0 && sendmsg(b->fd, &msg, 0) == -1)
+			error = errno;
+		iov.iov_base = (char *)iov.iov_base + iov.iov_len;
+
+		for (; n > 0; n--) {
+			req = TAILQ_FIRST(&reqs);
+			TAILQ_REMOVE(&reqs, req, next);
+			if (error)
+				done_netlink(ctx, req, error);
+			else {
+				req->deadline = deadline;
+				TAILQ_INSERT_TAIL(&b->pending, req, next);
+			}
+		}
+		/* Make room for the ACKs of the next send */
+		if (error == 0 && TAILQ_FIRST(&reqs))
+			read_netlink(ctx);
+	}
+	free(buf);
+
+	/* If older requests are still pending,
+	 * timeout_netlink is already waiting for them. */
+	if ((req = TAILQ_FIRST(&b->pending)) &&
+	    req->deadline.tv_sec == deadline.tv_sec &&
+	    req->deadline.tv_usec == deadline.tv_usec)
+		eloop_timeout_add_sec(ctx->eloop, NLACK_TIMEOUT,
+		    timeout_netlink, ctx);
+}
+
+void
+if_batch_free(struct dhcpcd_ctx *ctx)
+{
+	struct nl_batch *b;
+	struct nl_request *req;
+
+	if ((b = ctx->nl_batch) == NULL)
+		return;
+	if (b->fd != -1) {
+		/* Report anything the kernel has already answered */
+		read_netlink(ctx);
+		eloop_event_delete(ctx->eloop, b->fd, 0);
+		close(b->fd);
+	}
+	eloop_timeout_delete(ctx->eloop, timeout_netlink, ctx);
+	while ((req = TAILQ_FIRST(&b->queued))) {
+		TAILQ_REMOVE(&b->queued, req, next);
+		free(req->arg);
+		free(req);
+	}
+	while ((req = TAILQ_FIRST(&b->pending))) {
+		TAILQ_REMOVE(&b->pending, req, next);
+		free(req->arg);
+		free(req);
+	}
+	while ((req = TAILQ_FIRST(&b->free_reqs))) {
+		TAILQ_REMOVE(&b->free_reqs, req, next);
+		free(req);
+	}
+	free(b->buf);
+	free(b);
+	ctx->nl_batch = NULL;
+}
+
 #define NLMSG_TAIL(nmsg)						\
 	((struct rtattr *)(((ptrdiff_t)(nmsg))+NLMSG_ALIGN((nmsg)->nlmsg_len)))
 
@@ -1263,7 +2036,7 @@ if_address(const struct interface *iface,
 		add_attr_l(&nlm.hdr, sizeof(nlm), IFA_BROADCAST,
 		    &broadcast->s_addr, sizeof(broadcast->s_addr));
 
-	if (send_netlink(iface->ctx, NULL, NETLINK_ROUTE, &nlm.hdr, NULL) == -1)
+	if (request_netlink(iface->ctx, iface->name, &nlm.hdr) == -1)
 		retval = -1;
 	return retval;
 }
@@ -1328,11 +2101,97 @@ if_route(const struct rt *rt, int action)
 		add_attr_32(&nlm.hdr, sizeof(nlm), RTA_OIF, rt->iface->index);
 	add_attr_32(&nlm.hdr, sizeof(nlm), RTA_PRIORITY, rt->metric);
 
-	if (send_netlink(rt->iface->ctx, NULL,
-	    NETLINK_ROUTE, &nlm.hdr, NULL) == -1)
+	if (request_netlink(rt->iface->ctx, rt->iface->name, &nlm.hdr) == -1)
 		retval = -1;
 	return retval;
 }
+
+static int
+_if_initrt(struct dhcpcd_ctx *ctx, __unused struct interface *ifp,
+    struct nlmsghdr *nlm)
+{
+	size_t len;
+	unsigned int metric;
+	struct rtattr *rta;
+	struct rtmsg *rtm;
+	struct rt rt, *rtp;
+
+	if (nlm->nlmsg_type != RTM_NEWROUTE)
+		return 0;
+#ifdef NLM_F_DUMP_INTR
+	/* The table changed while we were reading it */
+	if (nlm->nlmsg_flags & NLM_F_DUMP_INTR) {
+		errno = EAGAIN;
+		return -1;
+	}
+#endif
+
+	len = nlm->nlmsg_len - sizeof(*nlm);
+	if (len < sizeof(*rtm)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	rtm = NLMSG_DATA(nlm);
+	if (rtm->rtm_type != RTN_UNICAST ||
+	    rtm->rtm_table != RT_TABLE_MAIN ||
+	    rtm->rtm_family != AF_INET)
+		return 0;
+
+	rta = (struct rtattr *)(void *)((char *)rtm +NLMSG_ALIGN(sizeof(*rtm)));
+	len = NLMSG_PAYLOAD(nlm, sizeof(*rtm));
+	memset(&rt, 0, sizeof(rt));
+	metric = 0;
+	while (RTA_OK(rta, len)) {
+		switch (rta->rta_type) {
+		case RTA_DST:
+			memcpy(&rt.dest.s_addr, RTA_DATA(rta),
+			    sizeof(rt.dest.s_addr));
+			break;
+		case RTA_GATEWAY:
+			memcpy(&rt.gate.s_addr, RTA_DATA(rta),
+			    sizeof(rt.gate.s_addr));
+			break;
+		case RTA_PREFSRC:
+			memcpy(&rt.src.s_addr, RTA_DATA(rta),
+			    sizeof(rt.src.s_addr));
+			break;
+		case RTA_OIF:
+			rt.iface = if_findindex(ctx,
+			    *(unsigned int *)RTA_DATA(rta));
+			break;
+		case RTA_PRIORITY:
+			metric = *(unsigned int *)RTA_DATA(rta);
+			break;
+		}
+		rta = RTA_NEXT(rta, len);
+	}
+
+	/* Routes at another metric cannot clash with ours */
+	if (rt.iface == NULL || metric != rt.iface->metric)
+		return 0;
+	rt.metric = metric;
+	inet_cidrtoaddr(rtm->rtm_dst_len, &rt.net);
+	if ((rtp = malloc(sizeof(*rtp))) == NULL)
+		return -1;
+	memcpy(rtp, &rt, sizeof(*rtp));
+	TAILQ_INSERT_TAIL(ctx->ipv4_kroutes, rtp, next);
+	return 0;
+}
+
+int
+if_initrt(struct dhcpcd_ctx *ctx)
+{
+	struct nlmr nlm;
+
+	memset(&nlm, 0, sizeof(nlm));
+	nlm.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	nlm.hdr.nlmsg_type = RTM_GETROUTE;
+	nlm.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlm.rt.rtm_family = AF_INET;
+	nlm.rt.rtm_table = RT_TABLE_MAIN;
+
+	return send_netlink(ctx, NULL, NETLINK_ROUTE, &nlm.hdr, &_if_initrt);
+}
 #endif
 
 #ifdef INET6
@@ -1378,8 +2237,7 @@ if_address6(const struct ipv6_addr *ap, int action)
 	}
 #endif
 
-	if (send_netlink(ap->iface->ctx, NULL,
-	    NETLINK_ROUTE, &nlm.hdr, NULL) == -1)
+	if (request_netlink(ap->iface->ctx, ap->iface->name, &nlm.hdr) == -1)
 		retval = -1;
 	return retval;
 }
@@ -1464,8 +2322,7 @@ if_route6(const struct rt6 *rt, int action)
 		    RTA_DATA(metrics), RTA_PAYLOAD(metrics));
 	}
 
-	if (send_netlink(rt->iface->ctx, NULL,
-	    NETLINK_ROUTE, &nlm.hdr, NULL) == -1)
+	if (request_netlink(rt->iface->ctx, rt->iface->name, &nlm.hdr) == -1)
 		retval = -1;
 	return retval;
 }
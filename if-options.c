@@ -93,6 +93,9 @@
 #define O_SLAAC			O_BASE + 35
 #define O_GATEWAY		O_BASE + 36
 #define O_PFXDLGMIX		O_BASE + 37
+#define O_CONTROLQUEUE		O_BASE + 38
+#define O_CONTROLQUEUE_POLICY	O_BASE + 39
+#define O_LINK_DEBOUNCE		O_BASE + 40
 
 const struct option cf_options[] = {
 	{"background",      no_argument,       NULL, 'b'},
@@ -180,6 +183,9 @@ const struct option cf_options[] = {
 	{"slaac",           required_argument, NULL, O_SLAAC},
 	{"gateway",         no_argument,       NULL, O_GATEWAY},
 	{"ia_pd_mix",       no_argument,       NULL, O_PFXDLGMIX},
+	{"controlqueue",    required_argument, NULL, O_CONTROLQUEUE},
+	{"controlqueue_policy", required_argument, NULL, O_CONTROLQUEUE_POLICY},
+	{"link_debounce",   required_argument, NULL, O_LINK_DEBOUNCE},
 	{NULL,              0,                 NULL, '\0'}
 };
 
@@ -1441,7 +1447,7 @@ err_sla:
 			if (*edop) {
 				dop = &(*edop)->embopts;
 				dop_len = &(*edop)->embopts_len;
-			} else if (ldop) {
+			} else if (*ldop) {
 				dop = &(*ldop)->embopts;
 				dop_len = &(*ldop)->embopts_len;
 			} else {
@@ -1902,6 +1908,49 @@ err_sla:
 		ctx->control_group = grp->gr_gid;
 #endif
 		break;
+	case O_CONTROLQUEUE:
+		errno = 0;
+		u = strtoul(arg, &np, 0);
+		if (errno != 0 || np == arg || u == 0) {
+			syslog(LOG_ERR, "controlqueue: `%s' out of range", arg);
+			return -1;
+		}
+		ctx->control_queue_max = (size_t)u;
+		np = strskipwhite(np);
+		if (np && *np != '\0') {
+			errno = 0;
+			u = strtoul(np, &fp, 0);
+			if (errno != 0 || fp == np || u == 0) {
+				syslog(LOG_ERR, "controlqueue: `%s' out of range",
+				    np);
+				return -1;
+			}
+			ctx->control_queue_bytes_max = (size_t)u;
+		}
+		break;
+	case O_CONTROLQUEUE_POLICY:
+		if (strcmp(arg, "drop") == 0)
+			ctx->control_queue_policy = CONTROL_POLICY_DROP;
+		else if (strcmp(arg, "coalesce") == 0)
+			ctx->control_queue_policy = CONTROL_POLICY_COALESCE;
+		else if (strcmp(arg, "disconnect") == 0)
+			ctx->control_queue_policy = CONTROL_POLICY_DISCONNECT;
+		else {
+			syslog(LOG_ERR, "controlqueue_policy: unknown policy `%s'",
+			    arg);
+			return -1;
+		}
+		break;
+	case O_LINK_DEBOUNCE:
+		errno = 0;
+		u = strtoul(arg, &np, 0);
+		if (errno != 0 || np == arg || *np != '\0' || u > 10000) {
+			syslog(LOG_ERR, "link_debounce: `%s' out of range",
+			    arg);
+			return -1;
+		}
+		ctx->link_debounce = (unsigned int)u;
+		break;
 	case O_GATEWAY:
 		ifo->options |= DHCPCD_GATEWAY;
 		break;
@@ -1923,31 +1972,84 @@ err_sla:
 	return 1;
 }
 
-static int
-parse_config_line(struct dhcpcd_ctx *ctx, const char *ifname,
-    struct if_options *ifo, const char *opt, char *line,
-    struct dhcp_opt **ldop, struct dhcp_opt **edop)
+/* cf_options hashed by name so that finding the option for a line of a
+ * large config file does not mean comparing it against every name.
+ * Built by cf_hashinit before the first config is read. */
+#define CF_HASH_SIZE	256	/* power of 2, at least twice cf_options */
+static const struct option *cf_hash[CF_HASH_SIZE];
+static int cf_hashed;
+
+/* Fails to compile if cf_options outgrows the table */
+typedef char cf_hash_size_check[CF_HASH_SIZE >=
+    2 * sizeof(cf_options) / sizeof(cf_options[0]) ? 1 : -1];
+
+/* FNV-1a, start with CF_FNV_BASIS and feed it more data as needed */
+#define CF_FNV_BASIS	2166136261U
+
+static size_t
+cf_fnv(size_t h, const void *data, size_t len)
 {
-	unsigned int i;
+	const unsigned char *p;
 
-	for (i = 0; i < sizeof(cf_options) / sizeof(cf_options[0]); i++) {
-		if (!cf_options[i].name ||
-		    strcmp(cf_options[i].name, opt) != 0)
-			continue;
+	for (p = data; len != 0; p++, len--)
+		h = (h ^ *p) * 16777619U;
+	return h;
+}
 
-		if (cf_options[i].has_arg == required_argument && !line) {
-			fprintf(stderr,
-			    PACKAGE ": option requires an argument -- %s\n",
-			    opt);
-			return -1;
-		}
+static size_t
+cf_hashname(const char *name)
+{
+
+	return cf_fnv(CF_FNV_BASIS, name, strlen(name)) & (CF_HASH_SIZE - 1);
+}
 
-		return parse_option(ctx, ifname, ifo, cf_options[i].val, line,
-		    ldop, edop);
+static void
+cf_hashinit(void)
+{
+	const struct option *o;
+	size_t h;
+
+	for (o = cf_options; o->name; o++) {
+		h = cf_hashname(o->name);
+		while (cf_hash[h])
+			h = (h + 1) & (CF_HASH_SIZE - 1);
+		cf_hash[h] = o;
 	}
+	cf_hashed = 1;
+}
 
-	syslog(LOG_ERR, "unknown option: %s", opt);
-	return -1;
+static const struct option *
+cf_find(const char *name)
+{
+	const struct option *o;
+	size_t h;
+
+	h = cf_hashname(name);
+	while ((o = cf_hash[h]) != NULL) {
+		if (strcmp(o->name, name) == 0)
+			return o;
+		h = (h + 1) & (CF_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
+static int
+parse_config_option(struct dhcpcd_ctx *ctx, const char *ifname,
+    struct if_options *ifo, const struct option *o, const char *opt,
+    char *line, struct dhcp_opt **ldop, struct dhcp_opt **edop)
+{
+
+	if (o == NULL) {
+		syslog(LOG_ERR, "unknown option: %s", opt);
+		return -1;
+	}
+	if (o->has_arg == required_argument && !line) {
+		fprintf(stderr,
+		    PACKAGE ": option requires an argument -- %s\n",
+		    opt);
+		return -1;
+	}
+	return parse_option(ctx, ifname, ifo, o->val, line, ldop, edop);
 }
 
 static void
@@ -1988,22 +2090,329 @@ get_line(char ** __restrict buf, size_t * __restrict buflen,
 	return p;
 }
 
-struct if_options *
-read_config(struct dhcpcd_ctx *ctx,
-    const char *ifname, const char *ssid, const char *profile)
+/* dhcpcd.conf is read once into a list of blocks, the global block
+ * followed by the interface, ssid and profile blocks in file order.
+ * read_config then applies the blocks for an interface from memory. */
+#define CONF_GLOBAL	0
+#define CONF_INTERFACE	1
+#define CONF_SSID	2
+#define CONF_PROFILE	3
+
+struct if_conf_line {
+	char *option;		/* option and argument, see arg */
+	char *arg;		/* points into option, or NULL */
+	size_t len;
+	const struct option *cf;	/* option found by cf_find, or NULL */
+};
+
+struct if_conf_block {
+	TAILQ_ENTRY(if_conf_block) next;
+	struct if_conf_block *hnext;	/* see conf_index */
+	struct if_conf_block *same;	/* next with this type and name */
+	struct if_conf_block *same_last;	/* the first one only */
+	size_t same_len;		/* the first one only */
+	size_t seq;			/* position in the file */
+	int type;
+	char *name;
+	struct if_conf_line *lines;
+	size_t lines_len;
+	size_t lines_size;
+};
+TAILQ_HEAD(if_conf_head, if_conf_block);
+
+/* Interfaces configured from the same blocks and arguments get the
+ * same options, so the first one parsed is kept as a template.
+ * Later interfaces get a copy of the template which shares its
+ * allocated data, see if_options_clone.
+ * Templates are hashed by what they were parsed from and go away with
+ * the last copy, so each new set of arguments does not leave one. */
+struct if_conf_tmpl {
+	TAILQ_ENTRY(if_conf_tmpl) next;
+	struct if_conf_tmpl *hnext;
+	struct if_conf *conf;
+	size_t hash;
+	struct if_conf_block **sel;
+	size_t sel_len;
+	int argc;
+	char **argv;
+	struct if_options *ifo;
+};
+TAILQ_HEAD(if_conf_tmpl_head, if_conf_tmpl);
+
+struct if_conf {
+	struct if_conf_head blocks;
+	size_t blocks_len;
+	struct if_conf_block *global;
+	/* The first interface, ssid and profile block of each name,
+	 * hashed by type and name */
+	struct if_conf_block **index;
+	size_t index_size;
+	struct if_conf_tmpl_head tmpls;
+	struct if_conf_tmpl **tmpls_hash;
+	size_t tmpls_hsize;
+	size_t tmpls_len;
+	int error;		/* errno from opening the file */
+};
+
+static struct if_conf_block *
+conf_newblock(struct if_conf *conf, int type, const char *name)
+{
+	struct if_conf_block *cb;
+
+	if ((cb = calloc(1, sizeof(*cb))) == NULL)
+		return NULL;
+	cb->type = type;
+	if (name && (cb->name = strdup(name)) == NULL) {
+		free(cb);
+		return NULL;
+	}
+	cb->seq = conf->blocks_len++;
+	TAILQ_INSERT_TAIL(&conf->blocks, cb, next);
+	return cb;
+}
+
+static size_t
+conf_hashblock(int type, const char *name)
+{
+
+	return cf_fnv(cf_fnv(CF_FNV_BASIS, &type, sizeof(type)),
+	    name, strlen(name));
+}
+
+static struct if_conf_block *
+conf_find(const struct if_conf *conf, int type, const char *name)
+{
+	struct if_conf_block *cb;
+
+	if (name == NULL || conf->index == NULL)
+		return NULL;
+	cb = conf->index[conf_hashblock(type, name) & (conf->index_size - 1)];
+	for (; cb; cb = cb->hnext) {
+		if (cb->type == type && strcmp(cb->name, name) == 0)
+			return cb;
+	}
+	return NULL;
+}
+
+/* Index the named blocks so selecting the blocks for an interface
+ * does not mean looking at every block in the file.
+ * Blocks of the same type and name are chained in file order from
+ * the first one, which is the one hashed. */
+static int
+conf_index(struct if_conf *conf)
+{
+	struct if_conf_block *cb, *first, **b;
+	size_t size;
+
+	for (size = 16; size < conf->blocks_len * 2; size <<= 1)
+		;
+	if ((conf->index = calloc(size, sizeof(*conf->index))) == NULL)
+		return -1;
+	conf->index_size = size;
+	TAILQ_FOREACH(cb, &conf->blocks, next) {
+		if (cb->type == CONF_GLOBAL) {
+			conf->global = cb;
+			continue;
+		}
+		if (cb->name == NULL)
+			continue;
+		first = conf_find(conf, cb->type, cb->name);
+		if (first != NULL) {
+			first->same_last->same = cb;
+			first->same_last = cb;
+			first->same_len++;
+			continue;
+		}
+		cb->same_last = cb;
+		cb->same_len = 1;
+		b = &conf->index[conf_hashblock(cb->type, cb->name) &
+		    (size - 1)];
+		cb->hnext = *b;
+		*b = cb;
+	}
+	return 0;
+}
+
+static int
+conf_addline(struct if_conf_block *cb, const char *option, const char *arg)
+{
+	struct if_conf_line *cl;
+	size_t olen, alen, n;
+
+	if (cb->lines_len == cb->lines_size) {
+		n = cb->lines_size ? cb->lines_size * 2 : 8;
+		cl = realloc(cb->lines, sizeof(*cl) * n);
+		if (cl == NULL)
+			return -1;
+		cb->lines = cl;
+		cb->lines_size = n;
+	}
+	cl = &cb->lines[cb->lines_len];
+	olen = strlen(option) + 1;
+	alen = arg ? strlen(arg) + 1 : 0;
+	if ((cl->option = malloc(olen + alen)) == NULL)
+		return -1;
+	memcpy(cl->option, option, olen);
+	if (arg) {
+		cl->arg = cl->option + olen;
+		memcpy(cl->arg, arg, alen);
+	} else
+		cl->arg = NULL;
+	cl->len = olen + alen;
+	cl->cf = cf_find(option);
+	cb->lines_len++;
+	return 0;
+}
+
+/* Frees the key, the options are freed by the caller */
+static void
+conf_freetmpl(struct if_conf_tmpl *t)
+{
+	int i;
+
+	for (i = 0; i < t->argc; i++)
+		free(t->argv[i]);
+	free(t->argv);
+	free(t->sel);
+	free(t);
+}
+
+/* The last copy of the template has been freed */
+static void
+conf_droptmpl(struct if_conf_tmpl *t)
+{
+	struct if_conf *conf;
+	struct if_conf_tmpl **b;
+
+	conf = t->conf;
+	b = &conf->tmpls_hash[t->hash & (conf->tmpls_hsize - 1)];
+	for (; *b; b = &(*b)->hnext) {
+		if (*b == t) {
+			*b = t->hnext;
+			break;
+		}
+	}
+	TAILQ_REMOVE(&conf->tmpls, t, next);
+	conf->tmpls_len--;
+	conf_freetmpl(t);
+}
+
+static void
+conf_free(struct if_conf *conf)
+{
+	struct if_conf_block *cb;
+	struct if_conf_tmpl *t;
+	size_t i;
+
+	if (conf == NULL)
+		return;
+	while ((t = TAILQ_FIRST(&conf->tmpls))) {
+		TAILQ_REMOVE(&conf->tmpls, t, next);
+		/* Interfaces still using the options keep them */
+		t->ifo->tmpl = NULL;
+		if (t->ifo->refs == 0)
+			free_options(t->ifo);
+		conf_freetmpl(t);
+	}
+	free(conf->tmpls_hash);
+	while ((cb = TAILQ_FIRST(&conf->blocks))) {
+		TAILQ_REMOVE(&conf->blocks, cb, next);
+		for (i = 0; i < cb->lines_len; i++)
+			free(cb->lines[i].option);
+		free(cb->lines);
+		free(cb->name);
+		free(cb);
+	}
+	free(conf->index);
+	free(conf);
+}
+
+void
+free_config(struct dhcpcd_ctx *ctx)
+{
+
+	conf_free(ctx->conf);
+	ctx->conf = NULL;
+}
+
+static struct if_conf *
+load_config(struct dhcpcd_ctx *ctx)
+{
+	struct if_conf *conf;
+	struct if_conf_block *cb;
+	FILE *fp;
+	char *buf, *line, *option, *p;
+	size_t buflen;
+	int type;
+
+	if ((conf = calloc(1, sizeof(*conf))) == NULL)
+		return NULL;
+	TAILQ_INIT(&conf->blocks);
+	TAILQ_INIT(&conf->tmpls);
+	fp = fopen(ctx->cffile, "r");
+	if (fp == NULL) {
+		conf->error = errno;
+		if (strcmp(ctx->cffile, CONFIG))
+			syslog(LOG_ERR, "fopen `%s': %m", ctx->cffile);
+		return conf;
+	}
+
+	buf = NULL;
+	buflen = 0;
+	cb = conf_newblock(conf, CONF_GLOBAL, NULL);
+	while (cb && (line = get_line(&buf, &buflen, fp))) {
+		option = strsep(&line, " \t");
+		if (line)
+			line = strskipwhite(line);
+		/* Trim trailing whitespace */
+		if (line && *line) {
+			p = line + strlen(line) - 1;
+			while (p != line &&
+			    (*p == ' ' || *p == '\t') &&
+			    *(p - 1) != '\\')
+				*p-- = '\0';
+		}
+		if (strcmp(option, "interface") == 0)
+			type = CONF_INTERFACE;
+		else if (strcmp(option, "ssid") == 0)
+			type = CONF_SSID;
+		else if (strcmp(option, "profile") == 0)
+			type = CONF_PROFILE;
+		else {
+			if (conf_addline(cb, option, line) == -1)
+				cb = NULL;
+			continue;
+		}
+		cb = conf_newblock(conf, type, line);
+	}
+	fclose(fp);
+	free(buf);
+
+	if (cb == NULL || conf_index(conf) == -1) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		conf_free(conf);
+		return NULL;
+	}
+	return conf;
+}
+
+static struct if_options *
+read_config1(struct dhcpcd_ctx *ctx, const char *ifname,
+    struct if_conf_block **sel, size_t sel_len)
 {
 	struct if_options *ifo;
+#ifdef EMBEDDED_CONFIG
 	FILE *fp;
-	char *line, *buf, *option, *p;
+	char *option;
+#endif
+	char *line, *buf, *p;
 	size_t buflen;
 	ssize_t vlen;
-	int skip = 0, have_profile = 0;
-#ifndef EMBEDDED_CONFIG
-	const char * const *e;
-	size_t ol;
-#endif
-#if !defined(INET) || !defined(INET6)
-	size_t i;
+	int sel_profile, have_profile;
+	struct if_conf_block *cb;
+	struct if_conf_line *cl;
+	size_t i, cll;
+#if defined(EMBEDDED_CONFIG) && (!defined(INET) || !defined(INET6))
 	struct dhcp_opt *opt;
 #endif
 	struct dhcp_opt *ldop, *edop;
@@ -2039,6 +2448,22 @@ read_config(struct dhcpcd_ctx *ctx,
 	buf = NULL;
 	buflen = 0;
 
+#ifndef EMBEDDED_CONFIG
+	/* Our embedded options are compiled into static tables by
+	 * genembedc so there is nothing to parse. */
+	if (ifname == NULL) {
+#ifdef INET
+		ctx->dhcp_opts = dhcpcd_embedded_dhcp_opts;
+		ctx->dhcp_opts_len = dhcpcd_embedded_dhcp_opts_len;
+#endif
+#ifdef INET6
+		ctx->dhcp6_opts = dhcpcd_embedded_dhcp6_opts;
+		ctx->dhcp6_opts_len = dhcpcd_embedded_dhcp6_opts_len;
+#endif
+		ctx->vivso = dhcpcd_embedded_vivso;
+		ctx->vivso_len = dhcpcd_embedded_vivso_len;
+	}
+#else
 	/* Parse our embedded options file */
 	if (ifname == NULL) {
 		/* Space for initial estimates */
@@ -2061,34 +2486,12 @@ read_config(struct dhcpcd_ctx *ctx,
 #endif
 
 		/* Now load our embedded config */
-#ifdef EMBEDDED_CONFIG
 		fp = fopen(EMBEDDED_CONFIG, "r");
 		if (fp == NULL)
 			syslog(LOG_ERR, "fopen `%s': %m", EMBEDDED_CONFIG);
 
-		while (fp && (line = get_line(&buf, &buflen, fp))) {
-#else
-		buflen = 80;
-		buf = malloc(buflen);
-		if (buf == NULL) {
-			syslog(LOG_ERR, "%s: %m", __func__);
-			return NULL;
-		}
 		ldop = edop = NULL;
-		for (e = dhcpcd_embedded_conf; *e; e++) {
-			ol = strlen(*e) + 1;
-			if (ol > buflen) {
-				buflen = ol;
-				buf = realloc(buf, buflen);
-				if (buf == NULL) {
-					syslog(LOG_ERR, "%s: %m", __func__);
-					free(buf);
-					return NULL;
-				}
-			}
-			memcpy(buf, *e, ol);
-			line = buf;
-#endif
+		while (fp && (line = get_line(&buf, &buflen, fp))) {
 			option = strsep(&line, " \t");
 			if (line)
 				line = strskipwhite(line);
@@ -2100,15 +2503,12 @@ read_config(struct dhcpcd_ctx *ctx,
 				    *(p - 1) != '\\')
 					*p-- = '\0';
 			}
-			parse_config_line(ctx, NULL, ifo, option, line,
-			    &ldop, &edop);
+			parse_config_option(ctx, NULL, ifo, cf_find(option),
+			    option, line, &ldop, &edop);
 
 		}
-
-#ifdef EMBEDDED_CONFIG
 		if (fp)
 			fclose(fp);
-#endif
 #ifdef INET
 		ctx->dhcp_opts = ifo->dhcp_override;
 		ctx->dhcp_opts_len = ifo->dhcp_override_len;
@@ -2140,40 +2540,320 @@ read_config(struct dhcpcd_ctx *ctx,
 		ifo->vivso_override = NULL;
 		ifo->vivso_override_len = 0;
 	}
+#endif
 
-	/* Parse our options file */
-	fp = fopen(ctx->cffile, "r");
-	if (fp == NULL) {
-		if (strcmp(ctx->cffile, CONFIG))
-			syslog(LOG_ERR, "fopen `%s': %m", ctx->cffile);
+	/* Parse the blocks of our options file that apply */
+	sel_profile = have_profile = 0;
+	for (i = 0; i < sel_len; i++) {
+		if (sel[i]->type == CONF_PROFILE)
+			sel_profile = 1;
+	}
+	if (ctx->conf->error) {
 		free(buf);
 		return ifo;
 	}
 
 	ldop = edop = NULL;
-	while ((line = get_line(&buf, &buflen, fp))) {
-		option = strsep(&line, " \t");
-		if (line)
-			line = strskipwhite(line);
-		/* Trim trailing whitespace */
-		if (line && *line) {
-			p = line + strlen(line) - 1;
-			while (p != line &&
-			    (*p == ' ' || *p == '\t') &&
-			    *(p - 1) != '\\')
-				*p-- = '\0';
+	for (i = 0; i < sel_len; i++) {
+		cb = sel[i];
+		if (cb->type == CONF_PROFILE)
+			have_profile = 1;
+		for (cll = 0; cll < cb->lines_len; cll++) {
+			cl = &cb->lines[cll];
+			/* Skip arping if we have selected a profile but not
+			 * parsing one. */
+			if (sel_profile && !have_profile &&
+			    cl->cf && cl->cf->val == O_ARPING)
+				continue;
+			/* parse_option can modify the argument */
+			if (cl->len > buflen) {
+				p = realloc(buf, cl->len);
+				if (p == NULL) {
+					syslog(LOG_ERR, "%s: %m", __func__);
+					continue;
+				}
+				buf = p;
+				buflen = cl->len;
+			}
+			memcpy(buf, cl->option, cl->len);
+			line = cl->arg ? buf + (cl->arg - cl->option) : NULL;
+			parse_config_option(ctx, ifname, ifo, cl->cf, buf, line,
+			    &ldop, &edop);
 		}
-		/* Start of an interface block, skip if not ours */
-		if (strcmp(option, "interface") == 0) {
-			char **n;
+	}
+	free(buf);
 
-			if (ifname && line && strcmp(line, ifname) == 0)
-				skip = 0;
-			else
-				skip = 1;
-			if (ifname)
-				continue;
+	finish_config(ifo);
+	return ifo;
+}
+
+/* Select the blocks which apply to the interface, in file order.
+ * The interface, ssid and profile chains are each in file order,
+ * so they are merged after the global block.
+ * Returns -1 with errno set to ENOENT if the profile is not found. */
+static ssize_t
+conf_select(struct if_conf *conf, struct if_conf_block ***selp,
+    const char *ifname, const char *ssid, const char *profile)
+{
+	struct if_conf_block *chain[3], **sel, **next;
+	size_t len, i;
+
+	chain[0] = conf_find(conf, CONF_INTERFACE, ifname);
+	chain[1] = conf_find(conf, CONF_SSID, ssid);
+	chain[2] = conf_find(conf, CONF_PROFILE, profile);
+	if (profile && chain[2] == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	len = 1;
+	for (i = 0; i < 3; i++) {
+		if (chain[i])
+			len += chain[i]->same_len;
+	}
+	if ((sel = malloc(sizeof(*sel) * len)) == NULL)
+		return -1;
+
+	len = 0;
+	if (conf->global)
+		sel[len++] = conf->global;
+	for (;;) {
+		next = NULL;
+		for (i = 0; i < 3; i++) {
+			if (chain[i] &&
+			    (next == NULL || chain[i]->seq < (*next)->seq))
+				next = &chain[i];
+		}
+		if (next == NULL)
+			break;
+		sel[len++] = *next;
+		*next = (*next)->same;
+	}
+	*selp = sel;
+	return (ssize_t)len;
+}
+
+static size_t
+conf_hashtmpl(struct if_conf_block **sel, size_t sel_len,
+    int argc, char **argv)
+{
+	size_t h;
+	int i;
+
+	h = cf_fnv(CF_FNV_BASIS, sel, sizeof(*sel) * sel_len);
+	for (i = 0; i < argc; i++)
+		h = cf_fnv(h, argv[i], strlen(argv[i]) + 1);
+	return h;
+}
+
+static struct if_conf_tmpl *
+conf_findtmpl(struct if_conf *conf, size_t hash,
+    struct if_conf_block **sel, size_t sel_len, int argc, char **argv)
+{
+	struct if_conf_tmpl *t;
+	int i;
+
+	if (conf->tmpls_hash == NULL)
+		return NULL;
+	t = conf->tmpls_hash[hash & (conf->tmpls_hsize - 1)];
+	for (; t; t = t->hnext) {
+		if (t->hash != hash ||
+		    t->sel_len != sel_len || t->argc != argc ||
+		    memcmp(t->sel, sel, sizeof(*sel) * sel_len) != 0)
+			continue;
+		for (i = 0; i < argc; i++) {
+			if (strcmp(t->argv[i], argv[i]) != 0)
+				break;
+		}
+		if (i == argc)
+			return t;
+	}
+	return NULL;
+}
+
+static int
+conf_hashaddtmpl(struct if_conf *conf, struct if_conf_tmpl *t)
+{
+	struct if_conf_tmpl **h, *tt, **b;
+	size_t size;
+
+	if (conf->tmpls_len + 1 > conf->tmpls_hsize / 2) {
+		size = conf->tmpls_hsize ? conf->tmpls_hsize * 2 : 16;
+		if ((h = calloc(size, sizeof(*h))) == NULL)
+			return -1;
+		TAILQ_FOREACH(tt, &conf->tmpls, next) {
+			b = &h[tt->hash & (size - 1)];
+			tt->hnext = *b;
+			*b = tt;
+		}
+		free(conf->tmpls_hash);
+		conf->tmpls_hash = h;
+		conf->tmpls_hsize = size;
+	}
+	b = &conf->tmpls_hash[t->hash & (conf->tmpls_hsize - 1)];
+	t->hnext = *b;
+	*b = t;
+	TAILQ_INSERT_TAIL(&conf->tmpls, t, next);
+	conf->tmpls_len++;
+	return 0;
+}
+
+/* Write down what the options are parsed from so that a reload can
+ * tell if they would change, see if_options_same.
+ * Each selected block and line, then each argument, is marked by a
+ * byte saying what follows. */
+#define SRC_BLOCK	1
+#define SRC_LINE	2
+#define SRC_LINEARG	3
+#define SRC_ARG		4
+
+static uint8_t *
+conf_source(struct if_conf_block **sel, size_t sel_len,
+    int argc, char **argv, size_t *lenp)
+{
+	size_t i, j, len, l;
+	int a;
+	struct if_conf_line *cl;
+	uint8_t *src, *p;
+
+	len = 0;
+	for (i = 0; i < sel_len; i++) {
+		len += 2 + (sel[i]->name ? strlen(sel[i]->name) : 0) + 1;
+		for (j = 0; j < sel[i]->lines_len; j++)
+			len += 1 + sel[i]->lines[j].len;
+	}
+	/* Like getopt, skip the program name */
+	for (a = 1; a < argc; a++)
+		len += 1 + strlen(argv[a]) + 1;
+	if ((src = malloc(len + 1)) == NULL)
+		return NULL;
+
+	p = src;
+	for (i = 0; i < sel_len; i++) {
+		*p++ = SRC_BLOCK;
+		*p++ = (uint8_t)sel[i]->type;
+		l = sel[i]->name ? strlen(sel[i]->name) : 0;
+		memcpy(p, sel[i]->name ? sel[i]->name : "", l + 1);
+		p += l + 1;
+		for (j = 0; j < sel[i]->lines_len; j++) {
+			cl = &sel[i]->lines[j];
+			*p++ = cl->arg ? SRC_LINEARG : SRC_LINE;
+			memcpy(p, cl->option, cl->len);
+			p += cl->len;
+		}
+	}
+	for (a = 1; a < argc; a++) {
+		*p++ = SRC_ARG;
+		l = strlen(argv[a]) + 1;
+		memcpy(p, argv[a], l);
+		p += l;
+	}
+	*lenp = len;
+	return src;
+}
+
+static struct if_conf_tmpl *
+conf_addtmpl(struct if_conf *conf, size_t hash, struct if_conf_block **sel,
+    size_t sel_len, int argc, char **argv, struct if_options *ifo)
+{
+	struct if_conf_tmpl *t;
+
+	ifo->source = conf_source(sel, sel_len, argc, argv,
+	    &ifo->source_len);
+	if (ifo->source == NULL)
+		return NULL;
+	if ((t = calloc(1, sizeof(*t))) == NULL)
+		return NULL;
+	t->ifo = ifo;
+	if ((t->sel = malloc(sizeof(*sel) * (sel_len + 1))) == NULL ||
+	    (t->argv = calloc((size_t)argc + 1, sizeof(char *))) == NULL)
+		goto eexit;
+	memcpy(t->sel, sel, sizeof(*sel) * sel_len);
+	t->sel_len = sel_len;
+	for (; t->argc < argc; t->argc++) {
+		if ((t->argv[t->argc] = strdup(argv[t->argc])) == NULL)
+			goto eexit;
+	}
+	t->conf = conf;
+	t->hash = hash;
+	if (conf_hashaddtmpl(conf, t) == -1)
+		goto eexit;
+	ifo->refs = 0;
+	ifo->tmpl = t;
+	return t;
+
+eexit:
+	t->ifo = NULL;
+	conf_freetmpl(t);
+	return NULL;
+}
+
+/* The copy shares everything the template allocated apart from the IA
+ * list, which configure_interface1 changes for each interface.
+ * Nothing else allocated is changed after parsing. */
+static struct if_options *
+if_options_clone(struct if_options *tmpl)
+{
+	struct if_options *ifo;
+
+	if ((ifo = malloc(sizeof(*ifo))) == NULL)
+		return NULL;
+	memcpy(ifo, tmpl, sizeof(*ifo));
+	if (tmpl->ia_len) {
+		ifo->ia = malloc(sizeof(*ifo->ia) * tmpl->ia_len);
+		if (ifo->ia == NULL) {
+			free(ifo);
+			return NULL;
+		}
+		memcpy(ifo->ia, tmpl->ia, sizeof(*ifo->ia) * tmpl->ia_len);
+	}
+	if (TAILQ_EMPTY(&tmpl->auth.tokens))
+		TAILQ_INIT(&ifo->auth.tokens);
+	ifo->refs = 0;
+	ifo->tmpl = NULL;
+	ifo->shared = tmpl;
+	tmpl->refs++;
+	return ifo;
+}
+
+struct if_options *
+read_config(struct dhcpcd_ctx *ctx,
+    const char *ifname, const char *ssid, const char *profile,
+    int argc, char **argv)
+{
+	struct if_conf_block *cb, **sel;
+	struct if_conf_tmpl *t;
+	struct if_options *ifo;
+	ssize_t sel_len;
+	size_t hash;
+	char **n;
+
+	if (!cf_hashed)
+		cf_hashinit();
+
+	/* Our options file is read when reading the global options at
+	 * startup or on reload, then interfaces are configured from
+	 * memory. */
+	if (ifname == NULL || ctx->conf == NULL) {
+		free_config(ctx);
+		if ((ctx->conf = load_config(ctx)) == NULL)
+			return NULL;
+	}
+	sel_len = conf_select(ctx->conf, &sel, ifname, ssid, profile);
+	if (sel_len == -1) {
+		if (errno != ENOENT)
+			syslog(LOG_ERR, "%s: %m", __func__);
+		return NULL;
+	}
 
+	if (ifname == NULL) {
+		ifo = read_config1(ctx, NULL, sel, (size_t)sel_len);
+		free(sel);
+		if (ifo == NULL)
+			return NULL;
+		TAILQ_FOREACH(cb, &ctx->conf->blocks, next) {
+			if (cb->type != CONF_INTERFACE || cb->name == NULL)
+				continue;
 			n = realloc(ctx->ifcv,
 			    sizeof(char *) * ((size_t)ctx->ifcc + 1));
 			if (n == NULL) {
@@ -2181,7 +2861,7 @@ read_config(struct dhcpcd_ctx *ctx,
 				continue;
 			}
 			ctx->ifcv = n;
-			ctx->ifcv[ctx->ifcc] = strdup(line);
+			ctx->ifcv[ctx->ifcc] = strdup(cb->name);
 			if (ctx->ifcv[ctx->ifcc] == NULL) {
 				syslog(LOG_ERR, "%s: %m", __func__);
 				continue;
@@ -2189,44 +2869,49 @@ read_config(struct dhcpcd_ctx *ctx,
 			ctx->ifcc++;
 			syslog(LOG_DEBUG, "allowing interface %s",
 			    ctx->ifcv[ctx->ifcc - 1]);
-			continue;
 		}
-		/* Start of an ssid block, skip if not ours */
-		if (strcmp(option, "ssid") == 0) {
-			if (ssid && line && strcmp(line, ssid) == 0)
-				skip = 0;
-			else
-				skip = 1;
-			continue;
+		return ifo;
+	}
+
+	hash = conf_hashtmpl(sel, (size_t)sel_len, argc, argv);
+	t = conf_findtmpl(ctx->conf, hash, sel, (size_t)sel_len, argc, argv);
+	if (t == NULL) {
+		ifo = read_config1(ctx, ifname, sel, (size_t)sel_len);
+		if (ifo == NULL) {
+			free(sel);
+			return NULL;
 		}
-		/* Start of a profile block, skip if not ours */
-		if (strcmp(option, "profile") == 0) {
-			if (profile && line && strcmp(line, profile) == 0) {
-				skip = 0;
-				have_profile = 1;
-			} else
-				skip = 1;
-			continue;
+		add_options(ctx, ifname, ifo, argc, argv);
+		t = conf_addtmpl(ctx->conf, hash, sel, (size_t)sel_len,
+		    argc, argv, ifo);
+		if (t == NULL) {
+			/* Not shared, but still usable */
+			free(sel);
+			return ifo;
 		}
-		/* Skip arping if we have selected a profile but not parsing
-		 * one. */
-		if (profile && !have_profile && strcmp(option, "arping") == 0)
-			continue;
-		if (skip)
-			continue;
-		parse_config_line(ctx, ifname, ifo, option, line, &ldop, &edop);
 	}
-	fclose(fp);
-	free(buf);
+	free(sel);
+	if ((ifo = if_options_clone(t->ifo)) == NULL)
+		syslog(LOG_ERR, "%s: %m", __func__);
+	return ifo;
+}
 
-	if (profile && !have_profile) {
-		free_options(ifo);
-		errno = ENOENT;
-		return NULL;
-	}
+/* Returns 1 if both options were parsed from the same config lines
+ * and arguments, even if the config has since been reloaded.
+ * Changes made for each interface after parsing are not compared. */
+int
+if_options_same(const struct if_options *a, const struct if_options *b)
+{
 
-	finish_config(ifo);
-	return ifo;
+	if (a->shared)
+		a = a->shared;
+	if (b->shared)
+		b = b->shared;
+	if (a == b)
+		return 1;
+	return a->source && b->source &&
+	    a->source_len == b->source_len &&
+	    memcmp(a->source, b->source, a->source_len) == 0;
 }
 
 int
@@ -2259,7 +2944,20 @@ free_options(struct if_options *ifo)
 	struct vivco *vo;
 	struct token *token;
 
+	if (ifo && ifo->shared) {
+		/* Only the IA list is our own, see if_options_clone */
+		free(ifo->ia);
+		free_options(ifo->shared);
+		free(ifo);
+		return;
+	}
+	if (ifo && ifo->refs > 1) {
+		ifo->refs--;
+		return;
+	}
 	if (ifo) {
+		if (ifo->tmpl)
+			conf_droptmpl(ifo->tmpl);
 		if (ifo->environ) {
 			i = 0;
 			while (ifo->environ[i])
@@ -2273,6 +2971,7 @@ free_options(struct if_options *ifo)
 			free(ifo->config);
 		}
 		ipv4_freeroutes(ifo->routes);
+		free(ifo->source);
 		free(ifo->script);
 		free(ifo->arping);
 		free(ifo->blacklist);
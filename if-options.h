@@ -109,6 +109,8 @@
 
 extern const struct option cf_options[];
 
+struct if_conf_tmpl;
+
 struct if_sla {
 	char ifname[IF_NAMESIZE];
 	uint32_t sla;
@@ -186,13 +188,25 @@ struct if_options {
 	size_t vivso_override_len;
 
 	struct auth auth;
+
+	/* Options read for one interface are a copy of a template,
+	 * sharing what it allocated, see read_config.
+	 * The template counts its copies in refs and is freed along with
+	 * the last one. */
+	struct if_options *shared;
+	unsigned int refs;
+	struct if_conf_tmpl *tmpl;
+	uint8_t *source;	/* see if_options_same */
+	size_t source_len;
 };
 
 struct if_options *read_config(struct dhcpcd_ctx *,
-    const char *, const char *, const char *);
+    const char *, const char *, const char *, int, char **);
 int add_options(struct dhcpcd_ctx *, const char *,
     struct if_options *, int, char **);
 void free_dhcp_opt_embenc(struct dhcp_opt *);
 void free_options(struct if_options *);
+void free_config(struct dhcpcd_ctx *);
+int if_options_same(const struct if_options *, const struct if_options *);
 
 #endif
@@ -121,6 +121,14 @@ if_route(const struct rt *rt, int action)
 	errno = ENOTSUP;
 	return -1;
 }
+
+int
+if_initrt(struct dhcpcd_ctx *ctx)
+{
+
+	errno = ENOTSUP;
+	return -1;
+}
 #endif
 
 #ifdef INET6
@@ -65,6 +65,7 @@
 #include "dev.h"
 #include "dhcp.h"
 #include "dhcp6.h"
+#include "eloop.h"
 #include "if.h"
 #include "if-options.h"
 #include "ipv4.h"
@@ -76,6 +77,8 @@ if_free(struct interface *ifp)
 
 	if (ifp == NULL)
 		return;
+	if (ifp->link_pending && ifp->ctx->eloop != NULL)
+		eloop_q_timeout_delete(ifp->ctx->eloop, ELOOP_LINK, NULL, ifp);
 	ipv4_free(ifp);
 	dhcp_free(ifp);
 	ipv6_free(ifp);
@@ -183,6 +186,7 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 	struct interface *ifp;
 #ifdef __linux__
 	char ifn[IF_NAMESIZE];
+	const struct if_nlinfo *nli;
 #endif
 #ifdef INET
 	const struct sockaddr_in *addr;
@@ -221,8 +225,13 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 	const struct sockaddr_ll *sll;
 #endif
 
+#ifdef __linux__
+	if (if_getifaddrs(ctx, &ifaddrs) == -1)
+		return NULL;
+#else
 	if (getifaddrs(&ifaddrs) == -1)
 		return NULL;
+#endif
 	ifs = malloc(sizeof(*ifs));
 	if (ifs == NULL)
 		return NULL;
@@ -310,7 +319,13 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 		ifp->ctx = ctx;
 		strlcpy(ifp->name, p, sizeof(ifp->name));
 		ifp->flags = ifa->ifa_flags;
+#ifdef __linux__
+		nli = ifa->ifa_data;
+		ifp->carrier = ifa->ifa_flags & IFF_RUNNING ?
+		    LINK_UP : LINK_DOWN;
+#else
 		ifp->carrier = if_carrier(ifp);
+#endif
 
 		if (ifa->ifa_addr != NULL) {
 #ifdef AF_LINK
@@ -399,9 +414,10 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 #endif
 		}
 #ifdef __linux__
-		/* PPP addresses on Linux don't have hardware addresses */
+		/* PPP addresses on Linux don't have hardware addresses,
+		 * but the link dump still told us the index */
 		else
-			ifp->index = if_nametoindex(ifp->name);
+			ifp->index = nli->index;
 #endif
 
 		/* We only work on ethernet by default */
@@ -436,14 +452,22 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 		}
 
 		/* Handle any platform init for the interface */
+#ifdef __linux__
+		if (if_initnl(ifp, nli) == -1) {
+#else
 		if (if_init(ifp) == -1) {
+#endif
 			syslog(LOG_ERR, "%s: if_init: %m", p);
 			if_free(ifp);
 			continue;
 		}
 
 		/* Ensure that the MTU is big enough for DHCP */
+#ifdef __linux__
+		if (nli->mtu < MTU_MIN &&
+#else
 		if (if_getmtu(ifp->name) < MTU_MIN &&
+#endif
 		    if_setmtu(ifp->name, MTU_MIN) == -1)
 		{
 			syslog(LOG_ERR, "%s: set_mtu: %m", p);
@@ -506,7 +530,12 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 				sin6->sin6_addr.s6_addr[2] =
 				    sin6->sin6_addr.s6_addr[3] = '\0';
 #endif
+#ifdef __linux__
+			nli = ifa->ifa_data;
+			ifa_flags = nli->addrflags;
+#else
 			ifa_flags = if_addrflags6(&sin6->sin6_addr, ifp);
+#endif
 			if (ifa_flags != -1)
 				ipv6_handleifa(ctx, RTM_NEWADDR, ifs,
 				    ifa->ifa_name,
@@ -516,7 +545,11 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 		}
 	}
 
+#ifdef __linux__
+	if_freeifaddrs(ifaddrs);
+#else
 	freeifaddrs(ifaddrs);
+#endif
 
 #ifdef SIOCGIFPRIORITY
 	close(s_inet);
@@ -528,19 +561,163 @@ if_discover(struct dhcpcd_ctx *ctx, int argc, char * const *argv)
 	return ifs;
 }
 
+/* Interfaces are also hashed by name and index so that lookups for
+ * each kernel message and packet do not walk the list.
+ * Each chain is in list order, so the first match is the same one a
+ * walk of the list would find. if_hashadd and if_hashdel keep it that
+ * way for interfaces added at the tail or removed. Anything else which
+ * moves or inserts interfaces must call if_freehash so the next lookup
+ * builds it again. */
+size_t
+if_hashname(const char *name, size_t size)
+{
+	uint32_t h;
+
+	/* FNV-1a */
+	for (h = 2166136261U; *name != '\0'; name++) {
+		h ^= (uint8_t)*name;
+		h *= 16777619U;
+	}
+	return h & (size - 1);
+}
+
+static size_t
+if_hashindex(unsigned int idx, size_t size)
+{
+
+	return (idx * 0x9e3779b1U) & (size - 1);
+}
+
+void
+if_freehash(struct dhcpcd_ctx *ctx)
+{
+
+	free(ctx->ifaces_name);
+	ctx->ifaces_name = NULL;
+	free(ctx->ifaces_index);
+	ctx->ifaces_index = NULL;
+	ctx->ifaces_hsize = ctx->ifaces_hlen = 0;
+}
+
+static int
+if_hash(struct dhcpcd_ctx *ctx)
+{
+	struct interface *ifp, **b;
+	size_t len, size;
+
+	if (ctx->ifaces_name != NULL)
+		return 0;
+	len = 0;
+	TAILQ_FOREACH(ifp, ctx->ifaces, next)
+		len++;
+	for (size = 16; size < len * 2; size <<= 1)
+		;
+	ctx->ifaces_name = calloc(size, sizeof(*ctx->ifaces_name));
+	ctx->ifaces_index = calloc(size, sizeof(*ctx->ifaces_index));
+	if (ctx->ifaces_name == NULL || ctx->ifaces_index == NULL) {
+		if_freehash(ctx);
+		return -1;
+	}
+	ctx->ifaces_hsize = size;
+	ctx->ifaces_hlen = len;
+
+	/* Push from the tail so each chain is in list order */
+	TAILQ_FOREACH_REVERSE(ifp, ctx->ifaces, if_head, next) {
+		b = &ctx->ifaces_name[if_hashname(ifp->name, size)];
+		ifp->name_hnext = *b;
+		*b = ifp;
+		b = &ctx->ifaces_index[if_hashindex(ifp->index, size)];
+		ifp->index_hnext = *b;
+		*b = ifp;
+	}
+	return 0;
+}
+
+/* Call after adding ifp to the tail of ctx->ifaces.
+ * The hash is built on the first lookup, so until then there is
+ * nothing to do. */
+void
+if_hashadd(struct dhcpcd_ctx *ctx, struct interface *ifp)
+{
+	struct interface **b;
+
+	if (ctx->ifaces_name == NULL)
+		return;
+	if (++ctx->ifaces_hlen * 2 > ctx->ifaces_hsize) {
+		/* Grow on the next lookup */
+		if_freehash(ctx);
+		return;
+	}
+	ifp->name_hnext = ifp->index_hnext = NULL;
+	b = &ctx->ifaces_name[if_hashname(ifp->name, ctx->ifaces_hsize)];
+	while (*b)
+		b = &(*b)->name_hnext;
+	*b = ifp;
+	b = &ctx->ifaces_index[if_hashindex(ifp->index, ctx->ifaces_hsize)];
+	while (*b)
+		b = &(*b)->index_hnext;
+	*b = ifp;
+}
+
+/* Call after removing ifp from ctx->ifaces */
+void
+if_hashdel(struct dhcpcd_ctx *ctx, struct interface *ifp)
+{
+	struct interface **b;
+
+	if (ctx->ifaces_name == NULL)
+		return;
+	b = &ctx->ifaces_name[if_hashname(ifp->name, ctx->ifaces_hsize)];
+	for (; *b; b = &(*b)->name_hnext) {
+		if (*b == ifp) {
+			*b = ifp->name_hnext;
+			ctx->ifaces_hlen--;
+			break;
+		}
+	}
+	b = &ctx->ifaces_index[if_hashindex(ifp->index, ctx->ifaces_hsize)];
+	for (; *b; b = &(*b)->index_hnext) {
+		if (*b == ifp) {
+			*b = ifp->index_hnext;
+			break;
+		}
+	}
+}
+
+#define IF_PFXDLGONLY(ifp)						      \
+	((ifp)->options != NULL &&					      \
+	    (ifp)->options->options & DHCPCD_PFXDLGONLY)
+
 static struct interface *
 if_findindexname(struct dhcpcd_ctx *ctx, unsigned int idx, const char *name)
 {
 	struct interface *ifp;
 
-	if (ctx != NULL && ctx->ifaces != NULL) {
+	if (ctx == NULL || ctx->ifaces == NULL)
+		return NULL;
+
+	if (if_hash(ctx) == -1) {
 		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-			if ((ifp->options == NULL ||
-			    !(ifp->options->options & DHCPCD_PFXDLGONLY)) &&
+			if (!IF_PFXDLGONLY(ifp) &&
 			    ((name && strcmp(ifp->name, name) == 0) ||
 			    (!name && ifp->index == idx)))
 				return ifp;
 		}
+		return NULL;
+	}
+
+	if (name) {
+		ifp = ctx->ifaces_name[if_hashname(name, ctx->ifaces_hsize)];
+		for (; ifp; ifp = ifp->name_hnext) {
+			if (!IF_PFXDLGONLY(ifp) && strcmp(ifp->name, name) == 0)
+				return ifp;
+		}
+	} else {
+		ifp = ctx->ifaces_index[if_hashindex(idx, ctx->ifaces_hsize)];
+		for (; ifp; ifp = ifp->index_hnext) {
+			if (!IF_PFXDLGONLY(ifp) && ifp->index == idx)
+				return ifp;
+		}
 	}
 	return NULL;
 }
@@ -88,6 +88,10 @@ int if_setflag(struct interface *ifp, short flag);
 struct if_head *if_discover(struct dhcpcd_ctx *, int, char * const *);
 struct interface *if_find(struct dhcpcd_ctx *, const char *);
 struct interface *if_findindex(struct dhcpcd_ctx *, unsigned int);
+size_t if_hashname(const char *, size_t);
+void if_hashadd(struct dhcpcd_ctx *, struct interface *);
+void if_hashdel(struct dhcpcd_ctx *, struct interface *);
+void if_freehash(struct dhcpcd_ctx *);
 void if_free(struct interface *);
 int if_domtu(const char *, short int);
 #define if_getmtu(iface) if_domtu(iface, 0)
@@ -97,11 +101,46 @@ int if_carrier(struct interface *);
 /* The below functions are provided by if-KERNEL.c */
 int if_conf(struct interface *);
 int if_init(struct interface *);
+#ifdef __linux__
+/* Linux discovers interfaces with one netlink dump for links and one
+ * for addresses. The list is used like getifaddrs(3) and ifa_data
+ * points to a struct if_nlinfo. */
+struct ifaddrs;
+struct if_nlinfo {
+	unsigned int index;
+	unsigned int mtu;
+	int promote;		/* promote_secondaries, -1 if unknown */
+	int addrflags;		/* IPv6 address flags */
+	uint8_t hwlen;		/* all of IFLA_ADDRESS, as /sys has it */
+	unsigned char hwaddr[HWADDR_LEN];
+};
+int if_getifaddrs(struct dhcpcd_ctx *, struct ifaddrs **);
+void if_freeifaddrs(struct ifaddrs *);
+int if_initnl(struct interface *, const struct if_nlinfo *);
+#endif
 int if_getssid(struct interface *);
 int if_vimaster(const char *);
 int if_openlinksocket(void);
 int if_managelink(struct dhcpcd_ctx *);
 
+/* Route and address changes made between if_batch_begin and
+ * if_batch_commit may be queued and sent to the kernel together.
+ * A queued change reports success; the real result is passed to the
+ * callback set by if_batch_callback, along with a copy of the data
+ * given, once the kernel has acknowledged it. */
+#ifdef __linux__
+void if_batch_begin(struct dhcpcd_ctx *);
+void if_batch_callback(struct dhcpcd_ctx *,
+    void (*)(struct dhcpcd_ctx *, void *, int), const void *, size_t);
+void if_batch_commit(struct dhcpcd_ctx *);
+void if_batch_free(struct dhcpcd_ctx *);
+#else
+#define if_batch_begin(ctx) do { } while (0 /* CONSTCOND */)
+#define if_batch_callback(ctx, cb, data, len) do { } while (0 /* CONSTCOND */)
+#define if_batch_commit(ctx) do { } while (0 /* CONSTCOND */)
+#define if_batch_free(ctx) do { } while (0 /* CONSTCOND */)
+#endif
+
 #ifdef INET
 int if_openrawsocket(struct interface *, int);
 ssize_t if_sendrawpacket(const struct interface *,
@@ -120,6 +159,10 @@ int if_route(const struct rt *rt, int);
 #define if_addroute(rt) if_route(rt, 1)
 #define if_chgroute(rt) if_route(rt, 0)
 #define if_delroute(rt) if_route(rt, -1)
+
+/* Load the kernel routes on our interfaces at their metric into
+ * ctx->ipv4_kroutes. */
+int if_initrt(struct dhcpcd_ctx *);
 #endif
 
 #ifdef INET6
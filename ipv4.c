@@ -44,6 +44,7 @@
 #include "common.h"
 #include "dhcpcd.h"
 #include "dhcp.h"
+#include "eloop.h"
 #include "if.h"
 #include "if-options.h"
 #include "ipv4.h"
@@ -177,34 +178,27 @@ ipv4_addrexists(struct dhcpcd_ctx *ctx, const struct in_addr *addr)
 	return 0;
 }
 
-void
-ipv4_freeroutes(struct rt_head *rts)
+static void
+ipv4_freeroutes1(struct rt_head *rts)
 {
 	struct rt *r;
 
-	if (rts) {
-		while ((r = TAILQ_FIRST(rts))) {
-			TAILQ_REMOVE(rts, r, next);
-			free(r);
-		}
-		free(rts);
+	while ((r = TAILQ_FIRST(rts))) {
+		TAILQ_REMOVE(rts, r, next);
+		free(r);
 	}
 }
 
-int
-ipv4_init(struct dhcpcd_ctx *ctx)
+void
+ipv4_freeroutes(struct rt_head *rts)
 {
 
-	if (ctx->ipv4_routes == NULL) {
-		ctx->ipv4_routes = malloc(sizeof(*ctx->ipv4_routes));
-		if (ctx->ipv4_routes == NULL)
-			return -1;
-		TAILQ_INIT(ctx->ipv4_routes);
+	if (rts) {
+		ipv4_freeroutes1(rts);
+		free(rts);
 	}
-	return 0;
 }
 
-
 /* Interface comparer for working out ordering. */
 static int
 ipv4_ifcmp(const struct interface *si, const struct interface *ti)
@@ -280,28 +274,194 @@ ipv4_sortinterfaces(struct dhcpcd_ctx *ctx)
 			TAILQ_INSERT_TAIL(&sorted, ifp, next);
 	}
 	TAILQ_CONCAT(ctx->ifaces, &sorted, next);
+	if_freehash(ctx);
 }
 
-static struct rt *
-find_route(struct rt_head *rts, const struct rt *r, const struct rt *srt)
+/* Move one interface to its place in the preferred order.
+ * The others are already in order, so unless it is out of order with
+ * its neighbours it stays where it is. */
+static void
+ipv4_sortinterface(struct interface *ifp)
 {
-	struct rt *rt;
+	struct if_head *ifaces;
+	struct interface *ift;
+
+	ifaces = ifp->ctx->ifaces;
+	if (((ift = TAILQ_PREV(ifp, if_head, next)) == NULL ||
+	    ipv4_ifcmp(ift, ifp) != 1) &&
+	    ((ift = TAILQ_NEXT(ifp, next)) == NULL ||
+	    ipv4_ifcmp(ifp, ift) != 1))
+		return;
+	TAILQ_REMOVE(ifaces, ifp, next);
+	if_freehash(ifp->ctx);
+	TAILQ_FOREACH(ift, ifaces, next) {
+		if (ipv4_ifcmp(ifp, ift) == -1) {
+			TAILQ_INSERT_BEFORE(ift, ifp, next);
+			return;
+		}
+	}
+	TAILQ_INSERT_TAIL(ifaces, ifp, next);
+}
 
-	if (rts == NULL)
-		return NULL;
-	TAILQ_FOREACH(rt, rts, next) {
-		if (rt->dest.s_addr == r->dest.s_addr &&
+/* Our routes, the routes each interface wants and our copy of the
+ * kernel table are hashed on dest, net and metric so a route to a
+ * destination is found without walking any of them. */
+struct rt_hash {
+	struct rt **buckets;
+	size_t size;
+	size_t len;
+};
+
+#if HAVE_ROUTE_METRIC
+#define RT_SAMEDEST(a, b)						      \
+	((a)->dest.s_addr == (b)->dest.s_addr &&			      \
+	    (a)->net.s_addr == (b)->net.s_addr &&			      \
+	    (a)->metric == (b)->metric)
+#else
+#define RT_SAMEDEST(a, b)						      \
+	((a)->dest.s_addr == (b)->dest.s_addr &&			      \
+	    (a)->net.s_addr == (b)->net.s_addr)
+#endif
+
+static size_t
+rt_hashkey(const struct rt *rt, size_t size)
+{
+	uint32_t k;
+
+	k = rt->dest.s_addr ^ (rt->net.s_addr * 0x9e3779b1U);
 #if HAVE_ROUTE_METRIC
-		    (srt || (!rt->iface ||
-			rt->iface->metric == r->iface->metric)) &&
+	k ^= rt->metric * 0x85ebca6bU;
 #endif
-                    (!srt || srt != rt) &&
-		    rt->net.s_addr == r->net.s_addr)
+	k ^= k >> 16;
+	k *= 0x7feb352dU;
+	k ^= k >> 15;
+	return k & (size - 1);
+}
+
+static struct rt_hash *
+rt_hash_new(size_t len)
+{
+	struct rt_hash *h;
+
+	if ((h = malloc(sizeof(*h))) == NULL)
+		return NULL;
+	for (h->size = 16; h->size < len * 2; h->size <<= 1)
+		;
+	if ((h->buckets = calloc(h->size, sizeof(*h->buckets))) == NULL) {
+		free(h);
+		return NULL;
+	}
+	h->len = 0;
+	return h;
+}
+
+static void
+rt_hash_free(struct rt_hash *h)
+{
+
+	if (h) {
+		free(h->buckets);
+		free(h);
+	}
+}
+
+static void
+rt_hash_add(struct rt_hash *h, struct rt *rt)
+{
+	struct rt **nb, **b, *r, *rn;
+	size_t i, size;
+
+	/* Keep chains short, but carry on if we cannot grow */
+	if (h->len >= h->size) {
+		size = h->size << 1;
+		if ((nb = calloc(size, sizeof(*nb))) != NULL) {
+			for (i = 0; i < h->size; i++) {
+				for (r = h->buckets[i]; r; r = rn) {
+					rn = r->hnext;
+					b = &nb[rt_hashkey(r, size)];
+					r->hnext = *b;
+					*b = r;
+				}
+			}
+			free(h->buckets);
+			h->buckets = nb;
+			h->size = size;
+		}
+	}
+	b = &h->buckets[rt_hashkey(rt, h->size)];
+	rt->hnext = *b;
+	*b = rt;
+	h->len++;
+}
+
+static void
+rt_hash_del(struct rt_hash *h, struct rt *rt)
+{
+	struct rt **r;
+
+	for (r = &h->buckets[rt_hashkey(rt, h->size)]; *r; r = &(*r)->hnext) {
+		if (*r == rt) {
+			*r = rt->hnext;
+			h->len--;
+			return;
+		}
+	}
+}
+
+static struct rt *
+rt_hash_find(const struct rt_hash *h, const struct rt *r)
+{
+	struct rt *rt;
+
+	for (rt = h->buckets[rt_hashkey(r, h->size)]; rt; rt = rt->hnext) {
+		if (RT_SAMEDEST(rt, r))
 			return rt;
 	}
 	return NULL;
 }
 
+static void
+ipv4_freekroutes(struct dhcpcd_ctx *ctx)
+{
+
+	ipv4_freeroutes(ctx->ipv4_kroutes);
+	ctx->ipv4_kroutes = NULL;
+	rt_hash_free(ctx->ipv4_khash);
+	ctx->ipv4_khash = NULL;
+}
+
+void
+ipv4_ctxfree(struct dhcpcd_ctx *ctx)
+{
+
+	ipv4_freeroutes(ctx->ipv4_routes);
+	ctx->ipv4_routes = NULL;
+	rt_hash_free(ctx->ipv4_rhash);
+	ctx->ipv4_rhash = NULL;
+	rt_hash_free(ctx->ipv4_whash);
+	ctx->ipv4_whash = NULL;
+	ipv4_freekroutes(ctx);
+}
+
+int
+ipv4_init(struct dhcpcd_ctx *ctx)
+{
+
+	if (ctx->ipv4_routes == NULL) {
+		if ((ctx->ipv4_rhash = rt_hash_new(0)) == NULL ||
+		    (ctx->ipv4_whash = rt_hash_new(0)) == NULL ||
+		    (ctx->ipv4_routes = malloc(sizeof(*ctx->ipv4_routes)))
+		    == NULL)
+		{
+			ipv4_ctxfree(ctx);
+			return -1;
+		}
+		TAILQ_INIT(ctx->ipv4_routes);
+		ctx->ipv4_kload = 1;
+	}
+	return 0;
+}
+
 static void
 desc_route(const char *cmd, const struct rt *rt)
 {
@@ -328,6 +488,92 @@ desc_route(const char *cmd, const struct rt *rt)
 		    addr, inet_ntocidr(rt->net), inet_ntoa(rt->gate));
 }
 
+#define RT_SAMEPATH(a, b)						      \
+	((a)->iface == (b)->iface && (a)->gate.s_addr == (b)->gate.s_addr)
+
+/* Note a route the kernel now has in our copy of its table */
+static void
+ipv4_kadd(struct dhcpcd_ctx *ctx, const struct rt *rt)
+{
+	struct rt *krt;
+
+	if (ctx->ipv4_kroutes == NULL)
+		return;
+	krt = rt_hash_find(ctx->ipv4_khash, rt);
+	if (krt == NULL) {
+		if ((krt = malloc(sizeof(*krt))) == NULL) {
+			/* Read it again rather than have it wrong */
+			syslog(LOG_ERR, "%s: %m", __func__);
+			ipv4_freekroutes(ctx);
+			ctx->ipv4_kload = 1;
+			return;
+		}
+		krt->dest = rt->dest;
+		krt->net = rt->net;
+		krt->metric = rt->metric;
+		TAILQ_INSERT_TAIL(ctx->ipv4_kroutes, krt, next);
+		rt_hash_add(ctx->ipv4_khash, krt);
+	}
+	krt->gate = rt->gate;
+	krt->iface = rt->iface;
+	krt->metric = rt->metric;
+	krt->src = rt->src;
+	krt->flags = 0;
+}
+
+/* Note a route the kernel no longer has in our copy of its table */
+static void
+ipv4_kdel(struct dhcpcd_ctx *ctx, const struct rt *rt)
+{
+	struct rt *krt;
+
+	if (ctx->ipv4_kroutes == NULL || rt->iface == NULL)
+		return;
+	krt = rt_hash_find(ctx->ipv4_khash, rt);
+	if (krt == NULL || !RT_SAMEPATH(krt, rt))
+		return;
+	rt_hash_del(ctx->ipv4_khash, krt);
+	TAILQ_REMOVE(ctx->ipv4_kroutes, krt, next);
+	free(krt);
+}
+
+/* Forget the routes on an interface which is going away */
+static void
+ipv4_kdelif(const struct interface *ifp)
+{
+	struct dhcpcd_ctx *ctx;
+	struct rt *krt, *krtn;
+
+	ctx = ifp->ctx;
+	if (ctx->ipv4_kroutes == NULL)
+		return;
+	TAILQ_FOREACH_SAFE(krt, ctx->ipv4_kroutes, next, krtn) {
+		if (krt->iface == ifp) {
+			rt_hash_del(ctx->ipv4_khash, krt);
+			TAILQ_REMOVE(ctx->ipv4_kroutes, krt, next);
+			free(krt);
+		}
+	}
+}
+
+/* Stop managing a route without touching the kernel */
+static void
+ipv4_forgetroute(struct dhcpcd_ctx *ctx, struct rt *rt)
+{
+
+	rt_hash_del(ctx->ipv4_rhash, rt);
+	TAILQ_REMOVE(ctx->ipv4_routes, rt, next);
+	free(rt);
+}
+
+/* Something other than dhcpcd added a route */
+void
+ipv4_routeadded(struct dhcpcd_ctx *ctx, const struct rt *rt)
+{
+
+	ipv4_kadd(ctx, rt);
+}
+
 /* If something other than dhcpcd removes a route,
  * we need to remove it from our internal table. */
 int
@@ -335,12 +581,12 @@ ipv4_routedeleted(struct dhcpcd_ctx *ctx, const struct rt *rt)
 {
 	struct rt *f;
 
-	f = find_route(ctx->ipv4_routes, rt, NULL);
-	if (f == NULL)
+	ipv4_kdel(ctx, rt);
+	if (ctx->ipv4_routes == NULL ||
+	    (f = rt_hash_find(ctx->ipv4_rhash, rt)) == NULL)
 		return 0;
 	desc_route("removing", f);
-	TAILQ_REMOVE(ctx->ipv4_routes, f, next);
-	free(f);
+	ipv4_forgetroute(ctx, f);
 	return 1;
 }
 
@@ -360,15 +606,81 @@ nc_route(int add, struct rt *ort, struct rt *nrt)
 	/* We delete and add the route so that we can change metric and
 	 * prefer the interface.
 	 * This also has the nice side effect of flushing ARP entries so
-	 * we don't have to do that manually. */
-	if (if_delroute(ort) == -1 && errno != ESRCH)
+	 * we don't have to do that manually.
+	 * There is nothing to delete if we know the kernel lacks it. */
+	if (ort != NULL && if_delroute(ort) == -1 && errno != ESRCH)
 		syslog(LOG_ERR, "%s: ipv4_delroute: %m", ort->iface->name);
-	if (!if_addroute(nrt))
+	if (!if_addroute(nrt)) {
+		ipv4_kadd(nrt->iface->ctx, nrt);
 		return 0;
+	}
 	syslog(LOG_ERR, "%s: if_addroute: %m", nrt->iface->name);
+	if (ort != NULL)
+		ipv4_kdel(nrt->iface->ctx, ort);
 	return -1;
 }
 
+static void
+ipv4_resync(void *arg)
+{
+
+	ipv4_syncroutes(arg);
+}
+
+/* Forget a batched route the kernel refused to add.
+ * The table may have been rebuilt since, so match on a copy. */
+static void
+nc_route_done(struct dhcpcd_ctx *ctx, void *arg, int error)
+{
+	const struct rt *r;
+	struct rt *rt;
+
+	if (error == 0 || ctx->ipv4_routes == NULL)
+		return;
+	r = arg;
+	/* The kernel may have added the route without telling us,
+	 * so read its table again and restore the route if not.
+	 * Once for all the requests which timed out together. */
+	if (error == ETIMEDOUT) {
+		ctx->ipv4_kload = 1;
+		eloop_timeout_add_sec(ctx->eloop, 0, ipv4_resync, ctx);
+		return;
+	}
+	/* The kernel table was wrong if it already had the route */
+	if (error == EEXIST)
+		ctx->ipv4_kload = 1;
+	else
+		ipv4_kdel(ctx, r);
+	errno = error;
+	if ((rt = rt_hash_find(ctx->ipv4_rhash, r)) != NULL &&
+	    RT_SAMEPATH(rt, r))
+	{
+		syslog(LOG_ERR, "%s: if_addroute: %m", rt->iface->name);
+		ipv4_forgetroute(ctx, rt);
+		return;
+	}
+	syslog(LOG_ERR, "if_addroute: %m");
+}
+
+/* Add a route that is not in our table.
+ * With a copy of the kernel table only the difference is sent: nothing if
+ * the kernel already has the route, a change if it has the route via
+ * another gateway or interface, otherwise an add without the delete.
+ * Returns 1 if the kernel already has the route. */
+static int
+k_route(struct dhcpcd_ctx *ctx, struct rt *rt)
+{
+	struct rt *krt;
+
+	if (ctx->ipv4_kroutes == NULL)
+		return n_route(rt);
+	if ((krt = rt_hash_find(ctx->ipv4_khash, rt)) == NULL)
+		return nc_route(1, NULL, rt);
+	if (RT_SAMEPATH(krt, rt))
+		return 1;
+	return c_route(krt, rt);
+}
+
 static int
 d_route(struct rt *rt)
 {
@@ -378,6 +690,8 @@ d_route(struct rt *rt)
 	retval = if_delroute(rt);
 	if (retval != 0 && errno != ENOENT && errno != ESRCH)
 		syslog(LOG_ERR,"%s: if_delroute: %m", rt->iface->name);
+	else
+		ipv4_kdel(rt->iface->ctx, rt);
 	return retval;
 }
 
@@ -584,83 +898,367 @@ add_router_host_route(struct rt_head *rt, const struct interface *ifp)
 	return rt;
 }
 
-void
-ipv4_buildroutes(struct dhcpcd_ctx *ctx)
+static struct ipv4_state *
+ipv4_getstate(struct interface *ifp)
 {
-	struct rt_head *nrs, *dnr;
-	struct rt *or, *rt, *rtn;
-	struct interface *ifp;
+	struct ipv4_state *state;
+
+	state = IPV4_STATE(ifp);
+	if (state == NULL) {
+	        ifp->if_data[IF_DATA_IPV4] = malloc(sizeof(*state));
+		state = IPV4_STATE(ifp);
+		if (state == NULL) {
+			syslog(LOG_ERR, "%s: %m", __func__);
+			return NULL;
+		}
+		TAILQ_INIT(&state->addrs);
+		TAILQ_INIT(&state->routes);
+	}
+	return state;
+}
+
+/* Find a route to the destination of r which an interface wants.
+ * If ifp is NULL any interface will do. */
+static struct rt *
+ipv4_findwant(struct dhcpcd_ctx *ctx, const struct rt *r,
+    const struct interface *ifp)
+{
+	struct rt *rt;
+
+	rt = ctx->ipv4_whash->buckets[rt_hashkey(r, ctx->ipv4_whash->size)];
+	for (; rt; rt = rt->hnext) {
+		if (RT_SAMEDEST(rt, r) && (ifp == NULL || rt->iface == ifp))
+			return rt;
+	}
+	return NULL;
+}
+
+/* Work out the routes an interface wants from its lease.
+ * They replace the routes it wanted before, which are moved to old so
+ * the caller can work out where those destinations go now.
+ * Nothing is cached against the lease, the routes are only worked out
+ * again when the interface changes. */
+static void
+ipv4_ifwants(struct interface *ifp, struct rt_head *old)
+{
+	struct dhcpcd_ctx *ctx;
 	const struct dhcp_state *state;
+	struct ipv4_state *istate;
+	struct rt_head *dnr;
+	struct rt *rt;
 
-	nrs = malloc(sizeof(*nrs));
-	if (nrs == NULL) {
-		syslog(LOG_ERR, "%s: %m", __func__);
-		return;
+	ctx = ifp->ctx;
+	if ((istate = IPV4_STATE(ifp)) != NULL) {
+		TAILQ_FOREACH(rt, &istate->routes, next)
+			rt_hash_del(ctx->ipv4_whash, rt);
+		TAILQ_CONCAT(old, &istate->routes, next);
 	}
-	TAILQ_INIT(nrs);
-	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-		state = D_CSTATE(ifp);
-		if (state == NULL || state->new == NULL || !state->added)
-			continue;
-		dnr = get_routes(ifp);
-		dnr = massage_host_routes(dnr, ifp);
-		dnr = add_subnet_route(dnr, ifp);
+	state = D_CSTATE(ifp);
+	if (state == NULL || state->new == NULL || !state->added)
+		return;
+	if (istate == NULL && (istate = ipv4_getstate(ifp)) == NULL)
+		return;
+
+	dnr = get_routes(ifp);
+	dnr = massage_host_routes(dnr, ifp);
+	dnr = add_subnet_route(dnr, ifp);
 #ifdef IPV4_LOOPBACK_ROUTE
-		dnr = add_loopback_route(dnr, ifp);
+	dnr = add_loopback_route(dnr, ifp);
 #endif
-		if (ifp->options->options & DHCPCD_GATEWAY) {
-			dnr = add_router_host_route(dnr, ifp);
-			dnr = add_destination_route(dnr, ifp);
-		}
-		if (dnr == NULL) /* failed to malloc all new routes */
+	if (ifp->options->options & DHCPCD_GATEWAY) {
+		dnr = add_router_host_route(dnr, ifp);
+		dnr = add_destination_route(dnr, ifp);
+	}
+	if (dnr == NULL) /* failed to malloc all new routes */
+		return;
+
+	while ((rt = TAILQ_FIRST(dnr))) {
+		TAILQ_REMOVE(dnr, rt, next);
+		rt->iface = ifp;
+		rt->metric = ifp->metric;
+		rt->src.s_addr = state->addr.s_addr;
+		rt->flags = 0;
+		/* Default routes need the gateway option and only the
+		 * first route to a destination counts */
+		if ((rt->dest.s_addr == INADDR_ANY &&
+		    rt->net.s_addr == INADDR_ANY &&
+		    !(ifp->options->options & DHCPCD_GATEWAY)) ||
+		    ipv4_findwant(ctx, rt, ifp) != NULL)
+		{
+			free(rt);
 			continue;
-		TAILQ_FOREACH_SAFE(rt, dnr, next, rtn) {
-			rt->iface = ifp;
-			rt->metric = ifp->metric;
-			/* Is this route already in our table? */
-			if ((find_route(nrs, rt, NULL)) != NULL)
-				continue;
-			rt->src.s_addr = state->addr.s_addr;
-			/* Do we already manage it? */
-			if ((or = find_route(ctx->ipv4_routes, rt, NULL))) {
-				if (state->added & STATE_FAKE)
-					continue;
-				if (or->flags & STATE_FAKE ||
-				    or->iface != ifp ||
-				    or->src.s_addr != state->addr.s_addr ||
-				    rt->gate.s_addr != or->gate.s_addr ||
-				    rt->metric != or->metric)
-				{
-					if (c_route(or, rt) != 0)
-						continue;
-				}
-				TAILQ_REMOVE(ctx->ipv4_routes, or, next);
-				free(or);
-			} else {
-				if (!(state->added & STATE_FAKE) &&
-				    n_route(rt) != 0)
-					continue;
+		}
+		TAILQ_INSERT_TAIL(&istate->routes, rt, next);
+		rt_hash_add(ctx->ipv4_whash, rt);
+	}
+	free(dnr);
+}
+
+static int
+ipv4_isfake(const struct interface *ifp)
+{
+	const struct dhcp_state *state;
+
+	state = D_CSTATE(ifp);
+	return state != NULL && state->added & STATE_FAKE;
+}
+
+/* Which of two interfaces wanting a route to the same destination
+ * gets it. A proper lease beats a fake one, then the interfaces are
+ * compared as when sorting them. On a tie the route stays put. */
+static int
+ipv4_wantcmp(const struct rt *a, const struct rt *b, const struct rt *or)
+{
+	int fa, fb, r;
+
+	fa = ipv4_isfake(a->iface);
+	fb = ipv4_isfake(b->iface);
+	if (fa != fb)
+		return fa ? 1 : -1;
+	if ((r = ipv4_ifcmp(a->iface, b->iface)) != 0)
+		return r;
+	if (or != NULL) {
+		if (a->iface == or->iface)
+			return -1;
+		if (b->iface == or->iface)
+			return 1;
+	}
+	return 0;
+}
+
+/* Stop managing a route, deleting it from the kernel unless the
+ * interface keeps its routes on exit or the kernel has lost it. */
+static void
+ipv4_unroute(struct dhcpcd_ctx *ctx, struct rt *rt)
+{
+	struct rt *krt;
+
+	if ((rt->iface->options->options &
+	    (DHCPCD_EXITING | DHCPCD_PERSISTENT)) !=
+	    (DHCPCD_EXITING | DHCPCD_PERSISTENT) &&
+	    (ctx->ipv4_kroutes == NULL ||
+	    /* Our copy only has routes at the interface metric */
+	    rt->metric != rt->iface->metric ||
+	    ((krt = rt_hash_find(ctx->ipv4_khash, rt)) != NULL &&
+	    RT_SAMEPATH(krt, rt))))
+		d_route(rt);
+	ipv4_forgetroute(ctx, rt);
+}
+
+/* Give the route to the destination of dest to the interface which
+ * should have it now, only telling the kernel what has changed. */
+static void
+ipv4_resolve(struct dhcpcd_ctx *ctx, const struct rt *dest)
+{
+	struct rt *or, *best, *rt;
+	int r;
+
+	or = rt_hash_find(ctx->ipv4_rhash, dest);
+	best = NULL;
+	rt = ctx->ipv4_whash->buckets[rt_hashkey(dest, ctx->ipv4_whash->size)];
+	for (; rt; rt = rt->hnext) {
+		if (RT_SAMEDEST(rt, dest) &&
+		    (best == NULL || ipv4_wantcmp(rt, best, or) == -1))
+			best = rt;
+	}
+	if (best == NULL) {
+		if (or != NULL)
+			ipv4_unroute(ctx, or);
+		return;
+	}
+
+	/* A fake lease only records routes nobody else has,
+	 * so they are removed with it */
+	if (ipv4_isfake(best->iface)) {
+		if (or == NULL) {
+			if ((rt = malloc(sizeof(*rt))) == NULL) {
+				syslog(LOG_ERR, "%s: %m", __func__);
+				return;
 			}
-			rt->flags = STATE_ADDED;
-			if (state->added & STATE_FAKE)
-				rt->flags |= STATE_FAKE;
-			TAILQ_REMOVE(dnr, rt, next);
-			TAILQ_INSERT_TAIL(nrs, rt, next);
+			*rt = *best;
+			rt->flags = STATE_ADDED | STATE_FAKE;
+			TAILQ_INSERT_TAIL(ctx->ipv4_routes, rt, next);
+			rt_hash_add(ctx->ipv4_rhash, rt);
+		} else if (or->flags & STATE_FAKE) {
+			or->iface = best->iface;
+			or->gate = best->gate;
+			or->src = best->src;
+		} else
+			ipv4_unroute(ctx, or);
+		return;
+	}
+
+	if (or != NULL && !(or->flags & STATE_FAKE) &&
+	    or->iface == best->iface &&
+	    or->src.s_addr == best->src.s_addr &&
+	    or->gate.s_addr == best->gate.s_addr &&
+	    or->metric == best->metric)
+		return;
+	if ((rt = malloc(sizeof(*rt))) == NULL) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		if (or != NULL)
+			ipv4_unroute(ctx, or);
+		return;
+	}
+	*rt = *best;
+	if (or != NULL)
+		r = c_route(or, rt);
+	else
+		r = k_route(ctx, rt);
+	if (r == -1) {
+		free(rt);
+		if (or != NULL)
+			ipv4_unroute(ctx, or);
+		return;
+	}
+	if (r == 0)
+		if_batch_callback(ctx, nc_route_done, rt, sizeof(*rt));
+	if (or != NULL)
+		ipv4_forgetroute(ctx, or);
+	rt->flags = STATE_ADDED;
+	TAILQ_INSERT_TAIL(ctx->ipv4_routes, rt, next);
+	rt_hash_add(ctx->ipv4_rhash, rt);
+}
+
+/* Read the kernel routing table into ctx->ipv4_kroutes and index it.
+ * If it cannot be read, routes are changed without checking it first. */
+static struct rt_head *
+ipv4_loadkroutes(struct dhcpcd_ctx *ctx)
+{
+	struct rt *rt;
+	size_t len;
+
+	ctx->ipv4_kload = 0;
+	ipv4_freekroutes(ctx);
+	ctx->ipv4_kroutes = malloc(sizeof(*ctx->ipv4_kroutes));
+	if (ctx->ipv4_kroutes == NULL) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		goto err;
+	}
+	TAILQ_INIT(ctx->ipv4_kroutes);
+	if (if_initrt(ctx) == -1) {
+		if (errno == ENOTSUP) {
+			ipv4_freekroutes(ctx);
+			return NULL;
 		}
-		ipv4_freeroutes(dnr);
+		syslog(LOG_ERR, "if_initrt: %m");
+		goto err;
 	}
+	len = 0;
+	TAILQ_FOREACH(rt, ctx->ipv4_kroutes, next)
+		len++;
+	if ((ctx->ipv4_khash = rt_hash_new(len)) == NULL) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		goto err;
+	}
+	TAILQ_FOREACH(rt, ctx->ipv4_kroutes, next)
+		rt_hash_add(ctx->ipv4_khash, rt);
+	return ctx->ipv4_kroutes;
+
+err:
+	/* Try again next time */
+	ipv4_freekroutes(ctx);
+	ctx->ipv4_kload = 1;
+	return NULL;
+}
 
-	/* Remove old routes we used to manage */
-	TAILQ_FOREACH(rt, ctx->ipv4_routes, next) {
-		if (find_route(nrs, rt, NULL) == NULL &&
-		    (rt->iface->options->options &
-		    (DHCPCD_EXITING | DHCPCD_PERSISTENT)) !=
-		    (DHCPCD_EXITING | DHCPCD_PERSISTENT))
-			d_route(rt);
+/* Work out the routes of every interface again.
+ * The kernel table is read by the first build, so a restart adopts the
+ * routes it left behind, and then kept by our own changes and the
+ * routing socket.
+ * If sync is set it is read again and routes we think we have
+ * are restored if something else removed or changed them. */
+static void
+ipv4_buildroutes1(struct dhcpcd_ctx *ctx, int sync)
+{
+	struct rt_head old;
+	struct rt *rt, *rtn;
+	struct interface *ifp;
+	struct ipv4_state *istate;
+	int r;
+
+	if (ctx->ipv4_routes == NULL)
+		return;
+	if ((sync || ctx->ipv4_kload) && ipv4_loadkroutes(ctx) == NULL)
+		sync = 0;
+	if_batch_begin(ctx);
+	TAILQ_INIT(&old);
+	TAILQ_FOREACH(ifp, ctx->ifaces, next)
+		ipv4_ifwants(ifp, &old);
+	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+		if ((istate = IPV4_STATE(ifp)) == NULL)
+			continue;
+		TAILQ_FOREACH(rt, &istate->routes, next)
+			ipv4_resolve(ctx, rt);
 	}
-	ipv4_freeroutes(ctx->ipv4_routes);
+	ipv4_freeroutes1(&old);
+
+	/* Remove old routes nobody wants */
+	TAILQ_FOREACH_SAFE(rt, ctx->ipv4_routes, next, rtn) {
+		if (ipv4_findwant(ctx, rt, NULL) == NULL)
+			ipv4_unroute(ctx, rt);
+	}
+
+	if (sync) {
+		TAILQ_FOREACH_SAFE(rt, ctx->ipv4_routes, next, rtn) {
+			if (rt->flags & STATE_FAKE ||
+			    (r = k_route(ctx, rt)) == 1)
+				continue;
+			if (r == 0)
+				if_batch_callback(ctx, nc_route_done,
+				    rt, sizeof(*rt));
+			else
+				ipv4_unroute(ctx, rt);
+		}
+	}
+	if_batch_commit(ctx);
+}
+
+/* A global rebuild, for when interface metrics or order change. */
+void
+ipv4_buildroutes(struct dhcpcd_ctx *ctx)
+{
+
+	ipv4_buildroutes1(ctx, 0);
+}
+
+/* A global rebuild which reconciles our routes with the kernel table. */
+void
+ipv4_syncroutes(struct dhcpcd_ctx *ctx)
+{
+
+	ipv4_buildroutes1(ctx, 1);
+}
 
-	ctx->ipv4_routes = nrs;
+/* Rebuild routes after the lease or address of one interface changed.
+ * Only the destinations it wants now or wanted before are looked at,
+ * the routes of other interfaces are left as they are. */
+void
+ipv4_buildifroutes(struct interface *ifp)
+{
+	struct dhcpcd_ctx *ctx;
+	struct rt_head old;
+	struct ipv4_state *istate;
+	struct rt *rt;
+
+	ctx = ifp->ctx;
+	if (ctx->ipv4_routes == NULL)
+		return;
+	/* The lease may have changed where it sorts */
+	ipv4_sortinterface(ifp);
+	if (ctx->ipv4_kload)
+		ipv4_loadkroutes(ctx);
+	if_batch_begin(ctx);
+	TAILQ_INIT(&old);
+	ipv4_ifwants(ifp, &old);
+	if ((istate = IPV4_STATE(ifp)) != NULL) {
+		TAILQ_FOREACH(rt, &istate->routes, next)
+			ipv4_resolve(ctx, rt);
+	}
+	TAILQ_FOREACH(rt, &old, next)
+		ipv4_resolve(ctx, rt);
+	ipv4_freeroutes1(&old);
+	if_batch_commit(ctx);
 }
 
 static int
@@ -710,24 +1308,6 @@ delete_address(struct interface *ifp)
 	return r;
 }
 
-static struct ipv4_state *
-ipv4_getstate(struct interface *ifp)
-{
-	struct ipv4_state *state;
-
-	state = IPV4_STATE(ifp);
-	if (state == NULL) {
-	        ifp->if_data[IF_DATA_IPV4] = malloc(sizeof(*state));
-		state = IPV4_STATE(ifp);
-		if (state == NULL) {
-			syslog(LOG_ERR, "%s: %m", __func__);
-			return NULL;
-		}
-		TAILQ_INIT(&state->addrs);
-	}
-	return state;
-}
-
 static int
 ipv4_addaddr(struct interface *ifp, const struct dhcp_lease *lease)
 {
@@ -764,11 +1344,7 @@ ipv4_applyaddr(void *arg)
 	struct ipv4_addr *ap;
 	struct ipv4_state *istate;
 	struct rt *rt;
-	int r;
-
-	/* As we are now adjusting an interface, we need to ensure
-	 * we have them in the right order for routing and configuration. */
-	ipv4_sortinterfaces(ifp->ctx);
+	int r, held;
 
 	if (state == NULL)
 		return;
@@ -801,20 +1377,29 @@ ipv4_applyaddr(void *arg)
 							    &nstate->lease);
 							nstate->added =
 							    STATE_ADDED;
+							ipv4_buildifroutes(ifn);
 						}
 						break;
 					}
 				}
 			}
-			ipv4_buildroutes(ifp->ctx);
+			ipv4_buildifroutes(ifp);
 			script_runreason(ifp, state->reason);
 		} else
-			ipv4_buildroutes(ifp->ctx);
+			ipv4_buildifroutes(ifp);
 		return;
 	}
 
-	/* Ensure only one interface has the address */
-	TAILQ_FOREACH(ifn, ifp->ctx->ifaces, next) {
+	/* Ensure only one interface has the address.
+	 * If we already have it, as on a renewal, that was done when it was
+	 * added and any other interface wanting it since has deferred to us
+	 * or taken it, so there is no need to look at every interface. */
+	held = state->added & STATE_ADDED &&
+	    state->addr.s_addr == lease->addr.s_addr;
+	for (ifn = held ? NULL : TAILQ_FIRST(ifp->ctx->ifaces);
+	    ifn != NULL;
+	    ifn = TAILQ_NEXT(ifn, next))
+	{
 		if (ifn == ifp || strcmp(ifn->name, ifp->name) == 0)
 			continue;
 		nstate = D_STATE(ifn);
@@ -836,12 +1421,13 @@ ipv4_applyaddr(void *arg)
 			    ifp->name);
 			delete_address1(ifn, &nstate->addr, &nstate->net);
 			nstate->added = 0;
+			ipv4_buildifroutes(ifn);
 			break;
 		}
 	}
 
 	/* Does another interface already have the address from a prior boot? */
-	if (ifn == NULL) {
+	if (!held && ifn == NULL) {
 		TAILQ_FOREACH(ifn, ifp->ctx->ifaces, next) {
 			if (ifn == ifp || strcmp(ifn->name, ifp->name) == 0)
 				continue;
@@ -888,14 +1474,16 @@ ipv4_applyaddr(void *arg)
 	rt = get_subnet_route(ifp->ctx, dhcp);
 	if (rt != NULL) {
 		rt->iface = ifp;
-		rt->metric = 0;
-		if (!find_route(ifp->ctx->ipv4_routes, rt, NULL))
+		rt->metric = ifp->metric;
+		if (rt_hash_find(ifp->ctx->ipv4_rhash, rt) == NULL) {
+			rt->metric = 0;
 			if_delroute(rt);
+		}
 		free(rt);
 	}
 
 routes:
-	ipv4_buildroutes(ifp->ctx);
+	ipv4_buildifroutes(ifp);
 	script_runreason(ifp, state->reason);
 }
 
@@ -958,6 +1546,28 @@ ipv4_handleifa(struct dhcpcd_ctx *ctx,
 	dhcp_handleifa(type, ifp, addr, net, dst);
 }
 
+/* Forget the routes an interface wants and has without touching
+ * the kernel. Other interfaces wanting them pick them up when their
+ * routes are next built. */
+static void
+ipv4_freeifroutes(struct interface *ifp, struct ipv4_state *state)
+{
+	struct dhcpcd_ctx *ctx;
+	struct rt *rt, *or;
+
+	ctx = ifp->ctx;
+	while ((rt = TAILQ_FIRST(&state->routes))) {
+		TAILQ_REMOVE(&state->routes, rt, next);
+		if (ctx->ipv4_routes != NULL) {
+			rt_hash_del(ctx->ipv4_whash, rt);
+			if ((or = rt_hash_find(ctx->ipv4_rhash, rt)) != NULL &&
+			    or->iface == ifp)
+				ipv4_forgetroute(ctx, or);
+		}
+		free(rt);
+	}
+}
+
 void
 ipv4_free(struct interface *ifp)
 {
@@ -971,14 +1581,11 @@ ipv4_free(struct interface *ifp)
 				TAILQ_REMOVE(&state->addrs, addr, next);
 				free(addr);
 			}
+			ipv4_freeifroutes(ifp, state);
 			free(state);
 		}
+		/* The kernel table may have routes on it */
+		ipv4_kdelif(ifp);
 	}
 }
 
-void
-ipv4_ctxfree(struct dhcpcd_ctx *ctx)
-{
-
-	ipv4_freeroutes(ctx->ipv4_routes);
-}
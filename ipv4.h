@@ -39,6 +39,7 @@ struct rt {
 	unsigned int metric;
 	struct in_addr src;
 	uint8_t flags;
+	struct rt *hnext;	/* hash chain of the table it is in */
 };
 TAILQ_HEAD(rt_head, rt);
 
@@ -52,6 +53,9 @@ TAILQ_HEAD(ipv4_addrhead, ipv4_addr);
 
 struct ipv4_state {
 	struct ipv4_addrhead addrs;
+
+	/* Routes the lease wants, see ipv4_ifwants */
+	struct rt_head routes;
 };
 
 #define IPV4_STATE(ifp)							       \
@@ -71,7 +75,10 @@ int ipv4_addrexists(struct dhcpcd_ctx *, const struct in_addr *);
 #define STATE_FAKE		0x02
 
 void ipv4_buildroutes(struct dhcpcd_ctx *);
+void ipv4_buildifroutes(struct interface *);
+void ipv4_syncroutes(struct dhcpcd_ctx *);
 void ipv4_applyaddr(void *);
+void ipv4_routeadded(struct dhcpcd_ctx *, const struct rt *);
 int ipv4_routedeleted(struct dhcpcd_ctx *, const struct rt *);
 
 struct ipv4_addr *ipv4_iffindaddr(struct interface *,
@@ -89,6 +96,7 @@ void ipv4_ctxfree(struct dhcpcd_ctx *);
 #define ipv4_init(a) (-1)
 #define ipv4_sortinterfaces(a) {}
 #define ipv4_applyaddr(a) {}
+#define ipv4_syncroutes(a) {}
 #define ipv4_freeroutes(a) {}
 #define ipv4_free(a) {}
 #define ipv4_ctxfree(a) {}
@@ -163,7 +163,7 @@ ipv4ll_conflicted(struct arp_state *astate, const struct arp_msg *amsg)
 		time_t up;
 
 		/* RFC 3927 Section 2.5 */
-		up = uptime();
+		up = eloop_uptime(astate->iface->ctx->eloop);
 		if (state->defend + DEFEND_INTERVAL > up) {
 			syslog(LOG_WARNING,
 			    "%s: IPv4LL %d second defence failed for %s",
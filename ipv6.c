@@ -102,6 +102,150 @@
 #  endif
 #endif
 
+static struct rt6 *
+find_route6(struct rt6_head *rts, const struct rt6 *r)
+{
+	struct rt6 *rt;
+
+	TAILQ_FOREACH(rt, rts, next) {
+		if (IN6_ARE_ADDR_EQUAL(&rt->dest, &r->dest) &&
+		    IN6_ARE_ADDR_EQUAL(&rt->net, &r->net))
+			return rt;
+	}
+	return NULL;
+}
+
+/* Our routes and the routes interfaces want are hashed so that only
+ * the destinations an interface changed need to be looked at.
+ * The metric is hashed as well, otherwise every default route lands in
+ * the same bucket. A route without an interface could have any metric,
+ * so looking one up walks the table with find_route6 instead. */
+struct rt6_hash {
+	struct rt6 **buckets;
+	size_t size;
+	size_t len;
+};
+
+#if HAVE_ROUTE_METRIC
+#define RT6_SAMEDEST(a, b)						      \
+	(IN6_ARE_ADDR_EQUAL(&(a)->dest, &(b)->dest) &&			      \
+	    IN6_ARE_ADDR_EQUAL(&(a)->net, &(b)->net) &&			      \
+	    (a)->metric == (b)->metric)
+#else
+#define RT6_SAMEDEST(a, b)						      \
+	(IN6_ARE_ADDR_EQUAL(&(a)->dest, &(b)->dest) &&			      \
+	    IN6_ARE_ADDR_EQUAL(&(a)->net, &(b)->net))
+#endif
+
+static size_t
+rt6_hashkey(const struct rt6 *rt, size_t size)
+{
+	const uint32_t *d, *n;
+	uint32_t k;
+	int i;
+
+	d = (const uint32_t *)(const void *)&rt->dest;
+	n = (const uint32_t *)(const void *)&rt->net;
+	k = 0;
+	for (i = 0; i < 4; i++) {
+		k ^= d[i] ^ (n[i] * 0x9e3779b1U);
+		k *= 0x85ebca6bU;
+		k ^= k >> 13;
+	}
+#if HAVE_ROUTE_METRIC
+	k ^= rt->metric * 0x85ebca6bU;
+#endif
+	k ^= k >> 16;
+	k *= 0x7feb352dU;
+	k ^= k >> 15;
+	return k & (size - 1);
+}
+
+static struct rt6_hash *
+rt6_hash_new(size_t len)
+{
+	struct rt6_hash *h;
+
+	if ((h = malloc(sizeof(*h))) == NULL)
+		return NULL;
+	for (h->size = 16; h->size < len * 2; h->size <<= 1)
+		;
+	if ((h->buckets = calloc(h->size, sizeof(*h->buckets))) == NULL) {
+		free(h);
+		return NULL;
+	}
+	h->len = 0;
+	return h;
+}
+
+static void
+rt6_hash_free(struct rt6_hash *h)
+{
+
+	if (h) {
+		free(h->buckets);
+		free(h);
+	}
+}
+
+static void
+rt6_hash_add(struct rt6_hash *h, struct rt6 *rt)
+{
+	struct rt6 **nb, **b, *r, *rn;
+	size_t i, size;
+
+	/* Keep chains short, but carry on if we cannot grow */
+	if (h->len >= h->size) {
+		size = h->size << 1;
+		if ((nb = calloc(size, sizeof(*nb))) != NULL) {
+			for (i = 0; i < h->size; i++) {
+				for (r = h->buckets[i]; r; r = rn) {
+					rn = r->hnext;
+					b = &nb[rt6_hashkey(r, size)];
+					r->hnext = *b;
+					*b = r;
+				}
+			}
+			free(h->buckets);
+			h->buckets = nb;
+			h->size = size;
+		}
+	}
+	b = &h->buckets[rt6_hashkey(rt, h->size)];
+	rt->hnext = *b;
+	*b = rt;
+	h->len++;
+}
+
+static void
+rt6_hash_del(struct rt6_hash *h, struct rt6 *rt)
+{
+	struct rt6 **r;
+
+	for (r = &h->buckets[rt6_hashkey(rt, h->size)]; *r; r = &(*r)->hnext) {
+		if (*r == rt) {
+			*r = rt->hnext;
+			h->len--;
+			return;
+		}
+	}
+}
+
+static struct rt6 *
+rt6_hash_find(const struct rt6_hash *h, struct rt6_head *rts,
+    const struct rt6 *r)
+{
+	struct rt6 *rt;
+
+	if (r->iface == NULL)
+		return find_route6(rts, r);
+	for (rt = h->buckets[rt6_hashkey(r, h->size)]; rt; rt = rt->hnext) {
+		if (RT6_SAMEDEST(rt, r))
+			return rt;
+	}
+	return NULL;
+}
+
 struct ipv6_ctx *
 ipv6_init(struct dhcpcd_ctx *dhcpcd_ctx)
 {
@@ -129,6 +273,17 @@ ipv6_init(struct dhcpcd_ctx *dhcpcd_ctx)
 	}
 	TAILQ_INIT(ctx->ra_routers);
 
+	ctx->rhash = rt6_hash_new(0);
+	ctx->whash = rt6_hash_new(0);
+	if (ctx->rhash == NULL || ctx->whash == NULL) {
+		rt6_hash_free(ctx->rhash);
+		rt6_hash_free(ctx->whash);
+		free(ctx->ra_routers);
+		free(ctx->routes);
+		free(ctx);
+		return NULL;
+	}
+
 	ctx->sndhdr.msg_namelen = sizeof(struct sockaddr_in6);
 	ctx->sndhdr.msg_iov = ctx->sndiov;
 	ctx->sndhdr.msg_iovlen = 1;
@@ -633,7 +788,7 @@ ipv6_addaddr(struct ipv6_addr *ap, const struct timeval *now)
 	    ap->prefix_vltime != ND6_INFINITE_LIFETIME))
 	{
 		if (now == NULL) {
-			get_monotonic(&n);
+			eloop_gettime(ap->iface->ctx->eloop, &n);
 			now = &n;
 		}
 		timersub(now, &ap->acquired, &n);
@@ -771,7 +926,7 @@ ipv6_addaddrs(struct ipv6_addrhead *addrs)
 			if (ap->flags & IPV6_AF_NEW)
 				i++;
 			if (!timerisset(&now))
-				get_monotonic(&now);
+				eloop_gettime(ap->iface->ctx->eloop, &now);
 			ipv6_addaddr(ap, &now);
 		}
 	}
@@ -807,7 +962,8 @@ ipv6_freedrop_addrs(struct ipv6_addrhead *addrs, int drop,
 			    DHCPCD_EXITING) && apf)
 			{
 				if (!timerisset(&now))
-					get_monotonic(&now);
+					eloop_gettime(ap->iface->ctx->eloop,
+					    &now);
 				ipv6_addaddr(apf, &now);
 			}
 		}
@@ -830,6 +986,7 @@ ipv6_getstate(struct interface *ifp)
 		}
 		TAILQ_INIT(&state->addrs);
 		TAILQ_INIT(&state->ll_callbacks);
+		TAILQ_INIT(&state->routes);
 	}
 	return state;
 }
@@ -1064,7 +1221,8 @@ nextslaacprivate:
 		}
 		ap->dadcounter = dadcounter;
 	} else {
-		memcpy(ap->addr.s6_addr, ap->prefix.s6_addr, ap->prefix_len);
+		memcpy(ap->addr.s6_addr, ap->prefix.s6_addr,
+		    ap->prefix_len / NBBY);
 		switch (ifp->family) {
 		case ARPHRD_ETHER:
 			if (ifp->hwlen == 6) {
@@ -1146,6 +1304,8 @@ ipv6_start(struct interface *ifp)
 	return 0;
 }
 
+static void ipv6_freeifroutes(struct interface *, struct ipv6_state *);
+
 void
 ipv6_free(struct interface *ifp)
 {
@@ -1160,6 +1320,7 @@ ipv6_free(struct interface *ifp)
 				TAILQ_REMOVE(&state->addrs, ap, next);
 				free(ap);
 			}
+			ipv6_freeifroutes(ifp, state);
 			free(state);
 			ifp->if_data[IF_DATA_IPV6] = NULL;
 		}
@@ -1169,11 +1330,18 @@ ipv6_free(struct interface *ifp)
 void
 ipv6_ctxfree(struct dhcpcd_ctx *ctx)
 {
+	struct rt6 *rt;
 
 	if (ctx->ipv6 == NULL)
 		return;
 
+	while ((rt = TAILQ_FIRST(ctx->ipv6->routes))) {
+		TAILQ_REMOVE(ctx->ipv6->routes, rt, next);
+		free(rt);
+	}
 	free(ctx->ipv6->routes);
+	rt6_hash_free(ctx->ipv6->rhash);
+	rt6_hash_free(ctx->ipv6->whash);
 	free(ctx->ipv6->ra_routers);
 	free(ctx->ipv6);
 }
@@ -1225,23 +1393,6 @@ ipv6_handleifa_addrs(int cmd,
 	return alldadcompleted ? found : 0;
 }
 
-static struct rt6 *
-find_route6(struct rt6_head *rts, const struct rt6 *r)
-{
-	struct rt6 *rt;
-
-	TAILQ_FOREACH(rt, rts, next) {
-		if (IN6_ARE_ADDR_EQUAL(&rt->dest, &r->dest) &&
-#if HAVE_ROUTE_METRIC
-		    (r->iface == NULL || rt->iface == NULL ||
-		    rt->iface->metric == r->iface->metric) &&
-#endif
-		    IN6_ARE_ADDR_EQUAL(&rt->net, &r->net))
-			return rt;
-	}
-	return NULL;
-}
-
 static void
 desc_route(const char *cmd, const struct rt6 *rt)
 {
@@ -1265,6 +1416,21 @@ desc_route(const char *cmd, const struct rt6 *rt)
 		    dest, ipv6_prefixlen(&rt->net), gate);
 }
 
+#define RT_IS_DEFAULT(rtp) \
+	(IN6_ARE_ADDR_EQUAL(&((rtp)->dest), &in6addr_any) &&		      \
+	    IN6_ARE_ADDR_EQUAL(&((rtp)->net), &in6addr_any))
+
+static void
+ipv6_forgetroute(struct ipv6_ctx *ctx, struct rt6 *rt)
+{
+
+	rt6_hash_del(ctx->rhash, rt);
+	TAILQ_REMOVE(ctx->routes, rt, next);
+	if (RT_IS_DEFAULT(rt))
+		ctx->defaults--;
+	free(rt);
+}
+
 /* If something other than dhcpcd removes a route,
  * we need to remove it from our internal table. */
 int
@@ -1275,12 +1441,11 @@ ipv6_routedeleted(struct dhcpcd_ctx *ctx, const struct rt6 *rt)
 	if (ctx->ipv6 == NULL)
 		return 0;
 
-	f = find_route6(ctx->ipv6->routes, rt);
+	f = rt6_hash_find(ctx->ipv6->rhash, ctx->ipv6->routes, rt);
 	if (f == NULL)
 		return 0;
 	desc_route("removing", f);
-	TAILQ_REMOVE(ctx->ipv6->routes, f, next);
-	free(f);
+	ipv6_forgetroute(ctx->ipv6, f);
 	return 1;
 }
 
@@ -1307,6 +1472,45 @@ nc_route(int add, struct rt6 *ort, struct rt6 *nrt)
 	return -1;
 }
 
+/* Forget a batched route the kernel refused to add.
+ * The table may have been rebuilt since, so match on a copy. */
+static void
+nc_route_done(struct dhcpcd_ctx *ctx, void *arg, int error)
+{
+	const struct rt6 *r;
+	struct rt6 *rt;
+
+	if (error == 0 || ctx->ipv6 == NULL || ctx->ipv6->routes == NULL)
+		return;
+	r = arg;
+	errno = error;
+	rt = rt6_hash_find(ctx->ipv6->rhash, ctx->ipv6->routes, r);
+	if (rt != NULL && rt->iface == r->iface &&
+	    IN6_ARE_ADDR_EQUAL(&rt->gate, &r->gate))
+	{
+		/* The kernel may have added the route without telling
+		 * us and we keep no copy of its table to check,
+		 * so replace it to be sure. */
+		if (error == ETIMEDOUT) {
+			n_route(rt);
+			return;
+		}
+		syslog(LOG_ERR, "%s: if_addroute6: %m", rt->iface->name);
+		ipv6_forgetroute(ctx->ipv6, rt);
+		return;
+	}
+	syslog(LOG_ERR, "if_addroute6: %m");
+}
+
+/* A route added again by ipv6_syncroutes which the kernel still has */
+static void
+sync_route_done(struct dhcpcd_ctx *ctx, void *arg, int error)
+{
+
+	if (error != EEXIST)
+		nc_route_done(ctx, arg, error);
+}
+
 static int
 d_route(struct rt6 *rt)
 {
@@ -1390,10 +1594,7 @@ make_router(const struct ra *rap)
 int
 ipv6_removesubnet(struct interface *ifp, struct ipv6_addr *addr)
 {
-	struct rt6 *rt;
-#if HAVE_ROUTE_METRIC
-	struct rt6 *ort;
-#endif
+	struct rt6 *rt, *ort;
 	int r;
 
 	/* We need to delete the subnet route to have our metric or
@@ -1402,6 +1603,9 @@ ipv6_removesubnet(struct interface *ifp, struct ipv6_addr *addr)
 	rt = make_prefix(ifp, NULL, addr);
 	if (rt) {
 		rt->iface = ifp;
+		/* make_prefix gave it our metric */
+		ort = rt6_hash_find(ifp->ctx->ipv6->rhash,
+		    ifp->ctx->ipv6->routes, rt);
 #ifdef __linux__
 		rt->metric = 256;
 #else
@@ -1411,10 +1615,9 @@ ipv6_removesubnet(struct interface *ifp, struct ipv6_addr *addr)
 		/* For some reason, Linux likes to re-add the subnet
 		   route under the original metric.
 		   I would love to find a way of stopping this! */
-		if ((ort = find_route6(ifp->ctx->ipv6->routes, rt)) == NULL ||
-		    ort->metric != rt->metric)
+		if (ort == NULL || ort->metric != rt->metric)
 #else
-		if (!find_route6(ifp->ctx->ipv6->routes, rt))
+		if (ort == NULL)
 #endif
 		{
 			r = if_delroute6(rt);
@@ -1426,155 +1629,365 @@ ipv6_removesubnet(struct interface *ifp, struct ipv6_addr *addr)
 	return r;
 }
 
-#define RT_IS_DEFAULT(rtp) \
-	(IN6_ARE_ADDR_EQUAL(&((rtp)->dest), &in6addr_any) &&		      \
-	    IN6_ARE_ADDR_EQUAL(&((rtp)->net), &in6addr_any))
+/* Where a route an interface wants comes from, best first */
+#define RT6_RA			0	/* reachable router */
+#define RT6_BOUND		1	/* DHCPv6 lease */
+#define RT6_DELEGATED		2	/* prefix delegated to us */
+#define RT6_RA_EXPIRED		3	/* see ipv6_wantok */
 
 static void
-ipv6_build_ra_routes(struct ipv6_ctx *ctx, struct rt6_head *dnr, int expired)
+ipv6_freeroutes(struct rt6_head *rts)
+{
+	struct rt6 *rt;
+
+	while ((rt = TAILQ_FIRST(rts))) {
+		TAILQ_REMOVE(rts, rt, next);
+		free(rt);
+	}
+}
+
+/* Find a route to the destination of r which an interface wants.
+ * If ifp is NULL any interface will do. */
+static struct rt6 *
+ipv6_findwant(const struct ipv6_ctx *ctx, const struct rt6 *r,
+    const struct interface *ifp)
+{
+	struct rt6 *rt;
+
+	rt = ctx->whash->buckets[rt6_hashkey(r, ctx->whash->size)];
+	for (; rt; rt = rt->hnext) {
+		if (RT6_SAMEDEST(rt, r) && (ifp == NULL || rt->iface == ifp))
+			return rt;
+	}
+	return NULL;
+}
+
+static void
+ipv6_addwant(struct interface *ifp, struct rt6 *rt,
+    uint8_t source, unsigned int rank)
+{
+	struct ipv6_ctx *ctx;
+	struct ipv6_state *state;
+
+	ctx = ifp->ctx->ipv6;
+	/* Only the first route to a destination counts */
+	if (ipv6_findwant(ctx, rt, ifp) != NULL ||
+	    (state = ipv6_getstate(ifp)) == NULL)
+	{
+		free(rt);
+		return;
+	}
+	rt->source = source;
+	rt->rank = rank;
+	if (source == RT6_RA)
+		ctx->reachable++;
+	TAILQ_INSERT_TAIL(&state->routes, rt, next);
+	rt6_hash_add(ctx->whash, rt);
+}
+
+static void
+ipv6_ra_wants(struct interface *ifp, int expired)
 {
 	struct rt6 *rt;
 	const struct ra *rap;
 	const struct ipv6_addr *addr;
+	unsigned int rank;
+	uint8_t source;
 
-	TAILQ_FOREACH(rap, ctx->ra_routers, next) {
-		if (rap->expired != expired)
+	source = expired ? RT6_RA_EXPIRED : RT6_RA;
+	rank = 0;
+	TAILQ_FOREACH(rap, ifp->ctx->ipv6->ra_routers, next) {
+		if (rap->iface != ifp || rap->expired != expired)
 			continue;
-		if (rap->iface->options->options & DHCPCD_IPV6RA_OWN) {
+		if (ifp->options->options & DHCPCD_IPV6RA_OWN) {
 			TAILQ_FOREACH(addr, &rap->addrs, next) {
-				rt = make_prefix(rap->iface, rap, addr);
+				rt = make_prefix(ifp, rap, addr);
 				if (rt)
-					TAILQ_INSERT_TAIL(dnr, rt, next);
+					ipv6_addwant(ifp, rt, source, rank);
 			}
 		}
-		if (rap->lifetime && rap->iface->options->options &
+		if (rap->lifetime && ifp->options->options &
 		    (DHCPCD_IPV6RA_OWN | DHCPCD_IPV6RA_OWN_DEFAULT))
 		{
 			rt = make_router(rap);
 			if (rt)
-				TAILQ_INSERT_TAIL(dnr, rt, next);
+				ipv6_addwant(ifp, rt, source, rank);
 		}
+		rank++;
 	}
 }
 
+/* Work out the routes an interface wants from its routers and DHCPv6.
+ * They replace the routes it wanted before, which are moved to old so
+ * the caller can work out where those destinations go now. */
 static void
-ipv6_build_dhcp_routes(struct dhcpcd_ctx *ctx,
-    struct rt6_head *dnr, enum DH6S dstate)
+ipv6_ifwants(struct interface *ifp, struct rt6_head *old)
 {
-	const struct interface *ifp;
+	struct ipv6_ctx *ctx;
+	struct ipv6_state *state;
 	const struct dhcp6_state *d6_state;
 	const struct ipv6_addr *addr;
 	struct rt6 *rt;
 
-	TAILQ_FOREACH(ifp, ctx->ifaces, next) {
-		d6_state = D6_CSTATE(ifp);
-		if (d6_state && d6_state->state == dstate) {
-			TAILQ_FOREACH(addr, &d6_state->addrs, next) {
-				rt = make_prefix(ifp, NULL, addr);
-				if (rt)
-					TAILQ_INSERT_TAIL(dnr, rt, next);
-			}
+	ctx = ifp->ctx->ipv6;
+	if ((state = IPV6_STATE(ifp)) != NULL) {
+		TAILQ_FOREACH(rt, &state->routes, next) {
+			rt6_hash_del(ctx->whash, rt);
+			if (rt->source == RT6_RA)
+				ctx->reachable--;
+		}
+		TAILQ_CONCAT(old, &state->routes, next);
+	}
+
+	/* Reachable routers first, then DHCPv6 as we have no way of
+	 * knowing if its prefixes are reachable, so we have to assume
+	 * they are. Bound comes before delegated so we can prefer
+	 * interfaces better. Routes from unreachable routers only count
+	 * if there are no reachable ones, see ipv6_wantok. */
+	ipv6_ra_wants(ifp, 0);
+	d6_state = D6_CSTATE(ifp);
+	if (d6_state && (d6_state->state == DH6S_BOUND ||
+	    d6_state->state == DH6S_DELEGATED))
+	{
+		TAILQ_FOREACH(addr, &d6_state->addrs, next) {
+			rt = make_prefix(ifp, NULL, addr);
+			if (rt)
+				ipv6_addwant(ifp, rt,
+				    d6_state->state == DH6S_BOUND ?
+				    RT6_BOUND : RT6_DELEGATED, 0);
 		}
 	}
+	ipv6_ra_wants(ifp, 1);
 }
 
-void
-ipv6_buildroutes(struct dhcpcd_ctx *ctx)
+/* Forget the routes an interface wants and has without touching
+ * the kernel. */
+static void
+ipv6_freeifroutes(struct interface *ifp, struct ipv6_state *state)
 {
-	struct rt6_head dnr, *nrs;
-	struct rt6 *rt, *rtn, *or;
-	uint8_t have_default;
-	unsigned long long o;
+	struct ipv6_ctx *ctx;
+	struct rt6 *rt, *or;
+
+	ctx = ifp->ctx->ipv6;
+	while ((rt = TAILQ_FIRST(&state->routes))) {
+		TAILQ_REMOVE(&state->routes, rt, next);
+		if (ctx != NULL) {
+			rt6_hash_del(ctx->whash, rt);
+			if (rt->source == RT6_RA)
+				ctx->reachable--;
+			or = rt6_hash_find(ctx->rhash, ctx->routes, rt);
+			if (or != NULL && or->iface == ifp)
+				ipv6_forgetroute(ctx, or);
+		}
+		free(rt);
+	}
+}
 
-	TAILQ_INIT(&dnr);
+/* If we have an unreachable router, we really do need to remove the
+ * route to it beause it could be a lower metric than a reachable
+ * router. Of course, we should at least have some routers if all
+ * are unreachable, which is a close match to kernel behaviour. */
+static int
+ipv6_wantok(const struct ipv6_ctx *ctx, const struct rt6 *rt)
+{
 
-	/* First add reachable routers and their prefixes */
-	ipv6_build_ra_routes(ctx->ipv6, &dnr, 0);
-#if HAVE_ROUTE_METRIC
-	have_default = (TAILQ_FIRST(&dnr) != NULL);
-#endif
+	if (HAVE_ROUTE_METRIC &&
+	    rt->source == RT6_RA_EXPIRED && ctx->reachable != 0)
+		return 0;
+	/* Don't set default routes if not asked to */
+	return !RT_IS_DEFAULT(rt) ||
+	    rt->iface->options->options & DHCPCD_GATEWAY;
+}
 
-	/* We have no way of knowing if prefixes added by DHCP are reachable
-	 * or not, so we have to assume they are.
-	 * Add bound before delegated so we can prefer interfaces better */
-	ipv6_build_dhcp_routes(ctx, &dnr, DH6S_BOUND);
-	ipv6_build_dhcp_routes(ctx, &dnr, DH6S_DELEGATED);
+/* Which of two interfaces wanting a route to the same destination
+ * gets it. It goes by where the route came from, then as ra_routers
+ * is sorted. On a tie the route stays put. */
+static int
+ipv6_wantcmp(const struct rt6 *a, const struct rt6 *b, const struct rt6 *or)
+{
 
-#if HAVE_ROUTE_METRIC
-	/* If we have an unreachable router, we really do need to remove the
-	 * route to it beause it could be a lower metric than a reachable
-	 * router. Of course, we should at least have some routers if all
-	 * are unreachable. */
-	if (!have_default)
-#endif
-	/* Add our non-reachable routers and prefixes
-	 * Unsure if this is needed, but it's a close match to kernel
-	 * behaviour */
-	ipv6_build_ra_routes(ctx->ipv6, &dnr, 1);
+	if (a->source != b->source)
+		return a->source < b->source ? -1 : 1;
+	if (a->iface->metric != b->iface->metric)
+		return a->iface->metric < b->iface->metric ? -1 : 1;
+	if (a->iface == b->iface && a->rank != b->rank)
+		return a->rank < b->rank ? -1 : 1;
+	if (or != NULL) {
+		if (a->iface == or->iface &&
+		    IN6_ARE_ADDR_EQUAL(&a->gate, &or->gate))
+			return -1;
+		if (b->iface == or->iface &&
+		    IN6_ARE_ADDR_EQUAL(&b->gate, &or->gate))
+			return 1;
+	}
+	return 0;
+}
+
+/* Stop managing a route.
+ * If we own the default route, but not RA management itself
+ * then we need to preserve the last best default route we had. */
+static void
+ipv6_unroute(struct ipv6_ctx *ctx, struct rt6 *rt)
+{
+	unsigned long long o;
+
+	o = rt->iface->options->options;
+	if (ctx->defaults == 1 && RT_IS_DEFAULT(rt) &&
+	    (o & DHCPCD_IPV6RA_OWN_DEFAULT) && !(o & DHCPCD_IPV6RA_OWN))
+		/* no need to add it back to our routing table
+		 * as we delete an exiting route when we add
+		 * a new one */
+		o |= DHCPCD_EXITING | DHCPCD_PERSISTENT;
+	if ((o & (DHCPCD_EXITING | DHCPCD_PERSISTENT)) !=
+	    (DHCPCD_EXITING | DHCPCD_PERSISTENT))
+		d_route(rt);
+	ipv6_forgetroute(ctx, rt);
+}
 
-	nrs = malloc(sizeof(*nrs));
-	if (nrs == NULL) {
+/* Give the route to the destination of dest to the interface which
+ * should have it now, only telling the kernel what has changed. */
+static void
+ipv6_resolve(struct dhcpcd_ctx *dhcpcd_ctx, const struct rt6 *dest)
+{
+	struct ipv6_ctx *ctx;
+	struct rt6 *or, *best, *rt;
+
+	ctx = dhcpcd_ctx->ipv6;
+	or = rt6_hash_find(ctx->rhash, ctx->routes, dest);
+	best = NULL;
+	rt = ctx->whash->buckets[rt6_hashkey(dest, ctx->whash->size)];
+	for (; rt; rt = rt->hnext) {
+		if (RT6_SAMEDEST(rt, dest) && ipv6_wantok(ctx, rt) &&
+		    (best == NULL || ipv6_wantcmp(rt, best, or) == -1))
+			best = rt;
+	}
+	if (best == NULL) {
+		if (or != NULL)
+			ipv6_unroute(ctx, or);
+		return;
+	}
+
+	if (or != NULL && or->iface == best->iface &&
+	    IN6_ARE_ADDR_EQUAL(&or->gate, &best->gate) &&
+	    or->metric == best->metric)
+		return;
+	if ((rt = malloc(sizeof(*rt))) == NULL) {
 		syslog(LOG_ERR, "%s: %m", __func__);
+		if (or != NULL)
+			ipv6_unroute(ctx, or);
 		return;
 	}
-	TAILQ_INIT(nrs);
-	have_default = 0;
-	TAILQ_FOREACH_SAFE(rt, &dnr, next, rtn) {
-		/* Is this route already in our table? */
-		if (find_route6(nrs, rt) != NULL)
-			continue;
-		//rt->src.s_addr = ifp->addr.s_addr;
-		/* Do we already manage it? */
-		if ((or = find_route6(ctx->ipv6->routes, rt))) {
-			if (or->iface != rt->iface ||
-		//	    or->src.s_addr != ifp->addr.s_addr ||
-			    !IN6_ARE_ADDR_EQUAL(&rt->gate, &or->gate) ||
-			    rt->metric != or->metric)
-			{
-				if (c_route(or, rt) != 0)
-					continue;
-			}
-			TAILQ_REMOVE(ctx->ipv6->routes, or, next);
-			free(or);
-		} else {
-			if (n_route(rt) != 0)
-				continue;
-		}
-		if (RT_IS_DEFAULT(rt))
-			have_default = 1;
-		TAILQ_REMOVE(&dnr, rt, next);
-		TAILQ_INSERT_TAIL(nrs, rt, next);
+	*rt = *best;
+	if ((or != NULL ? c_route(or, rt) : n_route(rt)) != 0) {
+		free(rt);
+		if (or != NULL)
+			ipv6_unroute(ctx, or);
+		return;
 	}
+	if_batch_callback(dhcpcd_ctx, nc_route_done, rt, sizeof(*rt));
+	if (or != NULL)
+		ipv6_forgetroute(ctx, or);
+	TAILQ_INSERT_TAIL(ctx->routes, rt, next);
+	rt6_hash_add(ctx->rhash, rt);
+	if (RT_IS_DEFAULT(rt))
+		ctx->defaults++;
+}
 
-	/* Free any routes we failed to add/change */
-	while ((rt = TAILQ_FIRST(&dnr))) {
-		TAILQ_REMOVE(&dnr, rt, next);
-		free(rt);
+/* Work out where every route interfaces want goes
+ * and remove old routes we used to manage. */
+static void
+ipv6_resolveall(struct dhcpcd_ctx *dhcpcd_ctx)
+{
+	struct ipv6_ctx *ctx;
+	struct interface *ifp;
+	struct ipv6_state *state;
+	struct rt6 *rt, *rtn;
+
+	ctx = dhcpcd_ctx->ipv6;
+	TAILQ_FOREACH(ifp, dhcpcd_ctx->ifaces, next) {
+		if ((state = IPV6_STATE(ifp)) == NULL)
+			continue;
+		TAILQ_FOREACH(rt, &state->routes, next)
+			ipv6_resolve(dhcpcd_ctx, rt);
+	}
+	TAILQ_FOREACH_SAFE(rt, ctx->routes, next, rtn) {
+		if (ipv6_findwant(ctx, rt, NULL) == NULL)
+			ipv6_unroute(ctx, rt);
 	}
+}
 
-	/* Remove old routes we used to manage
-	 * If we own the default route, but not RA management itself
-	 * then we need to preserve the last best default route we had */
-	while ((rt = TAILQ_LAST(ctx->ipv6->routes, rt6_head))) {
-		TAILQ_REMOVE(ctx->ipv6->routes, rt, next);
-		if (find_route6(nrs, rt) == NULL) {
-			o = rt->iface->options->options;
-			if (!have_default &&
-			    (o & DHCPCD_IPV6RA_OWN_DEFAULT) &&
-			    !(o & DHCPCD_IPV6RA_OWN) &&
-			    RT_IS_DEFAULT(rt))
-				have_default = 1;
-				/* no need to add it back to our routing table
-				 * as we delete an exiting route when we add
-				 * a new one */
-			else if ((rt->iface->options->options &
-				(DHCPCD_EXITING | DHCPCD_PERSISTENT)) !=
-				(DHCPCD_EXITING | DHCPCD_PERSISTENT))
-				d_route(rt);
+/* Work out the routes of every interface again. */
+void
+ipv6_buildroutes(struct dhcpcd_ctx *ctx)
+{
+	struct rt6_head old;
+	struct interface *ifp;
+
+	if (ctx->ipv6 == NULL)
+		return;
+	TAILQ_INIT(&old);
+	if_batch_begin(ctx);
+	TAILQ_FOREACH(ifp, ctx->ifaces, next)
+		ipv6_ifwants(ifp, &old);
+	ipv6_resolveall(ctx);
+	ipv6_freeroutes(&old);
+	if_batch_commit(ctx);
+}
+
+/* Rebuild routes after the routers, lease or delegated prefixes of one
+ * interface changed. Only the destinations it wants now or wanted
+ * before are looked at, unless that changed whether any router is
+ * reachable as then routes from unreachable routers come or go. */
+void
+ipv6_buildifroutes(struct interface *ifp)
+{
+	struct dhcpcd_ctx *ctx;
+	struct rt6_head old;
+	struct ipv6_state *state;
+	struct rt6 *rt;
+	size_t reachable;
+
+	ctx = ifp->ctx;
+	if (ctx->ipv6 == NULL)
+		return;
+	reachable = ctx->ipv6->reachable;
+	TAILQ_INIT(&old);
+	if_batch_begin(ctx);
+	ipv6_ifwants(ifp, &old);
+	if (HAVE_ROUTE_METRIC &&
+	    (reachable == 0) != (ctx->ipv6->reachable == 0))
+		ipv6_resolveall(ctx);
+	else {
+		if ((state = IPV6_STATE(ifp)) != NULL) {
+			TAILQ_FOREACH(rt, &state->routes, next)
+				ipv6_resolve(ctx, rt);
 		}
-		free(rt);
+		TAILQ_FOREACH(rt, &old, next)
+			ipv6_resolve(ctx, rt);
 	}
+	ipv6_freeroutes(&old);
+	if_batch_commit(ctx);
+}
 
-	free(ctx->ipv6->routes);
-	ctx->ipv6->routes = nrs;
+/* Restore routes something else removed while we were not told,
+ * such as when the link socket overflowed.
+ * We keep no copy of the kernel table, so add each of ours again:
+ * the kernel refuses the ones it still has. */
+void
+ipv6_syncroutes(struct dhcpcd_ctx *ctx)
+{
+	struct rt6 *rt;
+
+	if (ctx->ipv6 == NULL || ctx->ipv6->routes == NULL)
+		return;
+	if_batch_begin(ctx);
+	TAILQ_FOREACH(rt, ctx->ipv6->routes, next) {
+		if (if_addroute6(rt) == 0)
+			if_batch_callback(ctx, sync_route_done,
+			    rt, sizeof(*rt));
+		else if (errno != EEXIST)
+			syslog(LOG_ERR, "%s: if_addroute6: %m",
+			    rt->iface->name);
+	}
+	if_batch_commit(ctx);
 }
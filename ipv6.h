@@ -123,6 +123,9 @@ struct rt6 {
 	unsigned int flags;
 	unsigned int metric;
 	unsigned int mtu;
+	uint8_t source;		/* see ipv6_ifwants */
+	unsigned int rank;
+	struct rt6 *hnext;	/* hash chain of the table it is in */
 };
 TAILQ_HEAD(rt6_head, rt6);
 
@@ -136,6 +139,9 @@ TAILQ_HEAD(ll_callback_head, ll_callback);
 struct ipv6_state {
 	struct ipv6_addrhead addrs;
 	struct ll_callback_head ll_callbacks;
+
+	/* Routes the interface wants, see ipv6_ifwants */
+	struct rt6_head routes;
 };
 
 #define IPV6_STATE(ifp)							       \
@@ -162,6 +168,10 @@ struct ipv6_ctx {
 	int nd_fd;
 	struct ra_head *ra_routers;
 	struct rt6_head *routes;
+	struct rt6_hash *rhash;		/* routes hashed */
+	struct rt6_hash *whash;		/* routes interfaces want */
+	size_t reachable;		/* wants from reachable routers */
+	size_t defaults;		/* default routes in routes */
 
 	int dhcp_fd;
 };
@@ -202,6 +212,8 @@ void ipv6_ctxfree(struct dhcpcd_ctx *);
 int ipv6_routedeleted(struct dhcpcd_ctx *, const struct rt6 *);
 int ipv6_removesubnet(struct interface *, struct ipv6_addr *);
 void ipv6_buildroutes(struct dhcpcd_ctx *);
+void ipv6_buildifroutes(struct interface *);
+void ipv6_syncroutes(struct dhcpcd_ctx *);
 
 #else
 #define ipv6_init(a) NULL
@@ -209,6 +221,8 @@ void ipv6_buildroutes(struct dhcpcd_ctx *);
 #define ipv6_free_ll_callbacks(a)
 #define ipv6_free(a)
 #define ipv6_ctxfree(a)
+#define ipv6_buildroutes(a)
+#define ipv6_syncroutes(a)
 #endif
 
 #endif
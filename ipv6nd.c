@@ -323,7 +323,7 @@ ipv6nd_reachable(struct ra *rap, int flags)
 			syslog(LOG_INFO, "%s: %s is reachable again",
 			    rap->iface->name, rap->sfrom);
 			rap->expired = 0;
-			ipv6_buildroutes(rap->iface->ctx);
+			ipv6_buildifroutes(rap->iface);
 			/* XXX Not really an RA */
 			script_runreason(rap->iface, "ROUTERADVERT");
 		}
@@ -333,7 +333,7 @@ ipv6nd_reachable(struct ra *rap, int flags)
 			    "%s: %s is unreachable, expiring it",
 			    rap->iface->name, rap->sfrom);
 			rap->expired = 1;
-			ipv6_buildroutes(rap->iface->ctx);
+			ipv6_buildifroutes(rap->iface);
 			/* XXX Not really an RA */
 			script_runreason(rap->iface, "ROUTERADVERT");
 		}
@@ -775,7 +775,7 @@ ipv6nd_handlera(struct ipv6_ctx *ctx, struct interface *ifp,
 		rap->data_len = len;
 	}
 
-	get_monotonic(&rap->received);
+	eloop_gettime(ifp->ctx->eloop, &rap->received);
 	rap->flags = nd_ra->nd_ra_flags_reserved;
 	if (new_rap == 0 && rap->lifetime == 0)
 		syslog(LOG_WARNING, "%s: %s router available",
@@ -1063,7 +1063,7 @@ extra_opt:
 		goto handle_flag;
 	}
 	ipv6_addaddrs(&rap->addrs);
-	ipv6_buildroutes(ifp->ctx);
+	ipv6_buildifroutes(ifp);
 	if (ipv6nd_scriptrun(rap))
 		return;
 
@@ -1259,7 +1259,7 @@ ipv6nd_expirera(void *arg)
 	int expired, valid;
 
 	ifp = arg;
-	get_monotonic(&now);
+	eloop_gettime(ifp->ctx->eloop, &now);
 	expired = 0;
 	timerclear(&next);
 
@@ -1335,7 +1335,7 @@ ipv6nd_expirera(void *arg)
 		eloop_timeout_add_tv(ifp->ctx->eloop,
 		    &next, ipv6nd_expirera, ifp);
 	if (expired) {
-		ipv6_buildroutes(ifp->ctx);
+		ipv6_buildifroutes(ifp);
 		script_runreason(ifp, "ROUTERADVERT");
 	}
 }
@@ -1364,7 +1364,7 @@ ipv6nd_drop(struct interface *ifp)
 			TAILQ_REMOVE(&rtrs, rap, next);
 			ipv6nd_drop_ra(rap);
 		}
-		ipv6_buildroutes(ifp->ctx);
+		ipv6_buildifroutes(ifp);
 		if ((ifp->options->options &
 		    (DHCPCD_EXITING | DHCPCD_PERSISTENT)) !=
 		    (DHCPCD_EXITING | DHCPCD_PERSISTENT))
@@ -1431,7 +1431,7 @@ ipv6nd_handlena(struct ipv6_ctx *ctx, struct interface *ifp,
 		syslog(LOG_INFO, "%s: %s not a router (%s)",
 		    ifp->name, taddr, ctx->sfrom);
 		rap->expired = 1;
-		ipv6_buildroutes(ifp->ctx);
+		ipv6_buildifroutes(ifp);
 		script_runreason(ifp, "ROUTERADVERT");
 		return;
 	}
@@ -1441,48 +1441,42 @@ ipv6nd_handlena(struct ipv6_ctx *ctx, struct interface *ifp,
 			rap->expired = 0;
 			syslog(LOG_INFO, "%s: %s reachable (%s)",
 			    ifp->name, taddr, ctx->sfrom);
-			ipv6_buildroutes(ifp->ctx);
+			ipv6_buildifroutes(ifp);
 			script_runreason(rap->iface, "ROUTERADVERT"); /* XXX */
 		}
 	}
 }
 
-static void
-ipv6nd_handledata(void *arg)
+/* Handle a message read from the ND socket.
+ * This is split from ipv6nd_handledata so that test programs can
+ * feed in messages which did not come from the socket. */
+void
+ipv6nd_recvmsg(struct dhcpcd_ctx *dhcpcd_ctx, struct msghdr *msg, size_t len)
 {
-	struct dhcpcd_ctx *dhcpcd_ctx;
 	struct ipv6_ctx *ctx;
-	ssize_t len;
 	struct cmsghdr *cm;
 	int hoplimit;
 	struct in6_pktinfo pkt;
 	struct icmp6_hdr *icp;
 	struct interface *ifp;
 
-	dhcpcd_ctx = arg;
 	ctx = dhcpcd_ctx->ipv6;
-	ctx->rcvhdr.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo)) +
-	    CMSG_SPACE(sizeof(int));
-	len = recvmsg(ctx->nd_fd, &ctx->rcvhdr, 0);
-	if (len == -1) {
-		syslog(LOG_ERR, "recvmsg: %m");
-		eloop_event_delete(dhcpcd_ctx->eloop, ctx->nd_fd, 0);
-		close(ctx->nd_fd);
-		ctx->nd_fd = -1;
-		return;
-	}
+	if (msg->msg_name != &ctx->from)
+		memcpy(&ctx->from, msg->msg_name, sizeof(ctx->from));
 	ctx->sfrom = inet_ntop(AF_INET6, &ctx->from.sin6_addr,
 	    ctx->ntopbuf, INET6_ADDRSTRLEN);
-	if ((size_t)len < sizeof(struct icmp6_hdr)) {
+	if (len < sizeof(struct icmp6_hdr)) {
 		syslog(LOG_ERR, "IPv6 ICMP packet too short from %s",
 		    ctx->sfrom);
+		metrics_inc(dhcpcd_ctx, NULL, MET_ND_RX);
+		metrics_inc(dhcpcd_ctx, NULL, MET_ND_DROP);
 		return;
 	}
 
 	pkt.ipi6_ifindex = hoplimit = 0;
-	for (cm = (struct cmsghdr *)CMSG_FIRSTHDR(&ctx->rcvhdr);
+	for (cm = (struct cmsghdr *)CMSG_FIRSTHDR(msg);
 	     cm;
-	     cm = (struct cmsghdr *)CMSG_NXTHDR(&ctx->rcvhdr, cm))
+	     cm = (struct cmsghdr *)CMSG_NXTHDR(msg, cm))
 	{
 		if (cm->cmsg_level != IPPROTO_IPV6)
 			continue;
@@ -1502,28 +1496,54 @@ ipv6nd_handledata(void *arg)
 		syslog(LOG_ERR,
 		    "IPv6 RA/NA did not contain index or hop limit from %s",
 		    ctx->sfrom);
+		metrics_inc(dhcpcd_ctx, NULL, MET_ND_RX);
+		metrics_inc(dhcpcd_ctx, NULL, MET_ND_DROP);
 		return;
 	}
 
-	TAILQ_FOREACH(ifp, dhcpcd_ctx->ifaces, next) {
-		if (ifp->index == (unsigned int)pkt.ipi6_ifindex)
-			break;
-	}
+	ifp = if_findindex(dhcpcd_ctx, (unsigned int)pkt.ipi6_ifindex);
+	metrics_inc(dhcpcd_ctx, ifp, MET_ND_RX);
+	if (ifp == NULL)
+		metrics_inc(dhcpcd_ctx, NULL, MET_ND_DROP);
 
-	icp = (struct icmp6_hdr *)ctx->rcvhdr.msg_iov[0].iov_base;
+	icp = (struct icmp6_hdr *)msg->msg_iov[0].iov_base;
 	if (icp->icmp6_code == 0) {
 		switch(icp->icmp6_type) {
 			case ND_NEIGHBOR_ADVERT:
-				ipv6nd_handlena(ctx, ifp, icp, (size_t)len);
+				ipv6nd_handlena(ctx, ifp, icp, len);
 				return;
 			case ND_ROUTER_ADVERT:
-				ipv6nd_handlera(ctx, ifp, icp, (size_t)len);
+				ipv6nd_handlera(ctx, ifp, icp, len);
 				return;
 		}
 	}
 
 	syslog(LOG_ERR, "invalid IPv6 type %d or code %d from %s",
 	    icp->icmp6_type, icp->icmp6_code, ctx->sfrom);
+	if (ifp)
+		metrics_inc(dhcpcd_ctx, ifp, MET_ND_DROP);
+}
+
+static void
+ipv6nd_handledata(void *arg)
+{
+	struct dhcpcd_ctx *dhcpcd_ctx;
+	struct ipv6_ctx *ctx;
+	ssize_t len;
+
+	dhcpcd_ctx = arg;
+	ctx = dhcpcd_ctx->ipv6;
+	ctx->rcvhdr.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo)) +
+	    CMSG_SPACE(sizeof(int));
+	len = recvmsg(ctx->nd_fd, &ctx->rcvhdr, 0);
+	if (len == -1) {
+		syslog(LOG_ERR, "recvmsg: %m");
+		eloop_event_delete(dhcpcd_ctx->eloop, ctx->nd_fd, 0);
+		close(ctx->nd_fd);
+		ctx->nd_fd = -1;
+		return;
+	}
+	ipv6nd_recvmsg(dhcpcd_ctx, &ctx->rcvhdr, (size_t)len);
 }
 
 static void
@@ -98,6 +98,7 @@ void ipv6nd_handleifa(struct dhcpcd_ctx *, int,
 int ipv6nd_dadcompleted(const struct interface *);
 void ipv6nd_drop(struct interface *);
 void ipv6nd_neighbour(struct dhcpcd_ctx *, struct in6_addr *, int);
+void ipv6nd_recvmsg(struct dhcpcd_ctx *, struct msghdr *, size_t);
 #else
 #define ipv6nd_startrs(a) {}
 #define ipv6nd_findaddr(a, b, c) (0)
@@ -0,0 +1,227 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "common.h"
+#include "dhcpcd.h"
+#include "control.h"
+#include "eloop.h"
+#include "metrics.h"
+
+static const unsigned int metrics_hist_bounds[MET_HIST_LEN] = {
+	MET_HIST_BOUNDS
+};
+
+static const struct {
+	const char *name;
+	const char *protocol;
+} metrics_counters[MET_MAX] = {
+	{ "packets_received_total",	"dhcp" },
+	{ "packets_received_total",	"arp" },
+	{ "packets_received_total",	"nd" },
+	{ "packets_dropped_total",	"dhcp" },
+	{ "packets_dropped_total",	"arp" },
+	{ "packets_dropped_total",	"nd" },
+};
+
+/* Expected size of the global metrics and of each interface line */
+#define MET_BUF_LEN	4096
+#define MET_IFLINE_LEN	96
+
+struct metrics_buf {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+void
+metrics_inc(struct dhcpcd_ctx *ctx, struct interface *ifp, unsigned int m)
+{
+
+	ctx->metrics.counter[m]++;
+	if (ifp)
+		ifp->metrics[m]++;
+}
+
+void
+metrics_hist_add(struct metrics_hist *h, const struct timeval *tv)
+{
+	unsigned long long us;
+	size_t i;
+
+	us = (unsigned long long)tv->tv_sec * USECINSEC +
+	    (unsigned long long)tv->tv_usec;
+	for (i = 0; i < MET_HIST_LEN; i++) {
+		if (us <= metrics_hist_bounds[i] * 1000ULL)
+			break;
+	}
+	h->bucket[i]++;
+	h->count++;
+	h->sum_us += us;
+}
+
+static int
+metrics_printf(struct metrics_buf *mb, const char *fmt, ...)
+{
+	va_list va;
+	int n;
+	size_t size;
+	char *nbuf;
+
+	for (;;) {
+		va_start(va, fmt);
+		n = vsnprintf(mb->buf + mb->len, mb->size - mb->len, fmt, va);
+		va_end(va);
+		if (n == -1)
+			return -1;
+		if (mb->len + (size_t)n < mb->size)
+			break;
+		size = mb->size ? mb->size * 2 : 4096;
+		while (size <= mb->len + (size_t)n)
+			size *= 2;
+		if ((nbuf = realloc(mb->buf, size)) == NULL)
+			return -1;
+		mb->buf = nbuf;
+		mb->size = size;
+	}
+	mb->len += (size_t)n;
+	return 0;
+}
+
+static int
+metrics_print_hist(struct metrics_buf *mb, const char *name,
+    const struct metrics_hist *h)
+{
+	unsigned long long n;
+	size_t i;
+
+	if (metrics_printf(mb, "# TYPE dhcpcd_%s histogram\n", name) == -1)
+		return -1;
+	n = 0;
+	for (i = 0; i < MET_HIST_LEN; i++) {
+		n += h->bucket[i];
+		if (metrics_printf(mb, "dhcpcd_%s_bucket{le=\"%u.%03u\"} %llu\n",
+		    name, metrics_hist_bounds[i] / 1000,
+		    metrics_hist_bounds[i] % 1000, n) == -1)
+			return -1;
+	}
+	n += h->bucket[i];
+	return metrics_printf(mb,
+	    "dhcpcd_%s_bucket{le=\"+Inf\"} %llu\n"
+	    "dhcpcd_%s_sum %llu.%06llu\n"
+	    "dhcpcd_%s_count %llu\n",
+	    name, n,
+	    name, h->sum_us / USECINSEC, h->sum_us % USECINSEC,
+	    name, h->count);
+}
+
+static int
+metrics_print(struct metrics_buf *mb, const struct dhcpcd_ctx *ctx)
+{
+	const struct interface *ifp;
+	const char *last;
+	size_t i;
+
+	last = NULL;
+	for (i = 0; i < MET_MAX; i++) {
+		if ((last == NULL ||
+		    strcmp(last, metrics_counters[i].name) != 0) &&
+		    metrics_printf(mb, "# TYPE dhcpcd_%s counter\n",
+		    metrics_counters[i].name) == -1)
+			return -1;
+		last = metrics_counters[i].name;
+		if (metrics_printf(mb, "dhcpcd_%s{protocol=\"%s\"} %llu\n",
+		    metrics_counters[i].name, metrics_counters[i].protocol,
+		    ctx->metrics.counter[i]) == -1)
+			return -1;
+	}
+
+	last = NULL;
+	for (i = 0; i < MET_MAX; i++) {
+		if ((last == NULL ||
+		    strcmp(last, metrics_counters[i].name) != 0) &&
+		    metrics_printf(mb, "# TYPE dhcpcd_interface_%s counter\n",
+		    metrics_counters[i].name) == -1)
+			return -1;
+		last = metrics_counters[i].name;
+		TAILQ_FOREACH(ifp, ctx->ifaces, next) {
+			if (metrics_printf(mb, "dhcpcd_interface_%s"
+			    "{interface=\"%s\",protocol=\"%s\"} %llu\n",
+			    metrics_counters[i].name, ifp->name,
+			    metrics_counters[i].protocol,
+			    ifp->metrics[i]) == -1)
+				return -1;
+		}
+	}
+
+	if (metrics_printf(mb,
+	    "# TYPE dhcpcd_timeouts_total counter\n"
+	    "dhcpcd_timeouts_total %llu\n"
+	    "# TYPE dhcpcd_timeouts gauge\n"
+	    "dhcpcd_timeouts %zu\n"
+	    "# TYPE dhcpcd_events_total counter\n"
+	    "dhcpcd_events_total %llu\n"
+	    "# TYPE dhcpcd_events gauge\n"
+	    "dhcpcd_events %zu\n",
+	    ctx->eloop->timeouts_run, ctx->eloop->timeouts_len,
+	    ctx->eloop->events_run, ctx->eloop->events_len) == -1)
+		return -1;
+
+	return metrics_print_hist(mb, "script_duration_seconds",
+	    &ctx->metrics.script);
+}
+
+/* Send the metrics in the Prometheus text exposition format.
+ * The reply is not subject to the control queue limit, so with many
+ * interfaces it can be large; size it up front to avoid regrowing it. */
+int
+metrics_send(struct fd_list *fd)
+{
+	struct metrics_buf mb;
+	const struct interface *ifp;
+
+	memset(&mb, 0, sizeof(mb));
+	mb.size = MET_BUF_LEN;
+	TAILQ_FOREACH(ifp, fd->ctx->ifaces, next)
+		mb.size += MET_MAX * MET_IFLINE_LEN;
+	if ((mb.buf = malloc(mb.size)) == NULL)
+		return -1;
+	if (metrics_print(&mb, fd->ctx) == -1 ||
+	    control_queue(fd, NULL, mb.buf, mb.len + 1, 1) == -1)
+	{
+		free(mb.buf);
+		return -1;
+	}
+	return 0;
+}
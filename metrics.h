@@ -0,0 +1,67 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+/* Packet counters kept globally and per interface */
+#define MET_DHCP_RX		0
+#define MET_ARP_RX		1
+#define MET_ND_RX		2
+#define MET_DHCP_DROP		3
+#define MET_ARP_DROP		4
+#define MET_ND_DROP		5
+#define MET_MAX			6
+
+/* Latency histogram bucket upper bounds in milliseconds */
+#define MET_HIST_BOUNDS		1, 5, 10, 50, 100, 500, 1000, 5000, 10000
+#define MET_HIST_LEN		9
+
+struct metrics_hist {
+	unsigned long long bucket[MET_HIST_LEN + 1]; /* last is +Inf */
+	unsigned long long count;
+	unsigned long long sum_us;
+};
+
+struct metrics {
+	unsigned long long counter[MET_MAX];
+	struct metrics_hist script;
+};
+
+struct dhcpcd_ctx;
+struct interface;
+struct fd_list;
+
+void metrics_inc(struct dhcpcd_ctx *, struct interface *, unsigned int);
+void metrics_hist_add(struct metrics_hist *, const struct timeval *);
+int metrics_send(struct fd_list *);
+
+#endif
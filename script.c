@@ -559,7 +559,7 @@ send_interface1(struct fd_list *fd, const struct interface *iface,
 		free(s);
 		return -1;
 	}
-	retval = control_queue(fd, s, elen, 1);
+	retval = control_queue(fd, NULL, s, elen, 1);
 	ep = env;
 	while (*ep)
 		free(*ep++);
@@ -567,52 +567,128 @@ send_interface1(struct fd_list *fd, const struct interface *iface,
 	return retval;
 }
 
-int
-send_interface(struct fd_list *fd, const struct interface *ifp)
+/* The reasons describing the current state of the interface */
+#define IF_REASONS_MAX	4
+static size_t
+interface_reasons(const struct interface *ifp, const char **reasons)
 {
-	const char *reason;
-	int retval = 0;
-#ifdef INET
-	const struct dhcp_state *d;
-#endif
-#ifdef INET6
-	const struct dhcp6_state *d6;
-#endif
+	size_t n;
 
+	n = 0;
 	switch (ifp->carrier) {
 	case LINK_UP:
-		reason = "CARRIER";
+		reasons[n++] = "CARRIER";
 		break;
 	case LINK_DOWN:
-		reason = "NOCARRIER";
+		reasons[n++] = "NOCARRIER";
 		break;
 	default:
-		reason = "UNKNOWN";
+		reasons[n++] = "UNKNOWN";
 		break;
 	}
-	if (send_interface1(fd, ifp, reason) == -1)
-		retval = -1;
 #ifdef INET
-	if (D_STATE_RUNNING(ifp)) {
-		d = D_CSTATE(ifp);
-		if (send_interface1(fd, ifp, d->reason) == -1)
-			retval = -1;
-	}
+	if (D_STATE_RUNNING(ifp))
+		reasons[n++] = D_CSTATE(ifp)->reason;
 #endif
-
 #ifdef INET6
-	if (RS_STATE_RUNNING(ifp)) {
-		if (send_interface1(fd, ifp, "ROUTERADVERT") == -1)
+	if (RS_STATE_RUNNING(ifp))
+		reasons[n++] = "ROUTERADVERT";
+	if (D6_STATE_RUNNING(ifp))
+		reasons[n++] = D6_CSTATE(ifp)->reason;
+#endif
+	return n;
+}
+
+int
+send_interface(struct fd_list *fd, const struct interface *ifp)
+{
+	const char *reasons[IF_REASONS_MAX];
+	size_t i, n;
+	int retval = 0;
+
+	n = interface_reasons(ifp, reasons);
+	for (i = 0; i < n; i++) {
+		if (send_interface1(fd, ifp, reasons[i]) == -1)
 			retval = -1;
 	}
-	if (D6_STATE_RUNNING(ifp)) {
-		d6 = D6_CSTATE(ifp);
-		if (send_interface1(fd, ifp, d6->reason) == -1)
-			retval = -1;
+	return retval;
+}
+
+/* Append the env to buf as NULL terminated strings followed by
+ * an empty string to mark the end of the record. */
+static int
+append_env(char **buf, size_t *len, size_t *size, const char *const *env)
+{
+	const char *const *ep;
+	size_t l, need;
+	char *nbuf;
+
+	need = *len + 1;
+	for (ep = env; *ep; ep++)
+		need += strlen(*ep) + 1;
+	if (need > *size) {
+		l = *size ? *size : 1024;
+		while (l < need)
+			l *= 2;
+		if ((nbuf = realloc(*buf, l)) == NULL)
+			return -1;
+		*buf = nbuf;
+		*size = l;
 	}
-#endif
+	for (ep = env; *ep; ep++) {
+		l = strlen(*ep) + 1;
+		memcpy(*buf + *len, *ep, l);
+		*len += l;
+	}
+	(*buf)[(*len)++] = '\0';
+	return 0;
+}
 
-	return retval;
+/* Send the state of all interfaces as a single message */
+int
+send_interfaces(struct fd_list *fd)
+{
+	const struct interface *ifp;
+	const char *reasons[IF_REASONS_MAX];
+	char **env, **ep, *buf;
+	size_t i, n, len, size;
+	int retval;
+
+	/* Most interfaces fit in 2k, so try to allocate once */
+	len = 0;
+	TAILQ_FOREACH(ifp, fd->ctx->ifaces, next)
+		len++;
+	size = len * 2048;
+	if (size == 0)
+		size = 1;
+	if ((buf = malloc(size)) == NULL)
+		return -1;
+	len = 0;
+	TAILQ_FOREACH(ifp, fd->ctx->ifaces, next) {
+		n = interface_reasons(ifp, reasons);
+		for (i = 0; i < n; i++) {
+			/* make_env logs any error */
+			if (make_env(ifp, reasons[i], &env) == -1)
+				continue;
+			retval = append_env(&buf, &len, &size,
+			    (const char *const *)env);
+			ep = env;
+			while (*ep)
+				free(*ep++);
+			free(env);
+			if (retval == -1)
+				goto eexit;
+		}
+	}
+	if (len == 0)
+		buf[len++] = '\0';
+
+	if (control_queue(fd, NULL, buf, len, 1) == 0)
+		return 0;
+eexit:
+	syslog(LOG_ERR, "%s: %m", __func__);
+	free(buf);
+	return -1;
 }
 
 int
@@ -624,7 +700,8 @@ script_runreason(const struct interface *ifp, const char *reason)
 	size_t e, elen = 0;
 	pid_t pid;
 	int status = 0;
-	struct fd_list *fd;
+	struct fd_list *fd, *fdn;
+	struct timeval started, now;
 
 	if (ifp->options->script &&
 	    (ifp->options->script[0] == '\0' ||
@@ -678,6 +755,7 @@ script_runreason(const struct interface *ifp, const char *reason)
 	}
 	env[++elen] = NULL;
 
+	get_monotonic(&started);
 	pid = exec_script(ifp->ctx, argv, env);
 	if (pid == -1)
 		syslog(LOG_ERR, "%s: %s: %m", __func__, argv[0]);
@@ -698,12 +776,15 @@ script_runreason(const struct interface *ifp, const char *reason)
 		} else if (WIFSIGNALED(status))
 			syslog(LOG_ERR, "%s: %s: %s",
 			    __func__, argv[0], strsignal(WTERMSIG(status)));
+		get_monotonic(&now);
+		timersub(&now, &started, &now);
+		metrics_hist_add(&ifp->ctx->metrics.script, &now);
 	}
 
 	/* Send to our listeners */
 	bigenv = NULL;
 	status = 0;
-	TAILQ_FOREACH(fd, &ifp->ctx->control_fds, next) {
+	TAILQ_FOREACH_SAFE(fd, &ifp->ctx->control_fds, next, fdn) {
 		if (!(fd->flags & FD_LISTEN))
 			continue;
 		if (bigenv == NULL) {
@@ -715,7 +796,7 @@ script_runreason(const struct interface *ifp, const char *reason)
 				    break;
 			}
 		}
-		if (control_queue(fd, bigenv, elen, 1) == -1)
+		if (control_queue(fd, ifp->name, bigenv, elen, 1) == -1)
 			syslog(LOG_ERR, "%s: control_queue: %m", __func__);
 		else
 			status = 1;
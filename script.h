@@ -32,6 +32,7 @@
 
 void if_printoptions(void);
 int send_interface(struct fd_list *, const struct interface *);
+int send_interfaces(struct fd_list *);
 int script_runreason(const struct interface *, const char *);
 
 #endif
@@ -0,0 +1,107 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+unsigned long long bench_allocs;
+
+#ifdef BENCH_ALLOCS
+/* Count allocations by interposing on the glibc allocator.
+ * Memory is still released by the glibc free. */
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+
+void *
+malloc(size_t size)
+{
+
+	bench_allocs++;
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+
+	bench_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+
+	bench_allocs++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static const struct {
+	const char *name;
+	int (*func)(int, char **);
+} benches[] = {
+	{ "netlink",	bench_netlink },
+	{ "config",	bench_config },
+	{ "dhcp",	bench_dhcp },
+	{ NULL,		NULL },
+};
+
+static void
+usage(void)
+{
+	size_t i;
+
+	fprintf(stderr, "usage: bench [name [args ...]]\n");
+	for (i = 0; benches[i].name; i++)
+		fprintf(stderr, "\t%s\n", benches[i].name);
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+	int r;
+
+	r = 0;
+	for (i = 0; benches[i].name; i++) {
+		if (argc > 1 && strcmp(argv[1], benches[i].name) != 0)
+			continue;
+		if (benches[i].func(argc > 1 ? argc - 2 : 0,
+		    argc > 1 ? argv + 2 : NULL) == -1)
+			r = -1;
+		if (argc > 1)
+			return r;
+	}
+	if (argc > 1) {
+		usage();
+		return -1;
+	}
+	return r;
+}
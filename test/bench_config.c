@@ -0,0 +1,234 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Generate a dhcpcd.conf with many interface, ssid and profile blocks
+ * and a tree of custom option definitions, then time reading it and
+ * configuring an interface from each interface block as read_config
+ * does at startup and on reload.
+ * Allocations and heap use are reported where the C library allows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "../dhcpcd.h"
+#include "../if-options.h"
+#include "bench.h"
+
+#define CONFIG_BLOCKS	2000
+#define CONFIG_PASSES	10
+/* bench%u has to fit in IF_NAMESIZE */
+#define CONFIG_BLOCKS_MAX	1000000
+
+static int
+write_config(FILE *fp, size_t blocks)
+{
+	size_t i;
+
+	fprintf(fp,
+	    "hostname\n"
+	    "option domain_name_servers, domain_name, ntp_servers\n"
+	    "require dhcp_server_identifier\n"
+	    "slaac private\n"
+	    "define 224 encap bench\n"
+	    "encap 1 ipaddress bench_address\n"
+	    "encap 2 string bench_name\n"
+	    "encap 3 embed bench_tree\n"
+	    "embed uint16 bench_port\n"
+	    "embed array byte bench_flags\n"
+	    "define6 65000 encap bench6\n"
+	    "encap 1 ip6address bench6_address\n"
+	    "vendopt 32473 encap bench_vendor\n"
+	    "encap 1 string bench_vendor_name\n");
+	for (i = 0; i < blocks; i++) {
+		fprintf(fp,
+		    "\ninterface bench%zu\n"
+		    "static ip_address=10.%zu.%zu.1/24\n"
+		    "static routers=10.%zu.%zu.254\n"
+		    "metric %zu\n"
+		    "nooption ntp_servers\n"
+		    "define 225 array uint32 bench_if%zu\n",
+		    i, (i >> 8) & 0xff, i & 0xff, (i >> 8) & 0xff, i & 0xff,
+		    i, i);
+		fprintf(fp,
+		    "\nssid benchnet%zu\n"
+		    "static domain_name_servers=10.0.0.%zu\n"
+		    "\nprofile bench%zu\n"
+		    "static ip_address=192.168.%zu.%zu/16\n",
+		    i, i % 250 + 1, i, (i >> 8) & 0xff, i & 0xff);
+	}
+	return ferror(fp) ? -1 : 0;
+}
+
+static size_t
+heap_used(void)
+{
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+static void
+free_ctx(struct dhcpcd_ctx *ctx)
+{
+	int i;
+
+	free_config(ctx);
+	for (i = 0; i < ctx->ifcc; i++)
+		free(ctx->ifcv[i]);
+	free(ctx->ifcv);
+	ctx->ifcv = NULL;
+	ctx->ifcc = 0;
+}
+
+/* Read the config and each interface, as a reload does */
+static int
+pass(struct dhcpcd_ctx *ctx, size_t blocks, unsigned long long *ns,
+    unsigned long long *allocs, size_t *heap)
+{
+	struct if_options *ifo, **ifos;
+	char ifname[IF_NAMESIZE], ssid[IF_SSIDSIZE];
+	struct timespec start, end;
+	size_t base;
+	unsigned int i;
+	int r;
+
+	if ((ifos = calloc(blocks, sizeof(*ifos))) == NULL)
+		return -1;
+	r = -1;
+	base = heap_used();
+	*allocs -= bench_allocs;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if ((ifo = read_config(ctx, NULL, NULL, NULL, 0, NULL)) == NULL)
+		goto out;
+	free_options(ifo);
+	for (i = 0; i < blocks; i++) {
+		snprintf(ifname, sizeof(ifname), "bench%u", i);
+		snprintf(ssid, sizeof(ssid), "benchnet%u", i);
+		ifos[i] = read_config(ctx, ifname, ssid, NULL, 0, NULL);
+		if (ifos[i] == NULL)
+			goto out;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*allocs += bench_allocs;
+	*ns += bench_ns(&start, &end);
+	*heap = heap_used() - base;
+	r = 0;
+
+out:
+	for (i = 0; i < blocks; i++)
+		free_options(ifos[i]);
+	free(ifos);
+	free_ctx(ctx);
+	return r;
+}
+
+int
+bench_config(int argc, char **argv)
+{
+	struct dhcpcd_ctx ctx;
+	char file[] = "/tmp/bench_config.XXXXXX";
+	FILE *fp;
+	int fd, r;
+	size_t blocks, passes, i, heap;
+	unsigned long long ns, allocs;
+
+	blocks = CONFIG_BLOCKS;
+	passes = CONFIG_PASSES;
+	if (argc > 0)
+		blocks = strtoul(argv[0], NULL, 0);
+	if (argc > 1)
+		passes = strtoul(argv[1], NULL, 0);
+	if (blocks == 0 || passes == 0) {
+		fprintf(stderr, "config: nothing to do\n");
+		return -1;
+	}
+	if (blocks > CONFIG_BLOCKS_MAX) {
+		fprintf(stderr, "config: at most %d blocks\n",
+		    CONFIG_BLOCKS_MAX);
+		return -1;
+	}
+
+	if ((fd = mkstemp(file)) == -1) {
+		perror("mkstemp");
+		return -1;
+	}
+	if ((fp = fdopen(fd, "w")) == NULL ||
+	    write_config(fp, blocks) == -1 ||
+	    fclose(fp) == EOF)
+	{
+		perror(file);
+		unlink(file);
+		return -1;
+	}
+
+	/* Don't time syslog */
+	setlogmask(LOG_UPTO(LOG_EMERG));
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cffile = file;
+
+	r = 0;
+	ns = allocs = 0;
+	heap = 0;
+	for (i = 0; i < passes; i++) {
+		if (pass(&ctx, blocks, &ns, &allocs, &heap) == -1) {
+			fprintf(stderr, "config: read_config failed\n");
+			r = -1;
+			break;
+		}
+	}
+	unlink(file);
+	if (r == -1)
+		return -1;
+
+	printf("config: %zu interface, ssid and profile blocks\n", blocks);
+	printf("%-12s %8zu passes %10llu ns total %8.1f ns/interface\n",
+	    "read_config", passes, ns,
+	    (double)ns / (double)(passes * blocks));
+#ifdef BENCH_ALLOCS
+	printf("%-12s %8zu passes %10llu allocs %7.1f allocs/interface\n",
+	    "allocations", passes, allocs,
+	    (double)allocs / (double)(passes * blocks));
+#endif
+	if (heap)
+		printf("%-12s %8zu bytes %14.1f bytes/interface\n",
+		    "heap", heap, (double)heap / (double)blocks);
+	return 0;
+}
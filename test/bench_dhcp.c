@@ -0,0 +1,531 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Run DHCP OFFER and ACK messages through the receive path in a loop:
+ *   udp		valid_udp_packet and the checks of dhcp_handlepacket
+ *   get_option	get_option for every option we know of
+ *   validate	dhcp_handledhcp for an interface in the REQUEST state
+ *   dhcp_env	both passes of dhcp_env as the script environment does
+ *
+ * Accepting an ACK would bind the lease, so every message is validated
+ * as an OFFER which then takes the same checks and is ignored.
+ *
+ * Messages are synthesised unless a pcap file is given, in which case
+ * the IPv4 UDP packets to the DHCP client port are replayed.
+ * dhcp.c is included so we can reach its static functions.
+ */
+
+#include "bench.h"
+#include "capture.h"
+
+#ifdef INET
+
+#include "../dhcp.c"
+
+#define DHCP_PACKETS_MAX	64
+
+struct bench_packet {
+	const char *name;
+	struct udp_dhcp_packet *data;
+	size_t len;
+};
+
+static uint8_t *
+put_option(uint8_t *p, const uint8_t *e, uint8_t code,
+    const void *data, size_t len)
+{
+
+	if (p == NULL || len > 255 || p + 2 + len > e)
+		return NULL;
+	*p++ = code;
+	*p++ = (uint8_t)len;
+	memcpy(p, data, len);
+	return p + len;
+}
+
+/* Put an option, splitting it into instances of at most split bytes
+ * as RFC 3396 allows. */
+static uint8_t *
+put_option_split(uint8_t *p, const uint8_t *e, uint8_t code,
+    const uint8_t *data, size_t len, size_t split)
+{
+	size_t l;
+
+	while (p && len) {
+		l = len > split ? split : len;
+		p = put_option(p, e, code, data, l);
+		data += l;
+		len -= l;
+	}
+	return p;
+}
+
+static uint8_t *
+put_addr(uint8_t *p, const uint8_t *e, uint8_t code, in_addr_t addr)
+{
+	uint32_t u32;
+
+	u32 = htonl(addr);
+	return put_option(p, e, code, &u32, sizeof(u32));
+}
+
+static uint8_t *
+put_uint32(uint8_t *p, const uint8_t *e, uint8_t code, uint32_t u)
+{
+
+	u = htonl(u);
+	return put_option(p, e, code, &u, sizeof(u));
+}
+
+static uint8_t *
+put_end(uint8_t *p, const uint8_t *e)
+{
+
+	if (p == NULL || p >= e)
+		return NULL;
+	*p++ = DHO_END;
+	return p;
+}
+
+static void
+make_header(struct dhcp_message *dhcp, uint8_t type)
+{
+	static const uint8_t hwaddr[] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+	memset(dhcp, 0, sizeof(*dhcp));
+	dhcp->op = DHCP_BOOTREPLY;
+	dhcp->hwtype = ARPHRD_ETHER;
+	dhcp->hwlen = sizeof(hwaddr);
+	dhcp->xid = htonl(0x12345678 + type);
+	dhcp->yiaddr = htonl(0x0a000064);
+	memcpy(dhcp->chaddr, hwaddr, sizeof(hwaddr));
+	dhcp->cookie = htonl(MAGIC_COOKIE);
+}
+
+static uint8_t *
+put_lease(uint8_t *p, const uint8_t *e, uint8_t type)
+{
+	static const uint8_t dns[] = { 10, 0, 0, 1, 10, 0, 0, 2 };
+
+	p = put_option(p, e, DHO_MESSAGETYPE, &type, sizeof(type));
+	p = put_addr(p, e, DHO_SERVERID, 0x0a000001);
+	p = put_uint32(p, e, DHO_LEASETIME, 3600);
+	p = put_uint32(p, e, DHO_RENEWALTIME, 1800);
+	p = put_uint32(p, e, DHO_REBINDTIME, 3150);
+	p = put_addr(p, e, DHO_SUBNETMASK, 0xffffff00);
+	p = put_addr(p, e, DHO_ROUTER, 0x0a000001);
+	p = put_option(p, e, DHO_DNSSERVER, dns, sizeof(dns));
+	return put_option(p, e, DHO_DNSDOMAIN, "example.com", 11);
+}
+
+static size_t
+make_small(struct dhcp_message *dhcp, uint8_t type)
+{
+	uint8_t *p, *e;
+
+	make_header(dhcp, type);
+	p = dhcp->options;
+	e = p + sizeof(dhcp->options);
+	p = put_end(put_lease(p, e, type), e);
+	return p ? (size_t)(p - (uint8_t *)dhcp) : 0;
+}
+
+/* An ACK which fills the options, boot file and server name fields.
+ * The search list and classless routes are split over several options
+ * and the search list carries on into the overloaded fields. */
+static size_t
+make_max(struct dhcp_message *dhcp)
+{
+	uint8_t search[1024], routes[256], ntp[64], overload;
+	uint8_t *p, *e, *sp, *rp;
+	size_t i, sl;
+	int n;
+
+	make_header(dhcp, DHCP_ACK);
+
+	sp = search;
+	for (i = 0; i < 48; i++) {
+		n = snprintf((char *)sp + 1, 16, "site%zu", i);
+		*sp = (uint8_t)n;
+		sp += n + 1;
+		memcpy(sp, "\007example\003com", 13);
+		sp += 13;
+	}
+	sl = (size_t)(sp - search);
+
+	rp = routes;
+	for (i = 0; i < 24; i++) {
+		*rp++ = 24;
+		*rp++ = 10;
+		*rp++ = (uint8_t)(i + 1);
+		*rp++ = 0;
+		memcpy(rp, "\012\000\000\001", 4);
+		rp += 4;
+	}
+	for (i = 0; i < sizeof(ntp); i += 4) {
+		memcpy(ntp + i, "\012\000\000", 3);
+		ntp[i + 3] = (uint8_t)(i / 4 + 1);
+	}
+
+	p = dhcp->options;
+	e = p + sizeof(dhcp->options);
+	overload = 3;
+	p = put_option(p, e, DHO_OPTIONSOVERLOADED,
+	    &overload, sizeof(overload));
+	p = put_lease(p, e, DHCP_ACK);
+	p = put_option(p, e, DHO_HOSTNAME, "bench-client", 12);
+	p = put_option_split(p, e, DHO_CSR, routes,
+	    (size_t)(rp - routes), 64);
+	p = put_option(p, e, DHO_NTPSERVER, ntp, sizeof(ntp));
+	/* Most of the search list goes into the options field */
+	i = sl - 180;
+	p = put_option_split(p, e, DHO_DNSSEARCH, search, i, 255);
+	p = put_end(p, e);
+	if (p == NULL)
+		return 0;
+
+	/* and the rest into the boot file and server name fields */
+	p = dhcp->bootfile;
+	e = p + sizeof(dhcp->bootfile);
+	p = put_end(put_option(p, e, DHO_DNSSEARCH, search + i, 120), e);
+	if (p == NULL)
+		return 0;
+	p = dhcp->servername;
+	e = p + sizeof(dhcp->servername);
+	p = put_end(put_option(p, e, DHO_DNSSEARCH, search + i + 120, 60), e);
+	return p ? sizeof(*dhcp) : 0;
+}
+
+static int
+add_packet(struct bench_packet *pkts, size_t *len, const char *name,
+    const struct dhcp_message *dhcp, size_t dlen)
+{
+	struct in_addr src, dst;
+
+	if (dlen == 0) {
+		fprintf(stderr, "dhcp: %s does not fit\n", name);
+		return -1;
+	}
+	src.s_addr = htonl(0x0a000001);
+	dst.s_addr = INADDR_BROADCAST;
+	pkts[*len].name = name;
+	pkts[*len].data = dhcp_makeudppacket(&pkts[*len].len,
+	    (const uint8_t *)dhcp, dlen, src, dst);
+	if (pkts[*len].data == NULL)
+		return -1;
+	(*len)++;
+	return 0;
+}
+
+static int
+synth_packets(struct bench_packet *pkts, size_t *len)
+{
+	struct dhcp_message dhcp;
+
+	*len = 0;
+	if (add_packet(pkts, len, "offer", &dhcp,
+	    make_small(&dhcp, DHCP_OFFER)) == -1 ||
+	    add_packet(pkts, len, "ack", &dhcp,
+	    make_small(&dhcp, DHCP_ACK)) == -1 ||
+	    add_packet(pkts, len, "ack-max", &dhcp, make_max(&dhcp)) == -1)
+		return -1;
+	return 0;
+}
+
+/* Load the DHCP replies from a pcap file */
+static int
+load_packets(const char *file, struct bench_packet *pkts, size_t *len)
+{
+	struct capture cap;
+	struct capture_frame f;
+	const struct ip *ip;
+	struct udphdr udp;
+	int r;
+
+	if (capture_open(&cap, file) == -1) {
+		perror(file);
+		return -1;
+	}
+	*len = 0;
+	r = 0;
+	while (*len < DHCP_PACKETS_MAX && (r = capture_read(&cap, &f)) == 1) {
+		ip = (const struct ip *)(void *)f.data;
+		if (f.proto != ETHERTYPE_IP ||
+		    f.len < sizeof(*ip) + sizeof(udp) ||
+		    f.len > udp_dhcp_len ||
+		    ip->ip_v != IPVERSION || ip->ip_p != IPPROTO_UDP)
+			continue;
+		memcpy(&udp, f.data + (ip->ip_hl << 2), sizeof(udp));
+		if (ntohs(udp.uh_dport) != DHCP_CLIENT_PORT)
+			continue;
+		if ((pkts[*len].data = calloc(1, udp_dhcp_len)) == NULL) {
+			r = -1;
+			break;
+		}
+		memcpy(pkts[*len].data, f.data, f.len);
+		pkts[*len].len = f.len;
+		pkts[*len].name = "captured";
+		(*len)++;
+	}
+	if (r == -1)
+		perror(file);
+	capture_close(&cap);
+	if (r == -1)
+		return -1;
+	if (*len == 0) {
+		fprintf(stderr, "%s: no DHCP replies\n", file);
+		return -1;
+	}
+	return 0;
+}
+
+struct bench_stage {
+	const char *name;
+	unsigned long long ns;
+	unsigned long long allocs;
+};
+
+#define STAGE_UDP	0
+#define STAGE_OPTION	1
+#define STAGE_VALIDATE	2
+#define STAGE_ENV	3
+#define STAGE_MAX	4
+
+static void
+stage_start(struct bench_stage *st, struct timespec *ts)
+{
+
+	st->allocs -= bench_allocs;
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static void
+stage_end(struct bench_stage *st, const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	st->allocs += bench_allocs;
+	st->ns += bench_ns(start, &end);
+}
+
+/* Rewrite the message type so the message is validated as an OFFER */
+static int
+make_offer(struct dhcpcd_ctx *ctx, struct dhcp_message *dhcp)
+{
+	const uint8_t *p;
+	size_t len;
+
+	p = get_option(ctx, dhcp, DHO_MESSAGETYPE, &len);
+	if (p == NULL || len != 1 || (*p != DHCP_OFFER && *p != DHCP_ACK) ||
+	    p < (const uint8_t *)dhcp || p >= (const uint8_t *)(dhcp + 1))
+		return -1;
+	((uint8_t *)dhcp)[p - (const uint8_t *)dhcp] = DHCP_OFFER;
+	return 0;
+}
+
+static int
+replay(struct interface *ifp, const struct bench_packet *pkt,
+    size_t iterations)
+{
+	struct dhcpcd_ctx *ctx = ifp->ctx;
+	struct dhcp_state *state = D_STATE(ifp);
+	struct bench_stage stages[STAGE_MAX] = {
+		{ "udp", 0, 0 },
+		{ "get_option", 0, 0 },
+		{ "validate", 0, 0 },
+		{ "dhcp_env", 0, 0 },
+	};
+	struct dhcp_message *dhcp, *offer;
+	struct timespec ts;
+	struct in_addr from;
+	const uint8_t *pp;
+	const struct dhcp_opt *opt;
+	size_t i, j, bytes, found;
+	ssize_t e;
+	char **env;
+	int validate;
+
+	dhcp = malloc(sizeof(*dhcp));
+	offer = malloc(sizeof(*offer));
+	if (dhcp == NULL || offer == NULL) {
+		free(dhcp);
+		free(offer);
+		return -1;
+	}
+
+	found = 0;
+	validate = 1;
+	for (i = 0; i < iterations; i++) {
+		stage_start(&stages[STAGE_UDP], &ts);
+		if (valid_udp_packet((const uint8_t *)pkt->data, pkt->len,
+		    &from, 0) == -1)
+			goto invalid;
+		bytes = get_udp_data(&pp, (const uint8_t *)pkt->data);
+		if (bytes > sizeof(*dhcp))
+			goto invalid;
+		memset(dhcp, 0, sizeof(*dhcp));
+		memcpy(dhcp, pp, bytes);
+		if (dhcp->cookie != htonl(MAGIC_COOKIE) ||
+		    memcmp(dhcp->chaddr, ifp->hwaddr, ifp->hwlen))
+			goto invalid;
+		stage_end(&stages[STAGE_UDP], &ts);
+
+		stage_start(&stages[STAGE_OPTION], &ts);
+		for (j = 0, opt = ctx->dhcp_opts;
+		    j < ctx->dhcp_opts_len;
+		    j++, opt++)
+		{
+			if (get_option(ctx, dhcp, opt->option, &bytes))
+				found++;
+		}
+		stage_end(&stages[STAGE_OPTION], &ts);
+
+		memcpy(offer, dhcp, sizeof(*offer));
+		if (validate && make_offer(ctx, offer) == -1)
+			validate = 0;
+		if (validate) {
+			state->xid = ntohl(offer->xid);
+			stage_start(&stages[STAGE_VALIDATE], &ts);
+			dhcp_handledhcp(ifp, &offer, &from);
+			stage_end(&stages[STAGE_VALIDATE], &ts);
+			if (offer == NULL)
+				break;
+		}
+
+		stage_start(&stages[STAGE_ENV], &ts);
+		e = dhcp_env(NULL, NULL, dhcp, ifp);
+		if (e > 0 && (env = calloc((size_t)e + 1, sizeof(*env)))) {
+			e = dhcp_env(env, "new", dhcp, ifp);
+			for (j = 0; e > 0 && j < (size_t)e; j++)
+				free(env[j]);
+			free(env);
+		}
+		stage_end(&stages[STAGE_ENV], &ts);
+	}
+	free(dhcp);
+	free(offer);
+
+	printf("dhcp: %s, %zu bytes, %zu options found\n",
+	    pkt->name, pkt->len, found / iterations);
+	for (i = 0; i < STAGE_MAX; i++) {
+		if (i == STAGE_VALIDATE && !validate) {
+			printf("%-12s not an OFFER or ACK\n", stages[i].name);
+			continue;
+		}
+		printf("%-12s %8zu pkts %10llu ns total %8.1f ns/pkt",
+		    stages[i].name, iterations, stages[i].ns,
+		    (double)stages[i].ns / (double)iterations);
+#ifdef BENCH_ALLOCS
+		printf(" %6.1f allocs/pkt",
+		    (double)stages[i].allocs / (double)iterations);
+#endif
+		printf("\n");
+	}
+	return 0;
+
+invalid:
+	fprintf(stderr, "dhcp: %s: invalid packet\n", pkt->name);
+	free(dhcp);
+	free(offer);
+	return -1;
+}
+
+int
+bench_dhcp(int argc, char **argv)
+{
+	struct dhcpcd_ctx ctx;
+	struct interface ifp;
+	struct dhcp_state state;
+	struct if_options *ifo;
+	struct bench_packet pkts[DHCP_PACKETS_MAX];
+	size_t pkts_len, iterations, i;
+	int r;
+
+	iterations = BENCH_ITERATIONS;
+	if (argc > 0)
+		r = load_packets(argv[0], pkts, &pkts_len);
+	else
+		r = synth_packets(pkts, &pkts_len);
+	if (r == -1)
+		return -1;
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if (iterations == 0)
+		iterations = 1;
+
+	/* Don't time syslog */
+	setlogmask(LOG_UPTO(LOG_EMERG));
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cffile = "/dev/null";
+	if ((ifo = read_config(&ctx, NULL, NULL, NULL, 0, NULL)) == NULL)
+		return -1;
+	free_options(ifo);
+	if ((ifo = read_config(&ctx, "bench0", NULL, NULL, 0, NULL)) == NULL)
+		return -1;
+	add_option_mask(ifo->requiremask, DHO_SERVERID);
+	/* Our messages are not authenticated */
+	ifo->auth.options &= ~DHCPCD_AUTH_REQUIRE;
+
+	memset(&ifp, 0, sizeof(ifp));
+	strlcpy(ifp.name, "bench0", sizeof(ifp.name));
+	ifp.ctx = &ctx;
+	ifp.options = ifo;
+	ifp.family = ARPHRD_ETHER;
+	ifp.hwlen = 6;
+	memcpy(ifp.hwaddr, "\002\000\000\000\000\001", ifp.hwlen);
+	memset(&state, 0, sizeof(state));
+	state.state = DHS_REQUEST;
+	state.raw_fd = -1;
+	ifp.if_data[IF_DATA_DHCP] = &state;
+
+	r = 0;
+	for (i = 0; i < pkts_len; i++) {
+		if (replay(&ifp, &pkts[i], iterations) == -1)
+			r = -1;
+		free(pkts[i].data);
+	}
+
+	free_options(ifo);
+	free(ctx.opt_buffer);
+	free_config(&ctx);
+	return r;
+}
+
+#else
+
+int
+bench_dhcp(int argc, char **argv)
+{
+
+	printf("dhcp: not supported without INET\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Replay a storm of RTM_NEWLINK and RTM_NEWADDR messages through a
+ * datagram socket pair and compare the cost of receiving them with
+ * a peek, allocate and receive per message against a single recvmsg
+ * into a persistent buffer as get_netlink in if-linux.c does.
+ *
+ * Messages are synthesised unless a file of recorded messages is given.
+ * The file holds raw netlink messages back to back, each one replayed
+ * as a single datagram.
+ */
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#ifdef __linux__
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+
+#define NLBUFLEN	32768
+#define BATCH		64
+
+struct nlmsg {
+	void *data;
+	size_t len;
+};
+
+static void
+add_attr(struct nlmsghdr *n, unsigned short type, const void *data, size_t len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)(void *)
+	    (((unsigned char *)n) + NLMSG_ALIGN(n->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = (unsigned short)RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static void
+make_link(struct nlmsghdr *n, int idx)
+{
+	struct ifinfomsg *ifi;
+	char ifname[IF_NAMESIZE];
+	unsigned char hwaddr[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	unsigned int mtu = 1500;
+
+	n->nlmsg_len = NLMSG_LENGTH(sizeof(*ifi));
+	n->nlmsg_type = RTM_NEWLINK;
+	ifi = NLMSG_DATA(n);
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_type = ARPHRD_ETHER;
+	ifi->ifi_index = idx;
+	ifi->ifi_flags = IFF_UP | IFF_RUNNING | IFF_BROADCAST | IFF_MULTICAST;
+	snprintf(ifname, sizeof(ifname), "bench%d", idx);
+	add_attr(n, IFLA_IFNAME, ifname, strlen(ifname) + 1);
+	hwaddr[4] = (unsigned char)(idx >> 8);
+	hwaddr[5] = (unsigned char)idx;
+	add_attr(n, IFLA_ADDRESS, hwaddr, sizeof(hwaddr));
+	add_attr(n, IFLA_MTU, &mtu, sizeof(mtu));
+}
+
+static void
+make_addr(struct nlmsghdr *n, int idx)
+{
+	struct ifaddrmsg *ifa;
+	struct in_addr addr;
+	char label[IF_NAMESIZE];
+
+	n->nlmsg_len = NLMSG_LENGTH(sizeof(*ifa));
+	n->nlmsg_type = RTM_NEWADDR;
+	ifa = NLMSG_DATA(n);
+	ifa->ifa_family = AF_INET;
+	ifa->ifa_prefixlen = 24;
+	ifa->ifa_index = (unsigned int)idx;
+	addr.s_addr = htonl(0x0a000000U | (unsigned int)idx);
+	add_attr(n, IFA_ADDRESS, &addr, sizeof(addr));
+	add_attr(n, IFA_LOCAL, &addr, sizeof(addr));
+	snprintf(label, sizeof(label), "bench%d", idx);
+	add_attr(n, IFA_LABEL, label, strlen(label) + 1);
+}
+
+static struct nlmsg *
+synth_msgs(size_t *len)
+{
+	struct nlmsg *msgs;
+	struct nlmsghdr *n;
+	size_t i;
+
+	*len = 256;
+	if ((msgs = calloc(*len, sizeof(*msgs))) == NULL)
+		return NULL;
+	for (i = 0; i < *len; i++) {
+		if ((n = calloc(1, 512)) == NULL)
+			return NULL;
+		if (i % 2)
+			make_addr(n, (int)(i / 2) + 1);
+		else
+			make_link(n, (int)(i / 2) + 1);
+		msgs[i].data = n;
+		msgs[i].len = n->nlmsg_len;
+	}
+	return msgs;
+}
+
+static struct nlmsg *
+load_msgs(const char *file, size_t *len)
+{
+	int fd;
+	struct stat st;
+	unsigned char *buf;
+	struct nlmsghdr *n;
+	struct nlmsg *msgs, *nmsgs;
+	size_t left;
+	ssize_t bytes;
+
+	if ((fd = open(file, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		perror(file);
+		return NULL;
+	}
+	buf = malloc((size_t)st.st_size);
+	if (buf == NULL ||
+	    (bytes = read(fd, buf, (size_t)st.st_size)) != st.st_size)
+	{
+		fprintf(stderr, "%s: short read\n", file);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	msgs = NULL;
+	*len = 0;
+	left = (size_t)bytes;
+	for (n = (struct nlmsghdr *)(void *)buf;
+	    NLMSG_OK(n, left);
+	    n = NLMSG_NEXT(n, left))
+	{
+		nmsgs = realloc(msgs, sizeof(*msgs) * (*len + 1));
+		if (nmsgs == NULL) {
+			free(msgs);
+			return NULL;
+		}
+		msgs = nmsgs;
+		msgs[*len].data = n;
+		msgs[*len].len = n->nlmsg_len;
+		(*len)++;
+	}
+	if (*len == 0) {
+		fprintf(stderr, "%s: no netlink messages\n", file);
+		free(msgs);
+		return NULL;
+	}
+	return msgs;
+}
+
+/* Walk the attributes like link_netlink and link_addr would. */
+static size_t
+parse_msg(void *buf, size_t len)
+{
+	struct nlmsghdr *n;
+	struct rtattr *rta;
+	size_t hlen, attrs;
+	unsigned int rlen;
+
+	attrs = 0;
+	for (n = buf; NLMSG_OK(n, len); n = NLMSG_NEXT(n, len)) {
+		if (n->nlmsg_type == RTM_NEWLINK)
+			hlen = sizeof(struct ifinfomsg);
+		else if (n->nlmsg_type == RTM_NEWADDR)
+			hlen = sizeof(struct ifaddrmsg);
+		else
+			continue;
+		rta = (struct rtattr *)(void *)
+		    ((unsigned char *)NLMSG_DATA(n) + NLMSG_ALIGN(hlen));
+		rlen = (unsigned int)NLMSG_PAYLOAD(n, hlen);
+		for (; RTA_OK(rta, rlen); rta = RTA_NEXT(rta, rlen))
+			attrs++;
+	}
+	return attrs;
+}
+
+/* The old get_netlink: size the message, allocate, receive, free. */
+static ssize_t
+recv_peek(int fd, size_t *attrs)
+{
+	char *buf, *nbuf;
+	size_t buflen;
+	ssize_t bytes;
+
+	buf = NULL;
+	buflen = 0;
+	bytes = recv(fd, NULL, 0, MSG_PEEK | MSG_DONTWAIT | MSG_TRUNC);
+	if (bytes == -1)
+		return -1;
+	if (buflen < (size_t)bytes) {
+		buflen = (size_t)bytes + 1;
+		if ((nbuf = realloc(buf, buflen)) == NULL)
+			return -1;
+		buf = nbuf;
+	}
+	bytes = recv(fd, buf, buflen, 0);
+	if (bytes > 0)
+		*attrs += parse_msg(buf, (size_t)bytes);
+	free(buf);
+	return bytes;
+}
+
+/* The new get_netlink: one recvmsg into a persistent buffer. */
+static ssize_t
+recv_once(int fd, struct iovec *iov, size_t *attrs)
+{
+	struct msghdr msg;
+	ssize_t bytes;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+	bytes = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_TRUNC);
+	if (bytes > 0 && !(msg.msg_flags & MSG_TRUNC))
+		*attrs += parse_msg(iov->iov_base, (size_t)bytes);
+	return bytes;
+}
+
+static int
+replay(const char *name, const struct nlmsg *msgs, size_t msgs_len,
+    size_t iterations, int once)
+{
+	int fds[2], sz;
+	struct iovec iov;
+	struct timespec start, end;
+	unsigned long long ns;
+	size_t sent, i, j, n, attrs;
+	ssize_t bytes;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	sz = 1024 * 1024;
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+	setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &sz, sizeof(sz));
+	iov.iov_len = NLBUFLEN;
+	if ((iov.iov_base = malloc(iov.iov_len)) == NULL) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	ns = 0;
+	attrs = 0;
+	for (sent = 0; sent < iterations; sent += n) {
+		n = iterations - sent;
+		if (n > BATCH)
+			n = BATCH;
+		for (i = 0; i < n; i++) {
+			j = (sent + i) % msgs_len;
+			if (send(fds[0], msgs[j].data, msgs[j].len, 0) == -1) {
+				perror("send");
+				goto eexit;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < n; i++) {
+			if (once)
+				bytes = recv_once(fds[1], &iov, &attrs);
+			else
+				bytes = recv_peek(fds[1], &attrs);
+			if (bytes == -1) {
+				perror("recv");
+				goto eexit;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns += bench_ns(&start, &end);
+	}
+
+	printf("%-12s %8zu msgs %10llu ns total %8.1f ns/msg (%zu attrs)\n",
+	    name, iterations, ns, (double)ns / (double)iterations, attrs);
+	free(iov.iov_base);
+	close(fds[0]);
+	close(fds[1]);
+	return 0;
+
+eexit:
+	free(iov.iov_base);
+	close(fds[0]);
+	close(fds[1]);
+	return -1;
+}
+
+int
+bench_netlink(int argc, char **argv)
+{
+	struct nlmsg *msgs;
+	size_t msgs_len, iterations;
+
+	iterations = BENCH_ITERATIONS;
+	if (argc > 0)
+		msgs = load_msgs(argv[0], &msgs_len);
+	else
+		msgs = synth_msgs(&msgs_len);
+	if (msgs == NULL)
+		return -1;
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+
+	printf("netlink: replaying %zu distinct messages\n", msgs_len);
+	if (replay("peek+alloc", msgs, msgs_len, iterations, 0) == -1 ||
+	    replay("recvmsg", msgs, msgs_len, iterations, 1) == -1)
+		return -1;
+	return 0;
+}
+
+#else
+
+int
+bench_netlink(int argc, char **argv)
+{
+
+	printf("netlink: not supported on this platform\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <net/ethernet.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAP_ETHERNET		1
+#define PCAP_RAW		101
+#define PCAP_LINUX_SLL		113
+#define PCAP_IPV4		228
+#define PCAP_IPV6		229
+
+#define PCAP_SNAPLEN_MAX	262144
+
+#ifndef ETHERTYPE_VLAN
+#define ETHERTYPE_VLAN		0x8100
+#endif
+
+static uint32_t
+pcap32(const uint8_t *p, int swap)
+{
+	uint32_t u;
+
+	memcpy(&u, p, sizeof(u));
+	if (swap)
+		u = ((u & 0xff) << 24) | ((u & 0xff00) << 8) |
+		    ((u >> 8) & 0xff00) | (u >> 24);
+	return u;
+}
+
+static uint16_t
+get16(const uint8_t *p)
+{
+
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+int
+capture_open(struct capture *cap, const char *file)
+{
+	uint8_t hdr[24];
+	uint32_t magic;
+
+	memset(cap, 0, sizeof(*cap));
+	cap->file = file;
+	if ((cap->fp = fopen(file, "r")) == NULL)
+		return -1;
+	if (fread(hdr, sizeof(hdr), 1, cap->fp) != 1)
+		goto bad;
+	magic = pcap32(hdr, 0);
+	cap->swap = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC;
+	magic = pcap32(hdr, cap->swap);
+	if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC)
+		goto bad;
+	cap->nsec = magic == PCAP_MAGIC_NSEC;
+	cap->link = pcap32(hdr + 20, cap->swap);
+	switch (cap->link) {
+	case PCAP_ETHERNET:
+	case PCAP_LINUX_SLL:
+	case PCAP_RAW:
+	case PCAP_IPV4:
+	case PCAP_IPV6:
+		return 0;
+	}
+	fclose(cap->fp);
+	cap->fp = NULL;
+	errno = EPROTONOSUPPORT;
+	return -1;
+
+bad:
+	fclose(cap->fp);
+	cap->fp = NULL;
+	errno = EINVAL;
+	return -1;
+}
+
+/* Returns 1 if a frame was read, 0 at the end of the file */
+int
+capture_read(struct capture *cap, struct capture_frame *f)
+{
+	uint8_t rec[16], *nbuf;
+	uint32_t caplen;
+	size_t skip;
+
+	if (fread(rec, sizeof(rec), 1, cap->fp) != 1)
+		return ferror(cap->fp) ? -1 : 0;
+	caplen = pcap32(rec + 8, cap->swap);
+	if (caplen > PCAP_SNAPLEN_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (caplen > cap->buflen) {
+		if ((nbuf = realloc(cap->buf, caplen)) == NULL)
+			return -1;
+		cap->buf = nbuf;
+		cap->buflen = caplen;
+	}
+	if (caplen && fread(cap->buf, caplen, 1, cap->fp) != 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	f->when.tv_sec = (time_t)pcap32(rec, cap->swap);
+	f->when.tv_usec = (suseconds_t)pcap32(rec + 4, cap->swap);
+	if (cap->nsec)
+		f->when.tv_usec /= 1000;
+	f->proto = 0;
+	f->hwsrc = NULL;
+	skip = 0;
+	switch (cap->link) {
+	case PCAP_ETHERNET:
+		if (caplen < ETHER_HDR_LEN)
+			break;
+		f->hwsrc = cap->buf + ETHER_ADDR_LEN;
+		f->proto = get16(cap->buf + 12);
+		skip = ETHER_HDR_LEN;
+		if (f->proto == ETHERTYPE_VLAN && caplen >= skip + 4) {
+			f->proto = get16(cap->buf + skip + 2);
+			skip += 4;
+		}
+		break;
+	case PCAP_LINUX_SLL:
+		if (caplen < 16)
+			break;
+		if (get16(cap->buf + 4) == ETHER_ADDR_LEN)
+			f->hwsrc = cap->buf + 6;
+		f->proto = get16(cap->buf + 14);
+		skip = 16;
+		break;
+	default:
+		if (caplen == 0)
+			break;
+		if (cap->buf[0] >> 4 == 4)
+			f->proto = ETHERTYPE_IP;
+		else if (cap->buf[0] >> 4 == 6)
+			f->proto = ETHERTYPE_IPV6;
+		break;
+	}
+	if (skip > caplen)
+		skip = caplen;
+	f->data = cap->buf + skip;
+	f->len = caplen - skip;
+	return 1;
+}
+
+void
+capture_close(struct capture *cap)
+{
+
+	if (cap->fp)
+		fclose(cap->fp);
+	free(cap->buf);
+	memset(cap, 0, sizeof(*cap));
+}
@@ -0,0 +1,62 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <sys/time.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* A minimal reader for pcap files, enough to replay captured traffic
+ * without needing libpcap. */
+struct capture {
+	FILE *fp;
+	const char *file;
+	uint32_t link;
+	int swap;
+	int nsec;
+	uint8_t *buf;
+	size_t buflen;
+};
+
+/* A captured frame with the link layer header removed.
+ * data points into the capture buffer and is valid until the next read. */
+struct capture_frame {
+	struct timeval when;
+	uint16_t proto;		/* ethertype, 0 if unknown */
+	const uint8_t *hwsrc;	/* source hardware address or NULL */
+	uint8_t *data;
+	size_t len;
+};
+
+int capture_open(struct capture *, const char *);
+int capture_read(struct capture *, struct capture_frame *);
+void capture_close(struct capture *);
+
+#endif
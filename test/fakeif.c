@@ -0,0 +1,520 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/route.h>
+#include <netinet/in.h>
+#include <netinet/if_ether.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip6.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../common.h"
+#include "../dhcp.h"
+#include "../eloop.h"
+#include "../if.h"
+#include "../ipv4.h"
+#include "../ipv6.h"
+#include "../ipv6nd.h"
+#include "fakeif.h"
+
+/* Our ends of the raw sockets of an interface, found by its index
+ * so there is no search however many interfaces there are */
+#define FAKEIF_LINK_IP		0
+#define FAKEIF_LINK_ARP		1
+#define FAKEIF_LINK_MAX		2
+struct fakeif_link {
+	int fd[FAKEIF_LINK_MAX];
+};
+
+/* Address changes waiting to be reported, as netlink would */
+struct fakeif_notice {
+	TAILQ_ENTRY(fakeif_notice) next;
+	int cmd;
+	int family;
+	char ifname[IF_NAMESIZE];
+	struct in_addr addr;
+	struct in_addr net;
+	struct in_addr brd;
+	struct in6_addr addr6;
+};
+TAILQ_HEAD(fakeif_notice_head, fakeif_notice);
+
+struct fakeif_stats fakeif_stats;
+
+static struct fakeif_link *links;
+static size_t links_len;
+static struct fakeif_notice_head notices =
+    TAILQ_HEAD_INITIALIZER(notices);
+static struct timeval clock_now;
+static fakeif_send_cb *send_cb;
+static void *send_cb_arg;
+static int nd_fd = -1;
+static unsigned int next_index = 1;
+
+static void
+fakeif_send(const struct interface *ifp, int tx, int protocol,
+    const void *data, size_t len)
+{
+
+	fakeif_stats.tx[tx]++;
+	if (send_cb)
+		send_cb(send_cb_arg, ifp, protocol, data, len);
+}
+
+/* Nothing is ready, so move time on to the next timeout */
+static void
+fakeif_idle(void *arg, const struct timeval *tv)
+{
+	struct dhcpcd_ctx *ctx = arg;
+	struct timeval next;
+
+	if (tv == NULL) {
+		eloop_exit(ctx->eloop, EXIT_SUCCESS);
+		return;
+	}
+	timeradd(&clock_now, tv, &next);
+	fakeif_settime(&next);
+}
+
+void
+fakeif_init(struct dhcpcd_ctx *ctx)
+{
+
+	memset(&fakeif_stats, 0, sizeof(fakeif_stats));
+	get_monotonic(&clock_now);
+	eloop_setclock(ctx->eloop, fakeif_clock, fakeif_idle, ctx);
+	if (ctx->ifaces == NULL) {
+		if ((ctx->ifaces = malloc(sizeof(*ctx->ifaces))) == NULL)
+			return;
+		TAILQ_INIT(ctx->ifaces);
+	}
+}
+
+void
+fakeif_free(struct dhcpcd_ctx *ctx)
+{
+	struct fakeif_notice *n;
+	size_t i, j;
+
+	for (i = 0; i < links_len; i++) {
+		for (j = 0; j < FAKEIF_LINK_MAX; j++) {
+			if (links[i].fd[j] != -1)
+				close(links[i].fd[j]);
+		}
+	}
+	free(links);
+	links = NULL;
+	links_len = 0;
+	while ((n = TAILQ_FIRST(&notices))) {
+		TAILQ_REMOVE(&notices, n, next);
+		free(n);
+	}
+	if (nd_fd != -1) {
+		eloop_event_delete(ctx->eloop, nd_fd, 0);
+		close(nd_fd);
+		nd_fd = -1;
+	}
+}
+
+void
+fakeif_setsend(fakeif_send_cb *cb, void *arg)
+{
+
+	send_cb = cb;
+	send_cb_arg = arg;
+}
+
+/* Add an Ethernet interface which is up and has a carrier.
+ * The daemon keeps its lease files by interface name, so a name the
+ * host already uses is refused rather than clobbering its lease. */
+struct interface *
+fakeif_new(struct dhcpcd_ctx *ctx, const char *ifname,
+    const unsigned char *hwaddr, uint8_t hwlen)
+{
+	struct interface *ifp;
+	unsigned char *d;
+
+	if (hwlen > HWADDR_LEN) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (if_nametoindex(ifname) != 0) {
+		errno = EEXIST;
+		return NULL;
+	}
+	if ((ifp = calloc(1, sizeof(*ifp))) == NULL)
+		return NULL;
+	ifp->ctx = ctx;
+	strlcpy(ifp->name, ifname, sizeof(ifp->name));
+	ifp->index = next_index++;
+	/* As if_discover does for a wired interface */
+	ifp->metric = 200 + ifp->index;
+	ifp->flags = IFF_UP | IFF_BROADCAST | IFF_MULTICAST | IFF_RUNNING;
+	ifp->family = ARPHRD_ETHER;
+	memcpy(ifp->hwaddr, hwaddr, hwlen);
+	ifp->hwlen = hwlen;
+	ifp->carrier = LINK_UP;
+	TAILQ_INSERT_TAIL(ctx->ifaces, ifp, next);
+	if_hashadd(ctx, ifp);
+
+	/* Use a DUID-LL from the first interface rather than
+	 * reading or writing the DUID file of the host. */
+	if (ctx->duid == NULL && (ctx->duid = malloc(4 + hwlen))) {
+		d = ctx->duid;
+		*d++ = 0;
+		*d++ = 3;
+		*d++ = 0;
+		*d++ = 1;
+		memcpy(d, hwaddr, hwlen);
+		ctx->duid_len = 4 + hwlen;
+	}
+	return ifp;
+}
+
+static void
+fakeif_ndread(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+	uint8_t buf[1500];
+	ssize_t len;
+
+	while ((len = read(nd_fd, buf, sizeof(buf))) != -1)
+		fakeif_send(NULL, FAKEIF_TX_ND, ETHERTYPE_IPV6,
+		    buf, (size_t)len);
+	if (errno != EAGAIN) {
+		syslog(LOG_ERR, "%s: %m", __func__);
+		eloop_event_delete(ctx->eloop, nd_fd, 0);
+	}
+}
+
+/* Give the ND code a socket which sends to us before it opens its own.
+ * Call this after ipv6_init. */
+int
+fakeif_ndopen(struct dhcpcd_ctx *ctx)
+{
+	int fds[2];
+
+	if (ctx->ipv6 == NULL || ctx->ipv6->nd_fd != -1) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	    0, fds) == -1)
+		return -1;
+	nd_fd = fds[0];
+	ctx->ipv6->nd_fd = fds[1];
+	/* The destination is in the packet info */
+	ctx->ipv6->sndhdr.msg_namelen = 0;
+	eloop_event_add(ctx->eloop, nd_fd, fakeif_ndread, ctx, NULL, NULL);
+	return 0;
+}
+
+/* Hand an IPv6 packet holding an ND message to the daemon as if it
+ * was read from the ND socket on ifp */
+int
+fakeif_ndrecv(struct interface *ifp, const void *data, size_t len)
+{
+	const struct ip6_hdr *ip6;
+	struct sockaddr_in6 from;
+	struct in6_pktinfo pkt;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	int hoplimit;
+	union {
+		struct cmsghdr hdr;
+		uint8_t buf[CMSG_SPACE(sizeof(pkt)) + CMSG_SPACE(sizeof(int))];
+	} control;
+
+	if (ifp->ctx->ipv6 == NULL ||
+	    len < sizeof(*ip6) + sizeof(struct icmp6_hdr))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	ip6 = data;
+	if (ip6->ip6_nxt != IPPROTO_ICMPV6) {
+		errno = EPROTONOSUPPORT;
+		return -1;
+	}
+
+	memset(&from, 0, sizeof(from));
+	from.sin6_family = AF_INET6;
+	from.sin6_addr = ip6->ip6_src;
+	from.sin6_scope_id = ifp->index;
+	iov.iov_base = UNCONST(ip6 + 1);
+	iov.iov_len = len - sizeof(*ip6);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &from;
+	msg.msg_namelen = sizeof(from);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.ipi6_addr = ip6->ip6_dst;
+	pkt.ipi6_ifindex = ifp->index;
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = IPPROTO_IPV6;
+	cm->cmsg_type = IPV6_PKTINFO;
+	cm->cmsg_len = CMSG_LEN(sizeof(pkt));
+	memcpy(CMSG_DATA(cm), &pkt, sizeof(pkt));
+	hoplimit = ip6->ip6_hlim;
+	cm = CMSG_NXTHDR(&msg, cm);
+	cm->cmsg_level = IPPROTO_IPV6;
+	cm->cmsg_type = IPV6_HOPLIMIT;
+	cm->cmsg_len = CMSG_LEN(sizeof(hoplimit));
+	memcpy(CMSG_DATA(cm), &hoplimit, sizeof(hoplimit));
+
+	ipv6nd_recvmsg(ifp->ctx, &msg, iov.iov_len);
+	return 0;
+}
+
+static int *
+fakeif_linkfd(const struct interface *ifp, int protocol)
+{
+	int l;
+
+	switch (protocol) {
+	case ETHERTYPE_IP:
+		l = FAKEIF_LINK_IP;
+		break;
+	case ETHERTYPE_ARP:
+		l = FAKEIF_LINK_ARP;
+		break;
+	default:
+		errno = EPROTONOSUPPORT;
+		return NULL;
+	}
+	if (ifp->index >= links_len) {
+		errno = ENOENT;
+		return NULL;
+	}
+	return &links[ifp->index].fd[l];
+}
+
+int
+fakeif_rawfd(const struct interface *ifp, int protocol)
+{
+	int *fd;
+
+	if ((fd = fakeif_linkfd(ifp, protocol)) == NULL)
+		return -1;
+	if (*fd == -1)
+		errno = ENOENT;
+	return *fd;
+}
+
+void
+fakeif_gettime(struct timeval *tv)
+{
+
+	*tv = clock_now;
+}
+
+void
+fakeif_settime(const struct timeval *tv)
+{
+
+	if (timercmp(tv, &clock_now, >))
+		clock_now = *tv;
+}
+
+int
+fakeif_clock(__unused void *arg, struct timeval *tv)
+{
+
+	*tv = clock_now;
+	return 0;
+}
+
+static void
+fakeif_notify(void *arg)
+{
+	struct dhcpcd_ctx *ctx = arg;
+	struct fakeif_notice *n;
+
+	while ((n = TAILQ_FIRST(&notices))) {
+		TAILQ_REMOVE(&notices, n, next);
+#ifdef INET
+		if (n->family == AF_INET)
+			ipv4_handleifa(ctx, n->cmd, NULL, n->ifname,
+			    &n->addr, &n->net, &n->brd);
+#endif
+#ifdef INET6
+		if (n->family == AF_INET6)
+			ipv6_handleifa(ctx, n->cmd, NULL, n->ifname,
+			    &n->addr6, 0);
+#endif
+		free(n);
+	}
+}
+
+static struct fakeif_notice *
+fakeif_notice(const struct interface *ifp, int family, int action)
+{
+	struct fakeif_notice *n;
+
+	if ((n = calloc(1, sizeof(*n))) == NULL)
+		return NULL;
+	n->cmd = action < 0 ? RTM_DELADDR : RTM_NEWADDR;
+	n->family = family;
+	strlcpy(n->ifname, ifp->name, sizeof(n->ifname));
+	if (TAILQ_FIRST(&notices) == NULL)
+		eloop_timeout_add_sec(ifp->ctx->eloop, 0,
+		    fakeif_notify, ifp->ctx);
+	TAILQ_INSERT_TAIL(&notices, n, next);
+	return n;
+}
+
+#ifdef INET
+int
+if_openrawsocket(struct interface *ifp, int protocol)
+{
+	struct fakeif_link *l;
+	size_t len, i, j;
+	int *fd, fds[2];
+
+	if (ifp->index >= links_len) {
+		len = links_len ? links_len : 16;
+		while (len <= ifp->index)
+			len *= 2;
+		if ((l = realloc(links, sizeof(*l) * len)) == NULL)
+			return -1;
+		for (i = links_len; i < len; i++) {
+			for (j = 0; j < FAKEIF_LINK_MAX; j++)
+				l[i].fd[j] = -1;
+		}
+		links = l;
+		links_len = len;
+	}
+	if ((fd = fakeif_linkfd(ifp, protocol)) == NULL)
+		return -1;
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	    0, fds) == -1)
+		return -1;
+	if (*fd != -1)
+		close(*fd);
+	*fd = fds[0];
+	return fds[1];
+}
+
+ssize_t
+if_sendrawpacket(const struct interface *ifp, int protocol,
+    const void *data, size_t len)
+{
+
+	fakeif_send(ifp, protocol == ETHERTYPE_ARP ?
+	    FAKEIF_TX_ARP : FAKEIF_TX_DHCP, protocol, data, len);
+	return (ssize_t)len;
+}
+
+int
+if_address(const struct interface *ifp, const struct in_addr *addr,
+    const struct in_addr *net, const struct in_addr *brd, int action)
+{
+	struct fakeif_notice *n;
+
+	fakeif_stats.addrs++;
+	if ((n = fakeif_notice(ifp, AF_INET, action)) == NULL)
+		return -1;
+	n->addr = *addr;
+	n->net = *net;
+	if (brd)
+		n->brd = *brd;
+	return 0;
+}
+
+int
+if_route(__unused const struct rt *rt, __unused int action)
+{
+
+	fakeif_stats.routes++;
+	return 0;
+}
+
+int
+if_initrt(__unused struct dhcpcd_ctx *ctx)
+{
+
+	return 0;
+}
+#endif
+
+#ifdef INET6
+int
+if_address6(const struct ipv6_addr *ap, int action)
+{
+	struct fakeif_notice *n;
+
+	fakeif_stats.addrs++;
+	if ((n = fakeif_notice(ap->iface, AF_INET6, action)) == NULL)
+		return -1;
+	n->addr6 = ap->addr;
+	return 0;
+}
+
+int
+if_route6(__unused const struct rt6 *rt, __unused int action)
+{
+
+	fakeif_stats.routes++;
+	return 0;
+}
+
+/* Duplicate address detection always completes at once */
+int
+if_addrflags6(__unused const struct in6_addr *addr,
+    __unused const struct interface *ifp)
+{
+
+	return 0;
+}
+
+/* The kernel never handles RA itself */
+int
+if_checkipv6(__unused struct dhcpcd_ctx *ctx,
+    __unused const struct interface *ifp, __unused int own)
+{
+
+	return 0;
+}
+#endif
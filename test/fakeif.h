@@ -0,0 +1,82 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef FAKEIF_H
+#define FAKEIF_H
+
+#include <sys/time.h>
+
+#include "../dhcpcd.h"
+
+/*
+ * A stand in for the kernel so that test programs can run the daemon
+ * over interfaces which do not exist.
+ *
+ * The test Makefile builds if-linux.c with the functions listed in
+ * FAKEIF_CPPFLAGS renamed out of the way and fakeif.c supplies them
+ * instead:
+ *   raw sockets are one end of a socketpair, the other end is returned
+ *   by fakeif_rawfd so frames can be written to the daemon.
+ *   Address and route changes are counted and addresses are reported
+ *   back as the kernel would over netlink.
+ * fakeif_init also gives the event loop a clock which only moves when
+ * fakeif_settime is called, or when nothing is ready in which case
+ * it moves on to the next timeout. Pass fakeif_clock to eloop_setclock
+ * to decide what happens when nothing is ready instead.
+ */
+
+#define FAKEIF_TX_DHCP		0
+#define FAKEIF_TX_ARP		1
+#define FAKEIF_TX_ND		2
+#define FAKEIF_TX_MAX		3
+
+struct fakeif_stats {
+	unsigned long long tx[FAKEIF_TX_MAX];
+	unsigned long long addrs;
+	unsigned long long routes;
+};
+
+extern struct fakeif_stats fakeif_stats;
+
+/* Called for each frame the daemon sends.
+ * ND messages share one socket, so the interface is NULL for those. */
+typedef void fakeif_send_cb(void *, const struct interface *, int,
+    const void *, size_t);
+
+void fakeif_init(struct dhcpcd_ctx *);
+void fakeif_free(struct dhcpcd_ctx *);
+void fakeif_setsend(fakeif_send_cb *, void *);
+struct interface *fakeif_new(struct dhcpcd_ctx *, const char *,
+    const unsigned char *, uint8_t);
+int fakeif_ndopen(struct dhcpcd_ctx *);
+int fakeif_ndrecv(struct interface *, const void *, size_t);
+int fakeif_rawfd(const struct interface *, int);
+int fakeif_clock(void *, struct timeval *);
+void fakeif_gettime(struct timeval *);
+void fakeif_settime(const struct timeval *);
+
+#endif
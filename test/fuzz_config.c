@@ -0,0 +1,146 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * libFuzzer entry point for the config parser.
+ * Each input is used as dhcpcd.conf, then the global options and those
+ * for an interface, ssid and profile named fuzz0 are read from it.
+ *
+ *	make CC=clang CFLAGS="-g -fsanitize=fuzzer-no-link,address"
+ *	make CC=clang fuzz
+ *	test/fuzz_config corpus
+ *
+ * Building with -DFUZZ_STANDALONE gives a main which runs each file
+ * named on the command line once, to replay crashes without libFuzzer.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "../dhcpcd.h"
+#include "../if-options.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+static char file[] = "/tmp/fuzz_config.XXXXXX";
+static int fd = -1;
+
+static void
+cleanup(void)
+{
+
+	if (fd != -1)
+		unlink(file);
+}
+
+static void
+free_ifo(struct if_options *ifo)
+{
+
+	if (ifo != NULL)
+		free_options(ifo);
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct dhcpcd_ctx ctx;
+	int i;
+
+	if (fd == -1) {
+		if ((fd = mkstemp(file)) == -1) {
+			perror("mkstemp");
+			abort();
+		}
+		atexit(cleanup);
+		setlogmask(LOG_UPTO(LOG_EMERG));
+	}
+	if (ftruncate(fd, 0) == -1 ||
+	    pwrite(fd, data, size, 0) != (ssize_t)size)
+	{
+		perror(file);
+		abort();
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cffile = file;
+	free_ifo(read_config(&ctx, NULL, NULL, NULL, 0, NULL));
+	free_ifo(read_config(&ctx, "fuzz0", NULL, NULL, 0, NULL));
+	free_ifo(read_config(&ctx, "fuzz0", "fuzz0", NULL, 0, NULL));
+	free_ifo(read_config(&ctx, "fuzz0", NULL, "fuzz0", 0, NULL));
+
+	free_config(&ctx);
+	for (i = 0; i < ctx.ifac; i++)
+		free(ctx.ifav[i]);
+	free(ctx.ifav);
+	for (i = 0; i < ctx.ifdc; i++)
+		free(ctx.ifdv[i]);
+	free(ctx.ifdv);
+	for (i = 0; i < ctx.ifcc; i++)
+		free(ctx.ifcv[i]);
+	free(ctx.ifcv);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+int
+main(int argc, char **argv)
+{
+	FILE *fp;
+	uint8_t *buf;
+	size_t len;
+	long flen;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if ((fp = fopen(argv[i], "r")) == NULL ||
+		    fseek(fp, 0, SEEK_END) == -1 ||
+		    (flen = ftell(fp)) == -1)
+		{
+			perror(argv[i]);
+			return EXIT_FAILURE;
+		}
+		rewind(fp);
+		len = (size_t)flen;
+		if ((buf = malloc(len + 1)) == NULL ||
+		    fread(buf, 1, len, fp) != len)
+		{
+			perror(argv[i]);
+			return EXIT_FAILURE;
+		}
+		fclose(fp);
+		printf("%s\n", argv[i]);
+		LLVMFuzzerTestOneInput(buf, len);
+		free(buf);
+	}
+	return EXIT_SUCCESS;
+}
+#endif
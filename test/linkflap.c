@@ -0,0 +1,331 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Flap the link of a fake interface while its DHCP timers are running.
+ *
+ *	linkflap [-d] [flaps]
+ *
+ * The interface is started with no server to answer it, so it keeps
+ * sending DISCOVERs. Link down and up messages are then given to
+ * dhcpcd_handlelink at times which land all over the retransmission
+ * interval. Half way through each debounce window the link changes
+ * again and DHCP is restarted, which deletes the timers of the
+ * interface. Once the window is over the carrier has to be the last
+ * one given and nothing may be left pending. Every fourth flap goes
+ * back up inside the window, which must leave DHCP alone.
+ */
+
+#include <sys/time.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "../config.h"
+#include "../common.h"
+#include "../dhcp.h"
+#include "../dhcpcd.h"
+#include "../eloop.h"
+#include "../if.h"
+#include "../if-options.h"
+#include "../ipv4.h"
+#include "../ipv6.h"
+#include "fakeif.h"
+
+#define FLAP_COUNT		100
+#define FLAP_DEBOUNCE		200	/* milliseconds */
+/* Link changes are this far apart plus a part of FLAP_SPREAD
+ * which moves on each flap */
+#define FLAP_GAP		2000	/* milliseconds */
+#define FLAP_SPREAD		8000
+#define FLAP_STEP		731
+
+struct flap {
+	struct dhcpcd_ctx *ctx;
+	struct interface *ifp;
+	unsigned long count;
+	unsigned long flap;
+	unsigned long bounces;
+	unsigned long long sent;
+	int restarted;
+	int failed;
+};
+
+static void flap_down(void *);
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: linkflap [-d] [flaps]\n");
+}
+
+static void
+flap_fail(struct flap *f, const char *what)
+{
+
+	fprintf(stderr, "linkflap: flap %lu: %s\n", f->flap, what);
+	f->failed = 1;
+}
+
+static void
+flap_after(struct flap *f, unsigned int ms, void (*cb)(void *))
+{
+	struct timeval tv;
+
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (suseconds_t)(ms % 1000) * 1000;
+	eloop_timeout_add_tv(f->ctx->eloop, &tv, cb, f);
+}
+
+static void
+flap_link(struct flap *f, int carrier)
+{
+	unsigned int flags;
+
+	flags = f->ifp->flags | IFF_UP;
+	if (carrier == LINK_UP)
+		flags |= IFF_RUNNING;
+	else
+		flags &= ~(unsigned int)IFF_RUNNING;
+	dhcpcd_handlelink(f->ctx, carrier, flags, f->ifp->name);
+}
+
+static int
+flap_isbounce(const struct flap *f)
+{
+
+	return f->flap % 4 == 3;
+}
+
+static uint32_t
+flap_xid(const struct interface *ifp)
+{
+	const struct dhcp_state *state;
+
+	state = D_CSTATE(ifp);
+	return state == NULL ? 0 : state->xid;
+}
+
+static void
+flap_next(struct flap *f)
+{
+
+	if (++f->flap == f->count) {
+		eloop_exit(f->ctx->eloop,
+		    f->failed ? EXIT_FAILURE : EXIT_SUCCESS);
+		return;
+	}
+	flap_after(f, FLAP_GAP + (unsigned int)
+	    (f->flap * FLAP_STEP % FLAP_SPREAD), flap_down);
+}
+
+/* The window is over, so the link has to be up and DHCP started over */
+static void
+flap_checkup(void *arg)
+{
+	struct flap *f = arg;
+
+	if (f->ifp->link_pending)
+		flap_fail(f, "link still pending after going up");
+	if (f->ifp->carrier != LINK_UP)
+		flap_fail(f, "carrier did not come back");
+	f->restarted = 1;
+	f->sent = fakeif_stats.tx[FAKEIF_TX_DHCP];
+	flap_next(f);
+}
+
+static void
+flap_up(void *arg)
+{
+	struct flap *f = arg;
+
+	flap_link(f, LINK_UP);
+	flap_after(f, FLAP_DEBOUNCE + 1, flap_checkup);
+}
+
+static void
+flap_checkdown(void *arg)
+{
+	struct flap *f = arg;
+
+	if (f->ifp->link_pending)
+		flap_fail(f, "link still pending after going down");
+	if (flap_isbounce(f)) {
+		/* Back where it started, so DHCP carries on */
+		if (f->ifp->carrier != LINK_UP)
+			flap_fail(f, "carrier lost on a bounce");
+		if (flap_xid(f->ifp) == 0)
+			flap_fail(f, "DHCP stopped on a bounce");
+		f->bounces++;
+		f->restarted = 0;
+		flap_next(f);
+		return;
+	}
+	if (f->ifp->carrier != LINK_DOWN)
+		flap_fail(f, "carrier was not lost");
+	flap_up(f);
+}
+
+/* Half way through the window the link changes again and DHCP starts
+ * over, deleting the DHCP timers of the interface */
+static void
+flap_middle(void *arg)
+{
+	struct flap *f = arg;
+
+	if (!f->ifp->link_pending)
+		flap_fail(f, "link not pending in the window");
+	flap_link(f, LINK_UP);
+	if (!flap_isbounce(f))
+		flap_link(f, LINK_DOWN);
+	if (D_STATE(f->ifp) != NULL)
+		dhcp_discover(f->ifp);
+	flap_after(f, FLAP_DEBOUNCE / 2 + 1, flap_checkdown);
+}
+
+static void
+flap_down(void *arg)
+{
+	struct flap *f = arg;
+
+	/* DHCP starts over when the link comes up */
+	if (f->restarted && fakeif_stats.tx[FAKEIF_TX_DHCP] == f->sent)
+		flap_fail(f, "nothing sent since the link came up");
+	flap_link(f, LINK_DOWN);
+	flap_after(f, FLAP_DEBOUNCE / 2, flap_middle);
+}
+
+static void
+flap_start(void *arg)
+{
+	struct flap *f = arg;
+
+	dhcpcd_startinterface(f->ifp);
+	f->restarted = 1;
+	flap_after(f, FLAP_GAP, flap_down);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct dhcpcd_ctx ctx;
+	struct flap f;
+	struct if_options *ifo;
+	struct interface *ifp;
+	unsigned char hwaddr[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+	char *args[5];
+	int opt, logmask, r;
+
+	logmask = LOG_UPTO(LOG_EMERG);
+	while ((opt = getopt(argc, argv, "d")) != -1) {
+		switch (opt) {
+		case 'd':
+			logmask = LOG_UPTO(LOG_DEBUG);
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	memset(&f, 0, sizeof(f));
+	f.count = FLAP_COUNT;
+	if (optind < argc)
+		f.count = strtoul(argv[optind], NULL, 0);
+	if (f.count == 0) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	openlog("linkflap", LOG_PERROR, LOG_DAEMON);
+	setlogmask(logmask);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cffile = "/dev/null";
+	ctx.pid_fd = ctx.control_fd = ctx.control_unpriv_fd = ctx.link_fd = -1;
+	TAILQ_INIT(&ctx.control_fds);
+#ifdef INET
+	ctx.udp_fd = -1;
+#endif
+	if ((ifo = read_config(&ctx, NULL, NULL, NULL, 0, NULL)) == NULL)
+		return EXIT_FAILURE;
+	ctx.options = ifo->options & ~(DHCPCD_DAEMONISE | DHCPCD_WAITIP);
+	free_options(ifo);
+	ctx.link_debounce = FLAP_DEBOUNCE;
+	if ((ctx.eloop = eloop_init()) == NULL) {
+		perror("eloop_init");
+		return EXIT_FAILURE;
+	}
+	fakeif_init(&ctx);
+	if (ctx.ifaces == NULL ||
+	    (ifp = fakeif_new(&ctx, "flap0", hwaddr, sizeof(hwaddr))) == NULL)
+	{
+		perror("flap0");
+		return EXIT_FAILURE;
+	}
+
+	/* DHCP only and no scripts */
+	args[0] = argv[0];
+	args[1] = UNCONST("--ipv4only");
+	args[2] = UNCONST("-c");
+	args[3] = UNCONST("");
+	args[4] = NULL;
+	ctx.argv = args;
+	ctx.argc = 4;
+	dhcpcd_initstate(ifp);
+
+	f.ctx = &ctx;
+	f.ifp = ifp;
+	eloop_timeout_add_sec(ctx.eloop, 0, flap_start, &f);
+	r = eloop_start(&ctx);
+	if (r != EXIT_SUCCESS && !f.failed)
+		fprintf(stderr, "linkflap: stopped after %lu flaps\n", f.flap);
+	printf("%lu flaps, %lu of them bounces, %llu DHCP messages sent\n",
+	    f.flap, f.bounces, fakeif_stats.tx[FAKEIF_TX_DHCP]);
+
+	if_batch_free(&ctx);
+	while ((ifp = TAILQ_FIRST(ctx.ifaces))) {
+		TAILQ_REMOVE(ctx.ifaces, ifp, next);
+		if_hashdel(&ctx, ifp);
+		if_free(ifp);
+	}
+	free(ctx.ifaces);
+	if_freehash(&ctx);
+	fakeif_free(&ctx);
+	free(ctx.duid);
+	ipv4_ctxfree(&ctx);
+	ipv6_ctxfree(&ctx);
+	free_config(&ctx);
+	eloop_free(ctx.eloop);
+	return r;
+}
@@ -0,0 +1,561 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Replay a pcap file through the daemon faster than real time.
+ *
+ *	replay [-dq] [-e seconds] [-f dhcpcd.conf] [-i interface]
+ *	    [-m hwaddr] [-s script] capture.pcap
+ *
+ * A fake interface is configured from dhcpcd.conf (/dev/null unless -f
+ * is given) and started as dhcpcd would start it. The kernel is
+ * replaced by fakeif.c, so nothing on the host is changed other than
+ * the lease file of the interface, which is removed first so each run
+ * starts the same way. For that reason -i refuses the name of an
+ * interface which exists on the host.
+ * DHCP replies, ARP and ND advertisements are fed to dhcp_handlepacket,
+ * arp_packet and ipv6nd_recvmsg at the times they were captured,
+ * counted from when the daemon first sends a frame of the same kind
+ * as the first one in the capture. Time only passes when the daemon
+ * has nothing left to do, so timers fire at the right point in between.
+ * Replies are addressed to the hardware address of -m, or of the first
+ * DHCP client in the capture, and have their xid rewritten to the one
+ * the daemon is waiting for. DHCPv6 is not replayed and is disabled.
+ * The daemon keeps running for -e seconds after the last frame.
+ *
+ * No script is run unless -s is given, use -s /bin/true to include the
+ * cost of building the script environment and forking.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../common.h"
+#include "../dhcp.h"
+#include "../dhcpcd.h"
+#include "../eloop.h"
+#include "../if.h"
+#include "../if-options.h"
+#include "../ipv6.h"
+#include "capture.h"
+#include "fakeif.h"
+
+#define RX_DHCP		0
+#define RX_ARP		1
+#define RX_ND		2
+#define RX_IGNORED	3
+#define RX_MAX		4
+
+struct replay {
+	struct dhcpcd_ctx *ctx;
+	struct interface *ifp;
+	struct capture cap;
+	struct capture_frame frame;
+	int have_frame;
+	int started;
+	size_t frames;
+	struct timeval first;	/* capture time of the first frame */
+	struct timeval prev;	/* capture time of the last frame */
+	struct timeval start;	/* virtual time the first frame is seen */
+	struct timeval begin;	/* virtual time the daemon started */
+	struct timeval last;
+	struct timeval end;
+	time_t linger;
+	unsigned long long rx[RX_MAX];
+};
+
+static const char *rx_names[RX_MAX] = { "dhcp", "arp", "nd", "ignored" };
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: replay [-dq] [-e seconds] [-f dhcpcd.conf] "
+	    "[-i interface]\n"
+	    "\t[-m hwaddr] [-s script] capture.pcap\n");
+}
+
+static uint32_t
+cksum_add(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	for (; len > 1; p += 2, len -= 2)
+		sum += (uint32_t)(p[0] << 8 | p[1]);
+	if (len)
+		sum += (uint32_t)(p[0] << 8);
+	return sum;
+}
+
+static uint16_t
+cksum_fold(uint32_t sum)
+{
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return htons((uint16_t)~sum);
+}
+
+/* Return the DHCP message in a captured IPv4 frame, or NULL */
+static struct dhcp_message *
+frame_dhcp(const struct capture_frame *f, struct ip **ipp,
+    struct udphdr **udpp)
+{
+	struct ip *ip;
+	struct udphdr *udp;
+	size_t hl;
+
+	if (f->proto != ETHERTYPE_IP || f->len < sizeof(*ip))
+		return NULL;
+	ip = (struct ip *)(void *)f->data;
+	hl = (size_t)ip->ip_hl << 2;
+	if (ip->ip_v != IPVERSION || ip->ip_p != IPPROTO_UDP ||
+	    f->len < hl + sizeof(*udp) +
+	    offsetof(struct dhcp_message, servername))
+		return NULL;
+	udp = (struct udphdr *)(void *)(f->data + hl);
+	if (ntohs(udp->uh_dport) != DHCP_CLIENT_PORT &&
+	    ntohs(udp->uh_dport) != DHCP_SERVER_PORT)
+		return NULL;
+	if (ipp)
+		*ipp = ip;
+	if (udpp)
+		*udpp = udp;
+	return (struct dhcp_message *)(void *)(f->data + hl + sizeof(*udp));
+}
+
+/* Find the hardware address of the first DHCP client in the capture */
+static int
+find_client(const char *file, unsigned char *hwaddr)
+{
+	struct capture cap;
+	struct capture_frame f;
+	struct dhcp_message *dhcp;
+	int r;
+
+	if (capture_open(&cap, file) == -1)
+		return -1;
+	while ((r = capture_read(&cap, &f)) == 1) {
+		if ((dhcp = frame_dhcp(&f, NULL, NULL)) != NULL &&
+		    dhcp->hwtype == ARPHRD_ETHER &&
+		    dhcp->hwlen == ETHER_ADDR_LEN)
+		{
+			memcpy(hwaddr, dhcp->chaddr, ETHER_ADDR_LEN);
+			break;
+		}
+	}
+	capture_close(&cap);
+	return r == 1 ? 0 : -1;
+}
+
+static int
+next_frame(struct replay *r)
+{
+	int n;
+
+	if ((n = capture_read(&r->cap, &r->frame)) == -1) {
+		syslog(LOG_ERR, "%s: %m", r->cap.file);
+		return -1;
+	}
+	r->have_frame = n;
+	if (n == 0)
+		return 0;
+	if (r->frames++ == 0)
+		r->first = r->prev = r->frame.when;
+	/* Captures can go back in time, we can't */
+	if (timercmp(&r->frame.when, &r->prev, <))
+		r->frame.when = r->prev;
+	r->prev = r->frame.when;
+	return 1;
+}
+
+/* Virtual time the current frame is due at */
+static void
+frame_time(const struct replay *r, struct timeval *tv)
+{
+
+	timersub(&r->frame.when, &r->first, tv);
+	timeradd(&r->start, tv, tv);
+}
+
+static int
+inject_dhcp(struct replay *r, struct capture_frame *f)
+{
+	const struct dhcp_state *state;
+	struct dhcp_message *dhcp;
+	struct ip *ip;
+	struct udphdr *udp;
+	uint32_t sum;
+	size_t len;
+	int fd;
+
+	state = D_CSTATE(r->ifp);
+	if ((dhcp = frame_dhcp(f, &ip, &udp)) == NULL ||
+	    ntohs(udp->uh_dport) != DHCP_CLIENT_PORT ||
+	    dhcp->op != DHCP_BOOTREPLY ||
+	    state == NULL ||
+	    (fd = fakeif_rawfd(r->ifp, ETHERTYPE_IP)) == -1)
+		return -1;
+
+	/* Make the reply one the daemon is waiting for */
+	memcpy(dhcp->chaddr, r->ifp->hwaddr, r->ifp->hwlen);
+	dhcp->xid = htonl(state->xid);
+	if (udp->uh_sum != 0) {
+		len = ntohs(udp->uh_ulen);
+		if ((uint8_t *)udp + len > f->data + f->len)
+			return -1;
+		udp->uh_sum = 0;
+		sum = cksum_add(0, &ip->ip_src, sizeof(ip->ip_src) * 2);
+		sum += IPPROTO_UDP + (uint32_t)len;
+		sum = cksum_add(sum, udp, len);
+		if ((udp->uh_sum = cksum_fold(sum)) == 0)
+			udp->uh_sum = 0xffff;
+	}
+	return write(fd, f->data, f->len) == -1 ? -1 : 0;
+}
+
+static int
+inject_nd(struct replay *r, struct capture_frame *f)
+{
+	const struct ip6_hdr *ip6;
+	const struct icmp6_hdr *icp;
+
+	if (f->len < sizeof(*ip6) + sizeof(*icp))
+		return -1;
+	ip6 = (const struct ip6_hdr *)(void *)f->data;
+	if (ip6->ip6_nxt != IPPROTO_ICMPV6)
+		return -1;
+	icp = (const struct icmp6_hdr *)(const void *)(ip6 + 1);
+	if (icp->icmp6_type != ND_ROUTER_ADVERT &&
+	    icp->icmp6_type != ND_NEIGHBOR_ADVERT)
+		return -1;
+	return fakeif_ndrecv(r->ifp, f->data, f->len);
+}
+
+static void
+inject(struct replay *r, struct capture_frame *f)
+{
+	int rx, fd;
+
+	rx = RX_IGNORED;
+	switch (f->proto) {
+	case ETHERTYPE_IP:
+		if (inject_dhcp(r, f) == 0)
+			rx = RX_DHCP;
+		break;
+	case ETHERTYPE_ARP:
+		if ((fd = fakeif_rawfd(r->ifp, ETHERTYPE_ARP)) != -1 &&
+		    write(fd, f->data, f->len) != -1)
+			rx = RX_ARP;
+		break;
+	case ETHERTYPE_IPV6:
+		if (inject_nd(r, f) == 0)
+			rx = RX_ND;
+		break;
+	}
+	r->rx[rx]++;
+}
+
+/* Called from the event loop when the daemon has nothing left to do,
+ * with how long until the next timeout.
+ * Deliver the next frame or move time on to the next timeout. */
+static void
+replay_idle(void *arg, const struct timeval *tv)
+{
+	struct replay *r = arg;
+	struct eloop_ctx *eloop = r->ctx->eloop;
+	struct timeval now, next, when;
+	unsigned long long tx;
+
+	fakeif_gettime(&now);
+	if (tv)
+		timeradd(&now, tv, &next);
+
+	/* The capture starts when the daemon first sends something
+	 * of the same kind as the first frame, so the first reply
+	 * follows the first request whatever initial delay the
+	 * daemon picked. */
+	if (!r->started) {
+		switch (r->have_frame ? r->frame.proto : 0) {
+		case ETHERTYPE_IP:
+			tx = fakeif_stats.tx[FAKEIF_TX_DHCP];
+			break;
+		case ETHERTYPE_ARP:
+			tx = fakeif_stats.tx[FAKEIF_TX_ARP];
+			break;
+		case ETHERTYPE_IPV6:
+			tx = fakeif_stats.tx[FAKEIF_TX_ND];
+			break;
+		default:
+			tx = 1;
+			break;
+		}
+		if (tx != 0 || tv == NULL) {
+			r->started = 1;
+			r->start = now;
+			if (!r->have_frame) {
+				r->end = r->start;
+				r->end.tv_sec += r->linger;
+			}
+		}
+	}
+
+	if (r->started && r->have_frame)
+		frame_time(r, &when);
+	if (r->started && r->have_frame &&
+	    (tv == NULL || !timercmp(&next, &when, <)))
+	{
+		fakeif_settime(&when);
+		r->last = when;
+		inject(r, &r->frame);
+		if (next_frame(r) == -1)
+			eloop_exit(eloop, EXIT_FAILURE);
+		else if (!r->have_frame) {
+			r->end = r->last;
+			r->end.tv_sec += r->linger;
+		}
+		return;
+	}
+	if (tv == NULL ||
+	    (r->started && !r->have_frame && timercmp(&next, &r->end, >)))
+	{
+		if (!r->have_frame)
+			fakeif_settime(&r->end);
+		eloop_exit(eloop, EXIT_SUCCESS);
+		return;
+	}
+	fakeif_settime(&next);
+}
+
+static double
+ts_diff(const struct timespec *start, const struct timespec *end)
+{
+
+	return (double)(end->tv_sec - start->tv_sec) +
+	    (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+report(struct replay *r, const struct timespec *wall,
+    const struct timespec *cpu)
+{
+	const unsigned long long *c = r->ctx->metrics.counter;
+	struct timeval vt;
+	double v, w;
+	size_t i;
+
+	fakeif_gettime(&vt);
+	timersub(&vt, &r->begin, &vt);
+	v = timeval_to_double(&vt);
+	w = ts_diff(&wall[0], &wall[1]);
+	printf("replay: %s, %zu frames\n", r->cap.file, r->frames);
+	printf("%-10s", "received");
+	for (i = 0; i < RX_MAX; i++)
+		printf(" %s %llu", rx_names[i], r->rx[i]);
+	printf("\n%-10s dhcp %llu arp %llu nd %llu\n", "sent",
+	    fakeif_stats.tx[FAKEIF_TX_DHCP], fakeif_stats.tx[FAKEIF_TX_ARP],
+	    fakeif_stats.tx[FAKEIF_TX_ND]);
+	printf("%-10s dhcp %llu arp %llu nd %llu\n", "dropped",
+	    c[MET_DHCP_DROP], c[MET_ARP_DROP], c[MET_ND_DROP]);
+	printf("%-10s %llu address and %llu route changes\n", "kernel",
+	    fakeif_stats.addrs, fakeif_stats.routes);
+	printf("%-10s %llu events %llu timeouts\n", "eloop",
+	    r->ctx->eloop->events_run, r->ctx->eloop->timeouts_run);
+	printf("%-10s %.1f seconds in %.3f seconds, %.3f seconds cpu",
+	    "time", v, w, ts_diff(&cpu[0], &cpu[1]));
+	if (w > 0)
+		printf(" (%.0fx)", v / w);
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct dhcpcd_ctx ctx;
+	struct replay r;
+	struct if_options *ifo;
+	struct interface *ifp;
+	struct timespec wall[2], cpu[2];
+	unsigned char hwaddr[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, 1 };
+	const char *ifname, *script;
+	char leasefile[sizeof(LEASEFILE) + IF_NAMESIZE];
+	char *args[5];
+	int opt, logmask, i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&r, 0, sizeof(r));
+	ctx.cffile = "/dev/null";
+	ifname = "replay0";
+	script = "";
+	logmask = LOG_UPTO(LOG_INFO);
+	opt = 0;
+	while ((i = getopt(argc, argv, "de:f:i:m:qs:")) != -1) {
+		switch (i) {
+		case 'd':
+			logmask = LOG_UPTO(LOG_DEBUG);
+			break;
+		case 'e':
+			r.linger = (time_t)strtol(optarg, NULL, 0);
+			break;
+		case 'f':
+			ctx.cffile = optarg;
+			break;
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'm':
+			if (hwaddr_aton(NULL, optarg) != ETHER_ADDR_LEN) {
+				fprintf(stderr, "%s: not an ethernet address\n",
+				    optarg);
+				return EXIT_FAILURE;
+			}
+			hwaddr_aton(hwaddr, optarg);
+			opt = 1;
+			break;
+		case 'q':
+			logmask = LOG_UPTO(LOG_ERR);
+			break;
+		case 's':
+			script = optarg;
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	if (strlen(ifname) >= IF_NAMESIZE) {
+		fprintf(stderr, "%s: interface name too long\n", ifname);
+		return EXIT_FAILURE;
+	}
+	if (opt == 0)
+		find_client(argv[optind], hwaddr);
+	if (capture_open(&r.cap, argv[optind]) == -1) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	openlog("replay", LOG_PERROR, LOG_DAEMON);
+	setlogmask(logmask);
+
+	ctx.pid_fd = ctx.control_fd = ctx.control_unpriv_fd = ctx.link_fd = -1;
+	TAILQ_INIT(&ctx.control_fds);
+#ifdef INET
+	ctx.udp_fd = -1;
+#endif
+	if ((ifo = read_config(&ctx, NULL, NULL, NULL, 0, NULL)) == NULL)
+		return EXIT_FAILURE;
+	/* We run in the foreground, for a single interface */
+	ctx.options = ifo->options & ~(DHCPCD_DAEMONISE | DHCPCD_WAITIP);
+	free_options(ifo);
+	if ((ctx.eloop = eloop_init()) == NULL) {
+		perror("eloop_init");
+		return EXIT_FAILURE;
+	}
+
+	fakeif_init(&ctx);
+	if (ctx.ifaces == NULL ||
+	    (ifp = fakeif_new(&ctx, ifname, hwaddr, sizeof(hwaddr))) == NULL)
+	{
+		perror(ifname);
+		return EXIT_FAILURE;
+	}
+	snprintf(leasefile, sizeof(leasefile), LEASEFILE, ifp->name, "");
+	unlink(leasefile);
+
+	/* Options given here apply whenever the interface is
+	 * configured, as they do for dhcpcd */
+	args[0] = argv[0];
+	args[1] = UNCONST("--nodhcp6");
+	args[2] = UNCONST("-c");
+	args[3] = UNCONST(script);
+	args[4] = NULL;
+	ctx.argv = args;
+	ctx.argc = 4;
+	dhcpcd_initstate(ifp);
+
+	/* Frames are delivered when the daemon has nothing to do */
+	eloop_setclock(ctx.eloop, fakeif_clock, replay_idle, &r);
+	if (ctx.ipv6 && fakeif_ndopen(&ctx) == -1) {
+		perror("fakeif_ndopen");
+		return EXIT_FAILURE;
+	}
+	r.ctx = &ctx;
+	r.ifp = ifp;
+	fakeif_gettime(&r.begin);
+	if (next_frame(&r) == -1)
+		return EXIT_FAILURE;
+	eloop_timeout_add_sec(ctx.eloop, 0, dhcpcd_startinterface, ifp);
+
+	clock_gettime(CLOCK_MONOTONIC, &wall[0]);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu[0]);
+	i = eloop_start(&ctx);
+	clock_gettime(CLOCK_MONOTONIC, &wall[1]);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu[1]);
+	report(&r, wall, cpu);
+
+	if_batch_free(&ctx);
+	while ((ifp = TAILQ_FIRST(ctx.ifaces))) {
+		TAILQ_REMOVE(ctx.ifaces, ifp, next);
+		if_hashdel(&ctx, ifp);
+		if_free(ifp);
+	}
+	free(ctx.ifaces);
+	if_freehash(&ctx);
+	fakeif_free(&ctx);
+	free(ctx.duid);
+	ipv4_ctxfree(&ctx);
+	ipv6_ctxfree(&ctx);
+	free_config(&ctx);
+	eloop_free(ctx.eloop);
+	capture_close(&r.cap);
+	return i;
+}
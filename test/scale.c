@@ -0,0 +1,645 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Run the daemon over many fake interfaces as the count grows.
+ *
+ *	scale [-d] [-f dhcpcd.conf] [-l leasetime] [-r renewals] [count ...]
+ *
+ * For each count a child process creates that many interfaces with
+ * fakeif.c, so no network devices are needed, and starts them all as
+ * dhcpcd would. A stand in server answers each DISCOVER and REQUEST
+ * and each Router Solicitation with an RA, straight from the frames
+ * the daemon sends.
+ * Reported are the wall and CPU time from starting the interfaces
+ * until every one has a lease and an RA, the CPU time per renewal
+ * while the leases are renewed the given number of times and the
+ * maximum resident set size.
+ * Time is virtual, so lease and RA timers fire as soon as nothing else
+ * is ready and only the work the daemon does is measured.
+ *
+ * Scripts are not run and DHCPv6 is disabled. Renewals are unicast
+ * from an address the host does not have, so they fail to bind a UDP
+ * socket and are sent on the raw socket instead.
+ */
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/icmp6.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../common.h"
+#include "../dhcp.h"
+#include "../dhcpcd.h"
+#include "../eloop.h"
+#include "../if.h"
+#include "../if-options.h"
+#include "../ipv4.h"
+#include "../ipv6.h"
+#include "../ipv6nd.h"
+#include "fakeif.h"
+
+#define SCALE_LEASETIME		3600
+#define SCALE_RENEWALS		3
+/* Virtual seconds allowed for every interface to bind */
+#define SCALE_BINDTIME		600
+
+#define SCALE_NET		0x0a000000	/* 10.0.0.0/8 */
+#define SCALE_SERVER		(SCALE_NET + 1)
+
+static const unsigned long default_counts[] = { 100, 250, 500, 1000 };
+
+struct scale {
+	struct dhcpcd_ctx *ctx;
+	struct interface **ifaces;
+	unsigned long count;
+	unsigned long bound;
+	unsigned long renewals;
+	uint32_t leasetime;
+	int renewing;
+	unsigned long long acks;
+	struct timeval start;
+	struct timeval bind;
+	struct timeval deadline;
+	struct timespec wall[3], cpu[3];
+};
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: scale [-d] [-f dhcpcd.conf] [-l leasetime]"
+	    " [-r renewals] [count ...]\n");
+}
+
+static double
+elapsed(const struct timespec *a, const struct timespec *b)
+{
+
+	return (double)(b->tv_sec - a->tv_sec) +
+	    (double)(b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* Interfaces are numbered in their hardware address so the stand in
+ * server can find them from a frame */
+static void
+scale_hwaddr(unsigned char *hwaddr, unsigned long i)
+{
+
+	hwaddr[0] = 2;
+	hwaddr[1] = 0;
+	hwaddr[2] = (unsigned char)(i >> 24);
+	hwaddr[3] = (unsigned char)(i >> 16);
+	hwaddr[4] = (unsigned char)(i >> 8);
+	hwaddr[5] = (unsigned char)i;
+}
+
+static long
+scale_index(const struct scale *s, const unsigned char *hwaddr)
+{
+	unsigned long i;
+
+	if (hwaddr[0] != 2 || hwaddr[1] != 0)
+		return -1;
+	i = (unsigned long)hwaddr[2] << 24 | (unsigned long)hwaddr[3] << 16 |
+	    (unsigned long)hwaddr[4] << 8 | hwaddr[5];
+	if (i >= s->count ||
+	    memcmp(s->ifaces[i]->hwaddr, hwaddr, ETHER_ADDR_LEN))
+		return -1;
+	return (long)i;
+}
+
+static uint16_t
+ip_checksum(const void *data, size_t len)
+{
+	const uint8_t *p;
+	uint32_t sum;
+
+	p = data;
+	sum = 0;
+	for (; len > 1; len -= 2, p += 2)
+		sum += (uint32_t)(p[0] << 8 | p[1]);
+	if (len)
+		sum += (uint32_t)(p[0] << 8);
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return htons((uint16_t)~sum);
+}
+
+static int
+message_type(const struct dhcp_message *dhcp, size_t len)
+{
+	const uint8_t *p, *e;
+
+	p = dhcp->options;
+	e = (const uint8_t *)dhcp + len;
+	while (p < e) {
+		if (*p == DHO_PAD) {
+			p++;
+			continue;
+		}
+		if (*p == DHO_END || p + 2 > e)
+			break;
+		if (*p == DHO_MESSAGETYPE && p[1] == 1 && p + 3 <= e)
+			return p[2];
+		p += 2 + p[1];
+	}
+	return -1;
+}
+
+static uint8_t *
+put_option(uint8_t *p, uint8_t option, const void *data, uint8_t len)
+{
+
+	*p++ = option;
+	*p++ = len;
+	memcpy(p, data, len);
+	return p + len;
+}
+
+/* Answer a DISCOVER with an OFFER and a REQUEST with an ACK */
+static void
+scale_dhcp(struct scale *s, const struct interface *ifp,
+    const uint8_t *data, size_t len)
+{
+	const struct ip *ip;
+	const struct udphdr *udp;
+	const struct dhcp_message *req;
+	struct {
+		struct ip ip;
+		struct udphdr udp;
+		struct dhcp_message dhcp;
+	} rep;
+	uint8_t *p, type;
+	uint32_t u32;
+	size_t hl, dlen;
+	long i;
+	int fd;
+
+	if (len < sizeof(*ip))
+		return;
+	ip = (const void *)data;
+	hl = (size_t)ip->ip_hl << 2;
+	if (ip->ip_p != IPPROTO_UDP ||
+	    len < hl + sizeof(*udp) + offsetof(struct dhcp_message, options))
+		return;
+	udp = (const void *)(data + hl);
+	if (ntohs(udp->uh_dport) != DHCP_SERVER_PORT)
+		return;
+	req = (const void *)(data + hl + sizeof(*udp));
+	if (req->op != DHCP_BOOTREQUEST ||
+	    req->cookie != htonl(MAGIC_COOKIE))
+		return;
+	switch (message_type(req, len - hl - sizeof(*udp))) {
+	case DHCP_DISCOVER:
+		type = DHCP_OFFER;
+		break;
+	case DHCP_REQUEST:
+		type = DHCP_ACK;
+		break;
+	default:
+		return;
+	}
+	if ((i = scale_index(s, req->chaddr)) == -1 || s->ifaces[i] != ifp)
+		return;
+
+	memset(&rep, 0, sizeof(rep));
+	rep.dhcp.op = DHCP_BOOTREPLY;
+	rep.dhcp.hwtype = req->hwtype;
+	rep.dhcp.hwlen = req->hwlen;
+	rep.dhcp.xid = req->xid;
+	rep.dhcp.flags = req->flags;
+	rep.dhcp.ciaddr = req->ciaddr;
+	rep.dhcp.yiaddr = htonl(SCALE_NET + 2 + (uint32_t)i);
+	rep.dhcp.siaddr = htonl(SCALE_SERVER);
+	memcpy(rep.dhcp.chaddr, req->chaddr, sizeof(rep.dhcp.chaddr));
+	rep.dhcp.cookie = htonl(MAGIC_COOKIE);
+	p = rep.dhcp.options;
+	p = put_option(p, DHO_MESSAGETYPE, &type, 1);
+	u32 = htonl(SCALE_SERVER);
+	p = put_option(p, DHO_SERVERID, &u32, sizeof(u32));
+	u32 = htonl(s->leasetime);
+	p = put_option(p, DHO_LEASETIME, &u32, sizeof(u32));
+	u32 = htonl(0xff000000);
+	p = put_option(p, DHO_SUBNETMASK, &u32, sizeof(u32));
+	u32 = htonl(SCALE_SERVER);
+	p = put_option(p, DHO_ROUTER, &u32, sizeof(u32));
+	*p++ = DHO_END;
+	dlen = (size_t)(p - (uint8_t *)&rep.dhcp);
+
+	/* The daemon does not check a zero UDP checksum */
+	rep.udp.uh_sport = htons(DHCP_SERVER_PORT);
+	rep.udp.uh_dport = htons(DHCP_CLIENT_PORT);
+	rep.udp.uh_ulen = htons((uint16_t)(sizeof(rep.udp) + dlen));
+	rep.ip.ip_v = IPVERSION;
+	rep.ip.ip_hl = sizeof(rep.ip) >> 2;
+	rep.ip.ip_len = htons((uint16_t)(sizeof(rep.ip) +
+	    sizeof(rep.udp) + dlen));
+	rep.ip.ip_ttl = IPDEFTTL;
+	rep.ip.ip_p = IPPROTO_UDP;
+	rep.ip.ip_src.s_addr = htonl(SCALE_SERVER);
+	rep.ip.ip_dst.s_addr = rep.dhcp.yiaddr;
+	rep.ip.ip_sum = ip_checksum(&rep.ip, sizeof(rep.ip));
+
+	if ((fd = fakeif_rawfd(ifp, ETHERTYPE_IP)) == -1)
+		return;
+	if (write(fd, &rep, sizeof(rep.ip) + sizeof(rep.udp) + dlen) == -1)
+		return;
+	if (type == DHCP_ACK && s->renewing)
+		s->acks++;
+}
+
+#ifdef INET6
+/* Answer a Router Solicitation with an RA carrying a prefix for SLAAC.
+ * The interface is found from the source link-layer address option. */
+static void
+scale_nd(struct scale *s, const uint8_t *data, size_t len)
+{
+	const struct nd_router_solicit *rs;
+	const uint8_t *p, *e;
+	struct {
+		struct ip6_hdr ip6;
+		struct nd_router_advert ra;
+		struct nd_opt_prefix_info pi;
+	} ra;
+	long i;
+
+	if (len < sizeof(*rs))
+		return;
+	rs = (const void *)data;
+	if (rs->nd_rs_type != ND_ROUTER_SOLICIT)
+		return;
+	i = -1;
+	e = data + len;
+	for (p = data + sizeof(*rs); p + 2 <= e && p[1] != 0; p += p[1] * 8) {
+		if (p[0] == ND_OPT_SOURCE_LINKADDR &&
+		    p + 2 + ETHER_ADDR_LEN <= e)
+		{
+			i = scale_index(s, p + 2);
+			break;
+		}
+	}
+	if (i == -1)
+		return;
+
+	memset(&ra, 0, sizeof(ra));
+	ra.ip6.ip6_vfc = 6 << 4;		/* version */
+	ra.ip6.ip6_plen = htons(sizeof(ra) - sizeof(ra.ip6));
+	ra.ip6.ip6_nxt = IPPROTO_ICMPV6;
+	ra.ip6.ip6_hlim = 255;
+	ra.ip6.ip6_src.s6_addr[0] = 0xfe;
+	ra.ip6.ip6_src.s6_addr[1] = 0x80;
+	ra.ip6.ip6_src.s6_addr[15] = 1;
+	ra.ip6.ip6_dst.s6_addr[0] = 0xff;
+	ra.ip6.ip6_dst.s6_addr[1] = 0x02;
+	ra.ip6.ip6_dst.s6_addr[15] = 1;
+	ra.ra.nd_ra_type = ND_ROUTER_ADVERT;
+	ra.ra.nd_ra_curhoplimit = 64;
+	ra.ra.nd_ra_router_lifetime = htons(9000);
+	ra.pi.nd_opt_pi_type = ND_OPT_PREFIX_INFORMATION;
+	ra.pi.nd_opt_pi_len = sizeof(ra.pi) / 8;
+	ra.pi.nd_opt_pi_prefix_len = 64;
+	ra.pi.nd_opt_pi_flags_reserved =
+	    ND_OPT_PI_FLAG_ONLINK | ND_OPT_PI_FLAG_AUTO;
+	ra.pi.nd_opt_pi_valid_time = htonl(ND6_INFINITE_LIFETIME);
+	ra.pi.nd_opt_pi_preferred_time = htonl(ND6_INFINITE_LIFETIME);
+	/* 2001:db8:iiii:iiii::/64 */
+	ra.pi.nd_opt_pi_prefix.s6_addr[0] = 0x20;
+	ra.pi.nd_opt_pi_prefix.s6_addr[1] = 0x01;
+	ra.pi.nd_opt_pi_prefix.s6_addr[2] = 0x0d;
+	ra.pi.nd_opt_pi_prefix.s6_addr[3] = 0xb8;
+	ra.pi.nd_opt_pi_prefix.s6_addr[4] = (uint8_t)(i >> 24);
+	ra.pi.nd_opt_pi_prefix.s6_addr[5] = (uint8_t)(i >> 16);
+	ra.pi.nd_opt_pi_prefix.s6_addr[6] = (uint8_t)(i >> 8);
+	ra.pi.nd_opt_pi_prefix.s6_addr[7] = (uint8_t)i;
+	fakeif_ndrecv(s->ifaces[i], &ra, sizeof(ra));
+}
+#endif
+
+static void
+scale_send(void *arg, const struct interface *ifp, int protocol,
+    const void *data, size_t len)
+{
+	struct scale *s = arg;
+
+	switch (protocol) {
+	case ETHERTYPE_IP:
+		scale_dhcp(s, ifp, data, len);
+		break;
+#ifdef INET6
+	case ETHERTYPE_IPV6:
+		scale_nd(s, data, len);
+		break;
+#endif
+	}
+}
+
+static int
+scale_isbound(const struct interface *ifp)
+{
+	const struct dhcp_state *state;
+
+	state = D_CSTATE(ifp);
+	if (state == NULL || state->state != DHS_BOUND)
+		return 0;
+#ifdef INET6
+	if (ifp->options->options & DHCPCD_IPV6RS && !ipv6nd_hasra(ifp))
+		return 0;
+#endif
+	return 1;
+}
+
+/* Nothing is ready, so see how far the interfaces have got and
+ * move time on to the next timeout */
+static void
+scale_idle(void *arg, const struct timeval *tv)
+{
+	struct scale *s = arg;
+	struct timeval now, next;
+
+	fakeif_gettime(&now);
+	if (!s->renewing) {
+		while (s->bound < s->count &&
+		    scale_isbound(s->ifaces[s->bound]))
+			s->bound++;
+		if (s->bound == s->count) {
+			clock_gettime(CLOCK_MONOTONIC, &s->wall[1]);
+			clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &s->cpu[1]);
+			s->bind = now;
+			s->renewing = 1;
+			/* Each lease renews at T1, half way through */
+			s->deadline = now;
+			s->deadline.tv_sec +=
+			    (time_t)((s->renewals + 1) * s->leasetime / 2);
+		}
+	} else if (s->acks >= s->count * s->renewals) {
+		clock_gettime(CLOCK_MONOTONIC, &s->wall[2]);
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &s->cpu[2]);
+		eloop_exit(s->ctx->eloop, EXIT_SUCCESS);
+		return;
+	}
+
+	if (tv == NULL) {
+		eloop_exit(s->ctx->eloop, EXIT_FAILURE);
+		return;
+	}
+	timeradd(&now, tv, &next);
+	if (timercmp(&next, &s->deadline, >)) {
+		eloop_exit(s->ctx->eloop, EXIT_FAILURE);
+		return;
+	}
+	fakeif_settime(&next);
+}
+
+static void
+report(const struct scale *s, int r)
+{
+	struct rusage ru;
+	double renew;
+
+	if (getrusage(RUSAGE_SELF, &ru) == -1)
+		ru.ru_maxrss = 0;
+	if (!s->renewing) {
+		printf("%8lu  %lu bound after %d seconds\n",
+		    s->count, s->bound, SCALE_BINDTIME);
+		return;
+	}
+	if (r != EXIT_SUCCESS || s->acks == 0)
+		renew = 0;
+	else
+		renew = elapsed(&s->cpu[1], &s->cpu[2]) * 1e6 /
+		    (double)s->acks;
+	printf("%8lu %10.3f %10.3f %8ld %9llu %12.1f %10ld%s\n",
+	    s->count,
+	    elapsed(&s->wall[0], &s->wall[1]),
+	    elapsed(&s->cpu[0], &s->cpu[1]),
+	    (long)(s->bind.tv_sec - s->start.tv_sec),
+	    s->acks, renew, (long)ru.ru_maxrss,
+	    r == EXIT_SUCCESS ? "" : "  (renewals timed out)");
+}
+
+static void
+lease_unlink(const struct interface *ifp)
+{
+	char leasefile[sizeof(LEASEFILE) + IF_NAMESIZE];
+
+	snprintf(leasefile, sizeof(leasefile), LEASEFILE, ifp->name, "");
+	unlink(leasefile);
+}
+
+static int
+scale_run(const char *cffile, char *argv0, unsigned long count,
+    uint32_t leasetime, unsigned long renewals)
+{
+	struct dhcpcd_ctx ctx;
+	struct scale s;
+	struct if_options *ifo;
+	struct interface *ifp;
+	unsigned char hwaddr[ETHER_ADDR_LEN];
+	char ifname[IF_NAMESIZE];
+	char *args[5];
+	unsigned long i;
+	int r;
+
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&s, 0, sizeof(s));
+	ctx.cffile = cffile;
+	ctx.pid_fd = ctx.control_fd = ctx.control_unpriv_fd = ctx.link_fd = -1;
+	TAILQ_INIT(&ctx.control_fds);
+#ifdef INET
+	ctx.udp_fd = -1;
+#endif
+	if ((ifo = read_config(&ctx, NULL, NULL, NULL, 0, NULL)) == NULL)
+		return EXIT_FAILURE;
+	ctx.options = ifo->options & ~(DHCPCD_DAEMONISE | DHCPCD_WAITIP);
+	free_options(ifo);
+	if ((ctx.eloop = eloop_init()) == NULL) {
+		perror("eloop_init");
+		return EXIT_FAILURE;
+	}
+	fakeif_init(&ctx);
+	s.ctx = &ctx;
+	s.count = count;
+	s.leasetime = leasetime;
+	s.renewals = renewals;
+	if (ctx.ifaces == NULL ||
+	    (s.ifaces = calloc(count, sizeof(*s.ifaces))) == NULL)
+	{
+		perror("scale");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < count; i++) {
+		snprintf(ifname, sizeof(ifname), "scale%lu", i);
+		scale_hwaddr(hwaddr, i);
+		s.ifaces[i] = fakeif_new(&ctx, ifname, hwaddr, sizeof(hwaddr));
+		if (s.ifaces[i] == NULL) {
+			perror(ifname);
+			return EXIT_FAILURE;
+		}
+		lease_unlink(s.ifaces[i]);
+	}
+
+	args[0] = argv0;
+	args[1] = UNCONST("--nodhcp6");
+	args[2] = UNCONST("-c");
+	args[3] = UNCONST("");
+	args[4] = NULL;
+	ctx.argv = args;
+	ctx.argc = 4;
+	fakeif_setsend(scale_send, &s);
+	eloop_setclock(ctx.eloop, fakeif_clock, scale_idle, &s);
+
+	clock_gettime(CLOCK_MONOTONIC, &s.wall[0]);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &s.cpu[0]);
+	fakeif_gettime(&s.start);
+	s.deadline = s.start;
+	s.deadline.tv_sec += SCALE_BINDTIME;
+	for (i = 0; i < count; i++)
+		dhcpcd_initstate(s.ifaces[i]);
+	if (ctx.ipv6 && fakeif_ndopen(&ctx) == -1) {
+		perror("fakeif_ndopen");
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < count; i++)
+		eloop_timeout_add_sec(ctx.eloop, 0,
+		    dhcpcd_startinterface, s.ifaces[i]);
+	r = eloop_start(&ctx);
+	report(&s, r);
+
+	if_batch_free(&ctx);
+	while ((ifp = TAILQ_FIRST(ctx.ifaces))) {
+		TAILQ_REMOVE(ctx.ifaces, ifp, next);
+		if_hashdel(&ctx, ifp);
+		lease_unlink(ifp);
+		if_free(ifp);
+	}
+	free(ctx.ifaces);
+	free(s.ifaces);
+	if_freehash(&ctx);
+	fakeif_free(&ctx);
+	free(ctx.duid);
+	ipv4_ctxfree(&ctx);
+	ipv6_ctxfree(&ctx);
+	free_config(&ctx);
+	eloop_free(ctx.eloop);
+	return r;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *cffile;
+	unsigned long count, renewals;
+	uint32_t leasetime;
+	pid_t pid;
+	size_t n;
+	int opt, logmask, i, r, status;
+
+	cffile = "/dev/null";
+	leasetime = SCALE_LEASETIME;
+	renewals = SCALE_RENEWALS;
+	logmask = LOG_UPTO(LOG_EMERG);
+	while ((opt = getopt(argc, argv, "df:l:r:")) != -1) {
+		switch (opt) {
+		case 'd':
+			logmask = LOG_UPTO(LOG_DEBUG);
+			break;
+		case 'f':
+			cffile = optarg;
+			break;
+		case 'l':
+			leasetime = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			renewals = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (leasetime < 60) {
+		fprintf(stderr, "scale: lease time must be at least 60\n");
+		return EXIT_FAILURE;
+	}
+
+	openlog("scale", LOG_PERROR, LOG_DAEMON);
+	setlogmask(logmask);
+
+	printf("%8s %10s %10s %8s %9s %12s %10s\n",
+	    "ifaces", "bind wall", "bind cpu", "bind vt",
+	    "renewals", "cpu/renew", "max rss");
+	printf("%8s %10s %10s %8s %9s %12s %10s\n",
+	    "", "s", "s", "s", "", "us", "KB");
+	r = EXIT_SUCCESS;
+	n = argc > optind ? (size_t)(argc - optind) :
+	    sizeof(default_counts) / sizeof(default_counts[0]);
+	for (i = 0; (size_t)i < n; i++) {
+		count = argc > optind ?
+		    strtoul(argv[optind + i], NULL, 0) : default_counts[i];
+		if (count == 0 || count > 0xfffff0) {
+			fprintf(stderr, "scale: %s: invalid count\n",
+			    argv[optind + i]);
+			return EXIT_FAILURE;
+		}
+		/* Each count runs in a fresh process so the RSS is its own */
+		fflush(stdout);
+		if ((pid = fork()) == -1) {
+			perror("fork");
+			return EXIT_FAILURE;
+		}
+		if (pid == 0) {
+			r = scale_run(cffile, argv[0], count,
+			    leasetime, renewals);
+			fflush(stdout);
+			exit(r);
+		}
+		if (waitpid(pid, &status, 0) == -1 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			r = EXIT_FAILURE;
+	}
+	return r;
+}
@@ -0,0 +1,318 @@
+/*
+ * dhcpcd - DHCP client daemon
+ * Copyright (c) 2006-2014 Roy Marples <roy@marples.name>
+ * All rights reserved
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Send commands to the control socket in pieces.
+ *
+ *	splitcmd [-d]
+ *
+ * A command is sent in two writes with a complete argument in the first,
+ * which must not be run until the rest arrives. A client which never
+ * terminates its command must still get a reply once it stops sending.
+ * Lastly a burst of commands larger than the read buffer is sent in
+ * one write, which must be answered in full although it takes several
+ * reads to get through it.
+ */
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../common.h"
+#include "../dhcpcd.h"
+#include "../control.h"
+#include "../eloop.h"
+
+#define SPLIT_IFNAME		"splitcmd0"
+#define SPLIT_GAP		10	/* milliseconds */
+#define SPLIT_WAIT		(CONTROL_LEGACY_WAIT * 4)
+#define SPLIT_BURST		200
+
+struct client {
+	int fd;
+	unsigned int replies;
+	unsigned int bad;
+	char buf[1024];
+	size_t buf_len;
+};
+
+struct split {
+	struct dhcpcd_ctx *ctx;
+	struct client c[3];
+	int failed;
+};
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: splitcmd [-d]\n");
+}
+
+static void
+split_fail(struct split *s, const char *what)
+{
+
+	fprintf(stderr, "splitcmd: %s\n", what);
+	s->failed = 1;
+	eloop_exit(s->ctx->eloop, EXIT_FAILURE);
+}
+
+static void
+split_after(struct split *s, unsigned int ms, void (*cb)(void *))
+{
+	struct timeval tv;
+
+	ms_to_tv(&tv, ms);
+	eloop_timeout_add_tv(s->ctx->eloop, &tv, cb, s);
+}
+
+/* Each reply is its length followed by the data */
+static void
+client_read(void *arg)
+{
+	struct client *c = arg;
+	ssize_t bytes;
+	size_t len;
+	char *p;
+
+	bytes = read(c->fd, c->buf + c->buf_len, sizeof(c->buf) - c->buf_len);
+	if (bytes <= 0) {
+		if (bytes == -1 && (errno == EINTR || errno == EAGAIN))
+			return;
+		c->bad++;
+		return;
+	}
+	c->buf_len += (size_t)bytes;
+	p = c->buf;
+	while (c->buf_len >= sizeof(len)) {
+		memcpy(&len, p, sizeof(len));
+		if (c->buf_len - sizeof(len) < len)
+			break;
+		if (len != strlen(VERSION) + 1 ||
+		    memcmp(p + sizeof(len), VERSION, len) != 0)
+			c->bad++;
+		c->replies++;
+		p += sizeof(len) + len;
+		c->buf_len -= sizeof(len) + len;
+	}
+	memmove(c->buf, p, c->buf_len);
+}
+
+static int
+client_open(struct split *s, struct client *c, const char *cmd, size_t len)
+{
+	struct sockaddr_un sa;
+
+	if ((c->fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		return -1;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strlcpy(sa.sun_path, s->ctx->control_sock, sizeof(sa.sun_path));
+	if (connect(c->fd, (struct sockaddr *)&sa, (socklen_t)SUN_LEN(&sa))
+	    == -1)
+		return -1;
+	if (eloop_event_add(s->ctx->eloop, c->fd, client_read, c, NULL, NULL)
+	    == -1)
+		return -1;
+	if (write(c->fd, cmd, len) != (ssize_t)len)
+		return -1;
+	return 0;
+}
+
+static void
+client_close(struct split *s, struct client *c)
+{
+
+	if (c->fd != -1) {
+		eloop_event_delete(s->ctx->eloop, c->fd, 0);
+		close(c->fd);
+		c->fd = -1;
+	}
+}
+
+static void
+split_checkburst(void *arg)
+{
+	struct split *s = arg;
+	struct client *c = &s->c[2];
+
+	if (c->bad)
+		split_fail(s, "bad reply to the burst");
+	else if (c->replies != SPLIT_BURST)
+		split_fail(s, "burst not answered in full");
+	else
+		eloop_exit(s->ctx->eloop, EXIT_SUCCESS);
+}
+
+static void
+split_burst(void *arg)
+{
+	struct split *s = arg;
+	char cmd[SPLIT_BURST * sizeof("--version\n")];
+	size_t i;
+
+	for (i = 0; i < SPLIT_BURST; i++)
+		memcpy(cmd + i * sizeof("--version\n"), "--version\n",
+		    sizeof("--version\n"));
+	if (sizeof(cmd) <= CONTROL_BUFFER_LEN)
+		split_fail(s, "burst fits in one read");
+	else if (client_open(s, &s->c[2], cmd, sizeof(cmd)) == -1)
+		split_fail(s, strerror(errno));
+	else
+		split_after(s, SPLIT_WAIT, split_checkburst);
+}
+
+static void
+split_checklegacy(void *arg)
+{
+	struct split *s = arg;
+	struct client *c = &s->c[1];
+
+	if (c->bad)
+		split_fail(s, "bad reply to the unterminated command");
+	else if (c->replies != 1)
+		split_fail(s, "unterminated command not answered");
+	else
+		split_burst(s);
+}
+
+static void
+split_legacy(struct split *s)
+{
+
+	if (client_open(s, &s->c[1], "--version", sizeof("--version")) == -1)
+		split_fail(s, strerror(errno));
+	else
+		split_after(s, SPLIT_WAIT, split_checklegacy);
+}
+
+/* Both pieces are one command, so there is only one reply */
+static void
+split_checksplit(void *arg)
+{
+	struct split *s = arg;
+	struct client *c = &s->c[0];
+
+	if (c->bad)
+		split_fail(s, "bad reply to the split command");
+	else if (c->replies != 1)
+		split_fail(s, c->replies == 0 ?
+		    "split command not answered" :
+		    "first piece of the split command run on its own");
+	else
+		split_legacy(s);
+}
+
+static void
+split_rest(void *arg)
+{
+	struct split *s = arg;
+
+	if (write(s->c[0].fd, "--version\n", sizeof("--version\n")) == -1)
+		split_fail(s, strerror(errno));
+	else
+		split_after(s, SPLIT_WAIT, split_checksplit);
+}
+
+static void
+split_start(void *arg)
+{
+	struct split *s = arg;
+
+	if (client_open(s, &s->c[0], "--version", sizeof("--version")) == -1)
+		split_fail(s, strerror(errno));
+	else
+		split_after(s, SPLIT_GAP, split_rest);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct dhcpcd_ctx ctx;
+	struct split s;
+	size_t i;
+	int opt, logmask, r;
+
+	logmask = LOG_UPTO(LOG_EMERG);
+	while ((opt = getopt(argc, argv, "d")) != -1) {
+		switch (opt) {
+		case 'd':
+			logmask = LOG_UPTO(LOG_DEBUG);
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	openlog("splitcmd", LOG_PERROR, LOG_DAEMON);
+	setlogmask(logmask);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.cffile = "/dev/null";
+	ctx.pid_fd = ctx.control_fd = ctx.control_unpriv_fd = ctx.link_fd = -1;
+	TAILQ_INIT(&ctx.control_fds);
+#ifdef INET
+	ctx.udp_fd = -1;
+#endif
+	ctx.control_queue_max = CONTROL_QUEUE_MAX;
+	ctx.control_queue_bytes_max = CONTROL_QUEUE_BYTES_MAX;
+	if ((ctx.eloop = eloop_init()) == NULL) {
+		perror("eloop_init");
+		return EXIT_FAILURE;
+	}
+	if (control_start(&ctx, SPLIT_IFNAME) == -1) {
+		perror("control_start");
+		return EXIT_FAILURE;
+	}
+
+	memset(&s, 0, sizeof(s));
+	s.ctx = &ctx;
+	for (i = 0; i < sizeof(s.c) / sizeof(s.c[0]); i++)
+		s.c[i].fd = -1;
+	eloop_timeout_add_sec(ctx.eloop, 0, split_start, &s);
+	r = eloop_start(&ctx);
+	if (r == EXIT_SUCCESS && !s.failed)
+		printf("split, unterminated and %d burst commands answered\n",
+		    SPLIT_BURST);
+
+	for (i = 0; i < sizeof(s.c) / sizeof(s.c[0]); i++)
+		client_close(&s, &s.c[i]);
+	control_stop(&ctx);
+	eloop_free(ctx.eloop);
+	return r == EXIT_SUCCESS && !s.failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}